@@ -0,0 +1,231 @@
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+#include "DallasHealth.h"
+
+#include <string.h>
+
+// 85C, the temperature register value after power-on
+#define POWER_ON_RAW 10880
+
+// reading status used while readByAlarm() runs to find the entries it
+// left alone
+#define UNCHANGED 0xFF
+
+DallasHealth::DallasHealth(DallasTemperature* sensors) {
+	_sensors = sensors;
+	reset();
+}
+
+// forgets the history of every device
+void DallasHealth::reset(void) {
+	memset(entries, 0, sizeof(entries));
+	cycle = 0;
+}
+
+// reads every device after a conversion, see the header
+uint8_t DallasHealth::read(DallasTemperature::reading_t* readings, uint8_t count) {
+
+	if (count > _sensors->getDeviceCount())
+		count = _sensors->getDeviceCount();
+	if (count > DALLAS_MAX_DEVICES)
+		count = DALLAS_MAX_DEVICES;
+
+	_sensors->readAll(readings, count);
+	return check(readings, count, nullptr);
+}
+
+#if REQUIRESALARMS
+
+// reads the devices that alarmed after a conversion, see the header
+uint8_t DallasHealth::readByAlarm(DallasTemperature::reading_t* readings, uint8_t count) {
+
+	uint8_t previous[DALLAS_MAX_DEVICES];
+
+	if (count > _sensors->getDeviceCount())
+		count = _sensors->getDeviceCount();
+	if (count > DALLAS_MAX_DEVICES)
+		count = DALLAS_MAX_DEVICES;
+
+	for (uint8_t i = 0; i < count; i++) {
+		previous[i] = readings[i].status;
+		readings[i].status = UNCHANGED;
+	}
+	_sensors->readByAlarm(readings, count);
+	return check(readings, count, previous);
+}
+
+#endif
+
+uint8_t DallasHealth::check(DallasTemperature::reading_t* readings, uint8_t count, const uint8_t* previous) {
+
+	DeviceAddress deviceAddress;
+	uint8_t budget = DALLAS_HEALTH_RETRY_BUDGET;
+	uint8_t good = 0;
+
+	cycle++;
+	for (uint8_t i = 0; i < count; i++) {
+		DallasTemperature::reading_t& reading = readings[i];
+
+		// entries readByAlarm() did not refresh were checked before
+		if (reading.status == UNCHANGED) {
+			reading.status = previous[i];
+			if (reading.status == DALLAS_READ_OK)
+				good++;
+			continue;
+		}
+		// other 1-Wire devices in the table have no temperature to check
+		if (!_sensors->getAddress(deviceAddress, i) || !_sensors->validFamily(deviceAddress))
+			continue;
+
+		Entry* entry = findEntry(deviceAddress, true);
+		health_t& health = entry->health;
+		uint8_t faults = 0;
+
+		entry->seen = cycle;
+		health.cycles++;
+
+		// quarantined devices get no retries, they are only watched
+		for (uint8_t tries = 0;; tries++) {
+			if (reading.status == DALLAS_READ_CRC_ERROR)
+				health.crcErrors++;
+			else if (reading.status == DALLAS_READ_DISCONNECTED)
+				health.disconnects++;
+			else
+				break;
+			if (health.quarantined || tries == DALLAS_HEALTH_RETRIES || budget == 0)
+				break;
+			budget--;
+			health.retries++;
+			faults++;
+			_sensors->readByIndex(i, reading);
+		}
+
+		bool failed = reading.status != DALLAS_READ_OK;
+		if (!failed) {
+			reading.status = filter(*entry, reading.raw);
+			if (reading.status != DALLAS_READ_OK)
+				faults++;
+		}
+		score(*entry, failed, faults);
+
+		if (reading.status == DALLAS_READ_OK && health.quarantined)
+			reading.status = DALLAS_READ_QUARANTINED;
+		if (reading.status == DALLAS_READ_OK) {
+			good++;
+		} else {
+			reading.raw = DEVICE_DISCONNECTED_RAW;
+#if REQUIRESALARMS
+			// DallasTemperature took the reading and centred the alarm
+			// window on it. read the device again next cycle, so a step is
+			// confirmed and probation goes on without waiting for an alarm
+			_sensors->refreshByIndex(i);
+#endif
+		}
+	}
+
+	return good;
+}
+
+uint8_t DallasHealth::filter(Entry& entry, int32_t raw) {
+
+	health_t& health = entry.health;
+	bool known = health.lastGood != DEVICE_DISCONNECTED_RAW;
+	int32_t step = raw - health.lastGood;
+	bool jump = known && (step > DALLAS_HEALTH_MAX_STEP || step < -DALLAS_HEALTH_MAX_STEP);
+
+	// MAX31850 fault codes lie below the disconnected value
+	if (raw <= DEVICE_DISCONNECTED_RAW) {
+		health.outliers++;
+		return DALLAS_READ_REJECTED;
+	}
+
+	// a device that lost power reports 85C until it converts again. only
+	// believe it right after a reading close to it
+	if (raw == POWER_ON_RAW && (!known || jump)) {
+		health.sentinels++;
+		return DALLAS_READ_REJECTED;
+	}
+
+	// a real step change is still there in the next reading, a glitch is not
+	if (jump) {
+		step = raw - entry.pending;
+		if (entry.pending == DEVICE_DISCONNECTED_RAW
+		        || step > DALLAS_HEALTH_MAX_STEP || step < -DALLAS_HEALTH_MAX_STEP) {
+			entry.pending = raw;
+			health.outliers++;
+			return DALLAS_READ_REJECTED;
+		}
+	}
+
+	entry.pending = DEVICE_DISCONNECTED_RAW;
+	health.lastGood = raw;
+	return DALLAS_READ_OK;
+}
+
+void DallasHealth::score(Entry& entry, bool failed, uint8_t faults) {
+
+	health_t& health = entry.health;
+	uint16_t score = health.score + faults + (failed ? 4 : 0);
+
+	if (failed || faults) {
+		entry.clean = 0;
+	} else {
+		if (score)
+			score--;
+		if (entry.clean < 255)
+			entry.clean++;
+	}
+	health.score = score > 255 ? 255 : score;
+
+	if (!health.quarantined && health.score >= DALLAS_HEALTH_QUARANTINE) {
+		health.quarantined = true;
+		health.quarantines++;
+	} else if (health.quarantined && entry.clean >= DALLAS_HEALTH_PROBATION) {
+		health.quarantined = false;
+		health.score = 0;
+	}
+}
+
+DallasHealth::Entry* DallasHealth::findEntry(const uint8_t* deviceAddress, bool create) {
+
+	Entry* victim = nullptr;
+
+	for (uint8_t i = 0; i < DALLAS_MAX_DEVICES; i++) {
+		Entry& entry = entries[i];
+		if (entry.used) {
+			if (memcmp(entry.deviceAddress, deviceAddress, sizeof(DeviceAddress)) == 0)
+				return &entry;
+			if (victim == nullptr || (victim->used && entry.seen < victim->seen))
+				victim = &entry;
+		} else if (victim == nullptr || victim->used) {
+			victim = &entry;
+		}
+	}
+	if (!create)
+		return nullptr;
+
+	memset(victim, 0, sizeof(Entry));
+	memcpy(victim->deviceAddress, deviceAddress, sizeof(DeviceAddress));
+	victim->used = true;
+	victim->pending = DEVICE_DISCONNECTED_RAW;
+	victim->health.lastGood = DEVICE_DISCONNECTED_RAW;
+	return victim;
+}
+
+// copies the health of a device, see the header
+bool DallasHealth::getHealth(const uint8_t* deviceAddress, health_t& health) {
+	Entry* entry = findEntry(deviceAddress, false);
+	if (entry == nullptr)
+		return false;
+	health = entry->health;
+	return true;
+}
+
+// returns true if a device is quarantined
+bool DallasHealth::isQuarantined(const uint8_t* deviceAddress) {
+	Entry* entry = findEntry(deviceAddress, false);
+	return entry != nullptr && entry->health.quarantined;
+}
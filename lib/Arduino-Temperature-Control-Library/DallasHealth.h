@@ -0,0 +1,129 @@
+#ifndef DallasHealth_h
+#define DallasHealth_h
+
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+// Sensor health monitoring on top of DallasTemperature. Every reading
+// goes through bounded retries and plausibility filters before it is
+// handed out, and sensors that keep failing are quarantined, so a caller
+// that only stores DALLAS_READ_OK readings never stores bad data:
+//
+//    sensors.requestTemperatures();
+//    uint8_t good = health.read(readings, count);
+
+#include "DallasTemperature.h"
+
+// retries of a failed read per device and cycle
+#ifndef DALLAS_HEALTH_RETRIES
+#define DALLAS_HEALTH_RETRIES 2
+#endif
+
+// retries of all devices together per cycle
+#ifndef DALLAS_HEALTH_RETRY_BUDGET
+#define DALLAS_HEALTH_RETRY_BUDGET 4
+#endif
+
+// largest change from the last accepted reading, in 1/128 degrees C, that
+// is accepted at once. a larger step is only accepted when the next
+// reading confirms it
+#ifndef DALLAS_HEALTH_MAX_STEP
+#define DALLAS_HEALTH_MAX_STEP 640
+#endif
+
+// fault score at which a device is quarantined. a cycle without a valid
+// reading adds 4, a retry or a rejected reading adds 1 and a clean cycle
+// takes 1 off
+#ifndef DALLAS_HEALTH_QUARANTINE
+#define DALLAS_HEALTH_QUARANTINE 16
+#endif
+
+// clean cycles in a row that release a device from quarantine
+#ifndef DALLAS_HEALTH_PROBATION
+#define DALLAS_HEALTH_PROBATION 10
+#endif
+
+// Reading status codes added to the DALLAS_READ_* codes of readAll()
+#define DALLAS_READ_REJECTED    3  // read fine but failed a plausibility filter
+#define DALLAS_READ_QUARANTINED 4  // device is quarantined, reading withheld
+
+class DallasHealth {
+public:
+
+	DallasHealth(DallasTemperature*);
+
+	// reads every device after a conversion, like readAll(). failed reads
+	// are retried within the DALLAS_HEALTH_RETRIES/_RETRY_BUDGET limits
+	// and every reading is checked against the 85C power-on value and the
+	// device's rate of change. readings that are not DALLAS_READ_OK carry
+	// DEVICE_DISCONNECTED_RAW. returns the number of DALLAS_READ_OK
+	// readings
+	uint8_t read(DallasTemperature::reading_t*, uint8_t);
+
+#if REQUIRESALARMS
+	// the same checks on top of DallasTemperature::readByAlarm(). entries
+	// of devices that stayed inside their alarm window keep the reading
+	// and status of the cycle that last read them. devices whose reading
+	// was not accepted are read again in the next cycle
+	uint8_t readByAlarm(DallasTemperature::reading_t*, uint8_t);
+#endif
+
+	struct health_t {
+		uint32_t cycles;      // read() calls that included the device
+		uint32_t crcErrors;   // reads with a CRC error, retries included
+		uint32_t disconnects; // reads without an answer, retries included
+		uint32_t retries;     // reads repeated after a failure
+		uint32_t sentinels;   // 85C power-on values rejected
+		uint32_t outliers;    // readings rejected by the rate of change filter
+		uint32_t quarantines; // times the device was quarantined
+		int32_t lastGood;     // last accepted reading, DEVICE_DISCONNECTED_RAW if none
+		uint8_t score;        // fault score, see DALLAS_HEALTH_QUARANTINE
+		bool quarantined;
+	};
+
+	// copies the health of a device, returns false if it has not been
+	// read yet
+	bool getHealth(const uint8_t*, health_t&);
+
+	// returns true if a device is quarantined
+	bool isQuarantined(const uint8_t*);
+
+	// forgets the history of every device
+	void reset(void);
+
+private:
+
+	DallasTemperature* _sensors;
+
+	// health of a device, kept by address so it survives changes to the
+	// device table. 'seen' is the cycle the device was last read in
+	struct Entry {
+		DeviceAddress deviceAddress;
+		bool used;
+		uint32_t seen;
+		uint8_t clean;    // clean cycles in a row
+		int32_t pending;  // large step waiting to be confirmed, DEVICE_DISCONNECTED_RAW if none
+		health_t health;
+	};
+	Entry entries[DALLAS_MAX_DEVICES];
+	uint32_t cycle;
+
+	// returns the entry of a device, taking a free or the least recently
+	// seen one for a new device
+	Entry* findEntry(const uint8_t*, bool create);
+
+	// runs retries, filters and scoring over the entries of a read. with
+	// 'previous' set, entries left UNCHANGED get their previous status back
+	uint8_t check(DallasTemperature::reading_t*, uint8_t, const uint8_t* previous);
+
+	// checks a successful reading against the filters, returns the
+	// DALLAS_READ_* status to report
+	uint8_t filter(Entry&, int32_t);
+
+	// books the outcome of a cycle into the fault score and quarantine state
+	void score(Entry&, bool failed, uint8_t faults);
+};
+
+#endif
@@ -52,14 +52,32 @@ extern "C" {
 
 #define MAX_CONVERSION_TIMEOUT		750
 
+// 85C, the temperature register value after power-on, in 1/128 degrees C
+#define POWER_ON_RAW 10880
+
 // Alarm handler
 #define NO_ALARM_HANDLER ((AlarmHandler *)0)
 
+// Device event handler
+#define NO_DEVICE_EVENT_HANDLER ((DeviceEventHandler *)0)
+
+// Conversion scheduler phases
+#define CONV_IDLE     0
+#define CONV_ALL      1  // one conversion of every device
+#define CONV_SINGLE   2  // parasite devices one at a time
+#define CONV_EXTERNAL 3  // waiting for the externally powered devices
+
+// Families pollDevices() searches for new devices
+static const uint8_t pollFamilies[] = {
+	DS18S20MODEL, DS18B20MODEL, DS1822MODEL, DS1825MODEL, DS28EA00MODEL
+};
+
 
 DallasTemperature::DallasTemperature() {
 #if REQUIRESALARMS
 	setAlarmHandler(NO_ALARM_HANDLER);
 #endif
+	setDeviceEventHandler(NO_DEVICE_EVENT_HANDLER);
 	useExternalPullup = false;
 }
 
@@ -100,39 +118,189 @@ void DallasTemperature::setOneWire(OneWire* _oneWire) {
 	_wire = _oneWire;
 	devices = 0;
 	ds18Count = 0;
+	tableCount = 0;
+	pollCursor = 0;
+	pollFamily = 0;
+	pollSearching = false;
 	parasite = false;
 	bitResolution = 9;
 	waitForConversion = true;
 	checkForConversion = true;
 	autoSaveScratchPad = true;
+	fastRead = false;
+	adaptiveResolution = false;
+	adaptiveLowResolution = 9;
+#if REQUIRESALARMS
+	alarmRefresh = 0;
+#endif
+	convPhase = CONV_IDLE;
+	memset(&convStats, 0, sizeof(convStats));
 
 }
 
 // initialise the bus
 void DallasTemperature::begin(void) {
+	rescan();
+}
+
+// enumerate the bus and rebuild the device table
+// returns the number of devices found
+uint8_t DallasTemperature::rescan(void) {
 
 	DeviceAddress deviceAddress;
 
 	_wire->reset_search();
 	devices = 0; // Reset the number of devices when we enumerate wire devices
 	ds18Count = 0; // Reset number of DS18xxx Family devices
+	tableCount = 0;
+	pollCursor = 0;
+	pollFamily = 0;
+	pollSearching = false;
+	parasite = false;
 
 	while (_wire->search(deviceAddress)) {
 
 		if (validAddress(deviceAddress)) {
+			DeviceInfo* info = nullptr;
+			if (tableCount < DALLAS_MAX_DEVICES) {
+				info = &deviceTable[tableCount++];
+				memcpy(info->deviceAddress, deviceAddress, sizeof(DeviceAddress));
+				info->resolution = 0;
+				info->parasite = false;
+				info->missed = 0;
+				info->configValid = false;
+				info->borrowed = false;
+				clearReadState(*info);
+			}
 			devices++;
 
 			if (validFamily(deviceAddress)) {
 				ds18Count++;
 
-				if (!parasite && readPowerSupply(deviceAddress))
+				bool p = queryPowerSupply(deviceAddress);
+				if (p)
 					parasite = true;
 
+				// fills the configuration cache of the table entry
 				uint8_t b = getResolution(deviceAddress);
 				if (b > bitResolution) bitResolution = b;
+
+				if (info) {
+					info->resolution = b;
+					info->parasite = p;
+				}
 			}
 		}
 	}
+	return devices;
+}
+
+// checks one cached device or takes one search step for new devices
+// returns true if a device was added or removed
+bool DallasTemperature::pollDevices(void) {
+
+	// verify the cached devices one per call
+	if (pollCursor < tableCount) {
+		DeviceInfo& info = deviceTable[pollCursor];
+		if (_wire->verify(info.deviceAddress)) {
+			info.missed = 0;
+		} else {
+			// reload the configuration if the device comes back, it may
+			// have been power cycled
+			info.configValid = false;
+			if (++info.missed >= DALLAS_POLL_MISSES) {
+				DeviceAddress deviceAddress;
+				memcpy(deviceAddress, info.deviceAddress, sizeof(DeviceAddress));
+				removeDevice(pollCursor); // the next entry moves to pollCursor
+				if (_DeviceEventHandler != NO_DEVICE_EVENT_HANDLER)
+					_DeviceEventHandler(deviceAddress, false);
+				return true;
+			}
+		}
+		pollCursor++;
+		return false;
+	}
+
+	// new devices can only be told apart when the table holds the whole bus
+	if (tableCount != devices || pollFamily >= sizeof(pollFamilies)) {
+		pollCursor = 0;
+		pollFamily = 0;
+		pollSearching = false;
+		return false;
+	}
+
+	// then one search step per call through each supported family
+	DeviceAddress deviceAddress;
+	if (!pollSearching) {
+		_wire->target_search(pollFamilies[pollFamily]);
+		pollSearching = true;
+	}
+	if (!_wire->search(deviceAddress) || deviceAddress[DSROM_FAMILY] != pollFamilies[pollFamily]) {
+		pollSearching = false;
+		pollFamily++;
+		return false;
+	}
+	if (!validAddress(deviceAddress) || findDevice(deviceAddress) >= 0)
+		return false;
+
+	addDevice(deviceAddress);
+	if (_DeviceEventHandler != NO_DEVICE_EVENT_HANDLER)
+		_DeviceEventHandler(deviceAddress, true);
+	return true;
+}
+
+// sets the hot-plug event handler
+void DallasTemperature::setDeviceEventHandler(const DeviceEventHandler *handler) {
+	_DeviceEventHandler = handler;
+}
+
+void DallasTemperature::addDevice(const uint8_t* deviceAddress) {
+
+	DeviceInfo* info = nullptr;
+	if (tableCount < DALLAS_MAX_DEVICES) {
+		info = &deviceTable[tableCount++];
+		memcpy(info->deviceAddress, deviceAddress, sizeof(DeviceAddress));
+		info->missed = 0;
+		info->configValid = false;
+		info->borrowed = false;
+		clearReadState(*info);
+	}
+
+	bool p = queryPowerSupply(deviceAddress);
+	uint8_t b = getResolution(deviceAddress);
+
+	devices++;
+	ds18Count++;
+	if (p)
+		parasite = true;
+	if (b > bitResolution)
+		bitResolution = b;
+
+	if (info) {
+		info->resolution = b;
+		info->parasite = p;
+	}
+}
+
+void DallasTemperature::removeDevice(uint8_t index) {
+
+	if (validFamily(deviceTable[index].deviceAddress))
+		ds18Count--;
+	devices--;
+	tableCount--;
+	for (uint8_t i = index; i < tableCount; i++)
+		deviceTable[i] = deviceTable[i + 1];
+}
+
+void DallasTemperature::clearReadState(DeviceInfo& info) {
+	info.lastRaw = DEVICE_DISCONNECTED_RAW;
+	info.sinceAudit = 0;
+	memset(&info.stats, 0, sizeof(info.stats));
+	info.prevRaw = DEVICE_DISCONNECTED_RAW;
+	info.steady = 0;
+	info.precise = false;
+	info.window = false;
+	info.unconverted = false;
 }
 
 // returns the number of devices found on the bus
@@ -153,6 +321,15 @@ bool DallasTemperature::validAddress(const uint8_t* deviceAddress) {
 // returns true if the device was found
 bool DallasTemperature::getAddress(uint8_t* deviceAddress, uint8_t index) {
 
+	if (index < tableCount) {
+		memcpy(deviceAddress, deviceTable[index].deviceAddress, sizeof(DeviceAddress));
+		return true;
+	}
+	// the table holds every device unless the bus has more than
+	// DALLAS_MAX_DEVICES, or begin() has not been called yet
+	if (tableCount != 0 && tableCount == devices)
+		return false;
+
 	uint8_t depth = 0;
 
 	_wire->reset_search();
@@ -167,6 +344,15 @@ bool DallasTemperature::getAddress(uint8_t* deviceAddress, uint8_t index) {
 
 }
 
+// returns the device table index for an address, -1 if it is not cached
+int8_t DallasTemperature::findDevice(const uint8_t* deviceAddress) {
+	for (uint8_t i = 0; i < tableCount; i++) {
+		if (memcmp(deviceTable[i].deviceAddress, deviceAddress, sizeof(DeviceAddress)) == 0)
+			return i;
+	}
+	return -1;
+}
+
 // attempt to determine if the device at the given address is connected to the bus
 bool DallasTemperature::isConnected(const uint8_t* deviceAddress) {
 
@@ -186,15 +372,8 @@ bool DallasTemperature::isConnected(const uint8_t* deviceAddress,
 bool DallasTemperature::readScratchPad(const uint8_t* deviceAddress,
                                        uint8_t* scratchPad) {
 
-	// send the reset command and fail fast
-	int b = _wire->reset();
-	if (b == 0)
-		return false;
-
-	_wire->select(deviceAddress);
-	_wire->write(READSCRATCH);
-
-	// Read all registers in a simple loop
+	// reset, select, READSCRATCH and the 9 byte read run as one
+	// transaction; it fails fast when no device answers the reset.
 	// byte 0: temperature LSB
 	// byte 1: temperature MSB
 	// byte 2: high alarm temp
@@ -207,12 +386,11 @@ bool DallasTemperature::readScratchPad(const uint8_t* deviceAddress,
 	// byte 7: DS18S20: COUNT_PER_C
 	//         DS18B20 & DS1822: store for crc
 	// byte 8: SCRATCHPAD_CRC
-	for (uint8_t i = 0; i < 9; i++) {
-		scratchPad[i] = _wire->read();
-	}
+	static const uint8_t command[] = { READSCRATCH };
+	OneWireTransaction txn = { deviceAddress, command, 1, scratchPad, 9,
+	                           ONEWIRE_TXN_RESET | ONEWIRE_TXN_RESET_AFTER };
 
-	b = _wire->reset();
-	return (b == 1);
+	return _wire->transaction(txn) == ONEWIRE_TXN_OK;
 }
 
 void DallasTemperature::writeScratchPad(const uint8_t* deviceAddress,
@@ -228,6 +406,10 @@ void DallasTemperature::writeScratchPad(const uint8_t* deviceAddress,
 	if (deviceAddress[DSROM_FAMILY] != DS18S20MODEL)
 		_wire->write(scratchPad[CONFIGURATION]);
 
+	int8_t index = findDevice(deviceAddress);
+	if (index >= 0)
+		storeConfig(deviceTable[index], scratchPad);
+
 	if (autoSaveScratchPad)
 		saveScratchPad(deviceAddress);
 	else
@@ -240,6 +422,19 @@ void DallasTemperature::writeScratchPad(const uint8_t* deviceAddress,
 // uses parasite mode.
 // See issue #145
 bool DallasTemperature::readPowerSupply(const uint8_t* deviceAddress)
+{
+	if (deviceAddress != nullptr) {
+		int8_t index = findDevice(deviceAddress);
+		// only DS18xxx family entries have their power mode read
+		if (index >= 0 && validFamily(deviceAddress))
+			return deviceTable[index].parasite;
+	}
+	return queryPowerSupply(deviceAddress);
+}
+
+// asks the device, or every device when no address is given, whether it
+// runs on parasite power
+bool DallasTemperature::queryPowerSupply(const uint8_t* deviceAddress)
 {
 	bool parasiteMode = false;
 	_wire->reset();
@@ -261,9 +456,8 @@ void DallasTemperature::setResolution(uint8_t newResolution) {
 
 	bitResolution = constrain(newResolution, 9, 12);
 	DeviceAddress deviceAddress;
-	_wire->reset_search();
 	for (uint8_t i = 0; i < devices; i++) {
-		if(_wire->search(deviceAddress) && validAddress(deviceAddress)) {
+		if (getAddress(deviceAddress, i)) {
 			setResolution(deviceAddress, bitResolution, true);
 		}
 	}
@@ -317,6 +511,9 @@ bool DallasTemperature::setResolution(const uint8_t* deviceAddress,
 					scratchPad[CONFIGURATION] = newValue;
 					writeScratchPad(deviceAddress, scratchPad);
 				}
+				int8_t index = findDevice(deviceAddress);
+				if (index >= 0)
+					deviceTable[index].resolution = newResolution;
 				// done
 				success = true;
 			}
@@ -326,22 +523,29 @@ bool DallasTemperature::setResolution(const uint8_t* deviceAddress,
 	// do we need to update the max resolution used?
 	if (skipGlobalBitResolutionCalculation == false) {
 		bitResolution = newResolution;
-		if (devices > 1) {
-			DeviceAddress deviceAddr;
-			_wire->reset_search();
-			for (uint8_t i = 0; i < devices; i++) {
-				if (bitResolution == 12) break;
-				if (_wire->search(deviceAddr) && validAddress(deviceAddr)) {
-					uint8_t b = getResolution(deviceAddr);
-					if (b > bitResolution) bitResolution = b;
-				}
-			}
-		}
+		if (devices > 1)
+			updateBitResolution();
 	}
 
 	return success;
 }
 
+// raise bitResolution to the highest device resolution, taken from the
+// device table where possible
+void DallasTemperature::updateBitResolution(void) {
+	for (uint8_t i = 0; i < devices && bitResolution < 12; i++) {
+		uint8_t b = 0;
+		if (i < tableCount) {
+			b = deviceTable[i].resolution;
+		} else {
+			DeviceAddress deviceAddress;
+			if (getAddress(deviceAddress, i))
+				b = getResolution(deviceAddress);
+		}
+		if (b > bitResolution) bitResolution = b;
+	}
+}
+
 
 // returns the global resolution
 uint8_t DallasTemperature::getResolution() {
@@ -352,35 +556,133 @@ uint8_t DallasTemperature::getResolution() {
 // returns 0 if device not found
 uint8_t DallasTemperature::getResolution(const uint8_t* deviceAddress) {
 
+	if (findDevice(deviceAddress) >= 0) {
+		DeviceInfo* info = cachedConfig(deviceAddress);
+		return info ? info->resolution : 0;
+	}
+
 	// DS1820 and DS18S20 have no resolution configuration register
 	if (deviceAddress[DSROM_FAMILY] == DS18S20MODEL)
 		return 12;
 
 	ScratchPad scratchPad;
-	if (isConnected(deviceAddress, scratchPad)) {
+	if (isConnected(deviceAddress, scratchPad))
+		return scratchPadResolution(deviceAddress, scratchPad);
+	return 0;
+
+}
 
-		// MAX31850 has no resolution configuration register
-		if (deviceAddress[DSROM_FAMILY] == DS1825MODEL && scratchPad[CONFIGURATION] & 0x80)
-			return 12;
+// returns the resolution encoded in a scratchpad, 0 if unknown
+uint8_t DallasTemperature::scratchPadResolution(const uint8_t* deviceAddress,
+                                                const uint8_t* scratchPad) {
 
-		switch (scratchPad[CONFIGURATION]) {
-		case TEMP_12_BIT:
-			return 12;
+	// DS1820 and DS18S20 have no resolution configuration register
+	if (deviceAddress[DSROM_FAMILY] == DS18S20MODEL)
+		return 12;
 
-		case TEMP_11_BIT:
-			return 11;
+	// MAX31850 has no resolution configuration register
+	if (deviceAddress[DSROM_FAMILY] == DS1825MODEL && scratchPad[CONFIGURATION] & 0x80)
+		return 12;
 
-		case TEMP_10_BIT:
-			return 10;
+	switch (scratchPad[CONFIGURATION]) {
+	case TEMP_12_BIT:
+		return 12;
 
-		case TEMP_9_BIT:
-			return 9;
-		}
+	case TEMP_11_BIT:
+		return 11;
+
+	case TEMP_10_BIT:
+		return 10;
+
+	case TEMP_9_BIT:
+		return 9;
 	}
 	return 0;
 
 }
 
+// returns the cached configuration of a table device, loading it first if
+// it is stale
+DallasTemperature::DeviceInfo* DallasTemperature::cachedConfig(const uint8_t* deviceAddress) {
+
+	int8_t index = findDevice(deviceAddress);
+	if (index < 0)
+		return nullptr;
+
+	DeviceInfo& info = deviceTable[index];
+	if (!info.configValid) {
+		ScratchPad scratchPad;
+		if (!isConnected(deviceAddress, scratchPad))
+			return nullptr;
+		storeConfig(info, scratchPad);
+		info.configValid = true;
+	}
+	return &info;
+
+}
+
+void DallasTemperature::storeConfig(DeviceInfo& info, const uint8_t* scratchPad) {
+
+	// a readByAlarm() window in TH/TL is not the caller's
+	if (!info.borrowed) {
+		info.highAlarm = scratchPad[HIGH_ALARM_TEMP];
+		info.lowAlarm = scratchPad[LOW_ALARM_TEMP];
+	}
+	info.config = scratchPad[CONFIGURATION];
+	uint8_t b = scratchPadResolution(info.deviceAddress, scratchPad);
+	if (b)
+		info.resolution = b;
+
+}
+
+void DallasTemperature::invalidateConfig(void) {
+	for (uint8_t i = 0; i < tableCount; i++)
+		deviceTable[i].configValid = false;
+}
+
+bool DallasTemperature::writeAlarmBytes(DeviceInfo& info, uint8_t high, uint8_t low) {
+
+	uint8_t config = info.resolution >= 9 ? ((info.resolution - 9) << 5) | 0x1F : TEMP_12_BIT;
+	uint8_t command[4] = { WRITESCRATCH, high, low, config };
+
+	// DS1820 and DS18S20 have no configuration register
+	OneWireTransaction txn = { info.deviceAddress, command,
+	                           (uint8_t)(info.deviceAddress[DSROM_FAMILY] == DS18S20MODEL ? 3 : 4),
+	                           nullptr, 0, ONEWIRE_TXN_RESET | ONEWIRE_TXN_RESET_AFTER };
+	return _wire->transaction(txn) == ONEWIRE_TXN_OK;
+}
+
+// readByAlarm() windows live in the scratchpad only, an EEPROM copy has to
+// find the caller's TH/TL there
+bool DallasTemperature::restoreAlarms(const uint8_t* deviceAddress) {
+
+	for (uint8_t i = 0; i < tableCount; i++) {
+		DeviceInfo& info = deviceTable[i];
+		if (!info.borrowed)
+			continue;
+		if (deviceAddress && memcmp(deviceAddress, info.deviceAddress, sizeof(DeviceAddress)) != 0)
+			continue;
+		if (!writeAlarmBytes(info, info.highAlarm, info.lowAlarm))
+			return false;
+		info.borrowed = false;
+		info.window = false;
+	}
+	return true;
+}
+
+void DallasTemperature::takeBackAlarms(const uint8_t* deviceAddress, uint8_t* scratchPad) {
+
+	int8_t index = findDevice(deviceAddress);
+	if (index < 0 || !deviceTable[index].borrowed)
+		return;
+
+	DeviceInfo& info = deviceTable[index];
+	scratchPad[HIGH_ALARM_TEMP] = info.highAlarm;
+	scratchPad[LOW_ALARM_TEMP] = info.lowAlarm;
+	info.borrowed = false;
+	info.window = false;
+}
+
 
 // sets the value of the waitForConversion flag
 // TRUE : function requestTemperature() etc returns when conversion is ready
@@ -418,9 +720,12 @@ DallasTemperature::request_t DallasTemperature::requestTemperatures() {
 	DallasTemperature::request_t req = {};
 	req.result = true;
 
-	_wire->reset();
+	if (!_wire->reset())
+		invalidateConfig();
 	_wire->skip();
 	_wire->write(STARTCONVO, parasite);
+	for (uint8_t i = 0; i < tableCount; i++)
+		deviceTable[i].unconverted = false;
 
 	// ASYNC mode?
 	req.timestamp = millis();
@@ -441,9 +746,18 @@ DallasTemperature::request_t DallasTemperature::requestTemperaturesByAddress(con
 		return req; //Device disconnected
 	}
 
-	_wire->reset();
+	// the resolution may have come from the cache, so the reset is the
+	// presence check
+	if (!_wire->reset()) {
+		invalidateConfig();
+		req.result = false;
+		return req;
+	}
 	_wire->select(deviceAddress);
 	_wire->write(STARTCONVO, parasite);
+	int8_t index = findDevice(deviceAddress);
+	if (index >= 0)
+		deviceTable[index].unconverted = false;
 
 	req.timestamp = millis();
 	// ASYNC mode?
@@ -457,6 +771,158 @@ DallasTemperature::request_t DallasTemperature::requestTemperaturesByAddress(con
 
 }
 
+// starts a non-blocking conversion of every device, see the header
+bool DallasTemperature::startConversion(void) {
+
+	uint8_t parasites = 0;
+	uint8_t resolution = 0;
+	uint8_t i;
+
+	memset(&convStats, 0, sizeof(convStats));
+	convStart = millis();
+	convPhase = CONV_IDLE;
+
+	for (i = 0; i < tableCount; i++) {
+		deviceTable[i].unconverted = false;
+		if (validFamily(deviceTable[i].deviceAddress) && deviceTable[i].parasite)
+			parasites++;
+	}
+
+	// a single skip ROM conversion if the pull-up can carry all of them
+	if ((uint32_t)parasites * DALLAS_CONVERSION_UA <= DALLAS_PULLUP_BUDGET_UA) {
+		if (!_wire->reset()) {
+			invalidateConfig();
+			return false;
+		}
+		_wire->skip();
+		_wire->write(STARTCONVO, parasite);
+		openWindow(millisToWaitForConversion(bitResolution), parasite);
+		convPhase = CONV_ALL;
+		return true;
+	}
+
+	// 1-Wire cannot address a subset of devices in one command, and any
+	// bus traffic drops the pull-up, so over budget every parasite device
+	// gets its own window. externally powered devices are started first
+	// and convert during those windows
+	for (i = 0; i < tableCount; i++) {
+		DeviceInfo& info = deviceTable[i];
+		if (!validFamily(info.deviceAddress) || info.parasite)
+			continue;
+		if (!_wire->reset()) {
+			invalidateConfig();
+			return false;
+		}
+		_wire->select(info.deviceAddress);
+		_wire->write(STARTCONVO);
+		if (info.resolution > resolution)
+			resolution = info.resolution;
+	}
+	externalMillis = resolution ? millisToWaitForConversion(resolution) : 0;
+
+	convNext = 0;
+	convPhase = CONV_SINGLE;
+	if (!startNextParasite()) {
+		// every parasite device missed presence
+		if (!resolution) {
+			convPhase = CONV_IDLE;
+			return false;
+		}
+		convPhase = CONV_EXTERNAL;
+	}
+	return true;
+}
+
+bool DallasTemperature::startNextParasite(void) {
+
+	for (; convNext < tableCount; convNext++) {
+		DeviceInfo& info = deviceTable[convNext];
+		if (!validFamily(info.deviceAddress) || !info.parasite)
+			continue;
+		// its scratchpad still holds the previous conversion, so readers
+		// are told instead of getting that value
+		if (!_wire->reset()) {
+			invalidateConfig();
+			info.unconverted = true;
+			convStats.notConverted++;
+			continue;
+		}
+		_wire->select(info.deviceAddress);
+		_wire->write(STARTCONVO, 1);
+		openWindow(millisToWaitForConversion(info.resolution ? info.resolution : 12), true);
+		convNext++;
+		return true;
+	}
+	return false;
+}
+
+// advances the conversion scheduler, returns true once every conversion
+// is done
+bool DallasTemperature::runConversion(void) {
+
+	unsigned long now = millis();
+
+	switch (convPhase) {
+	case CONV_ALL:
+		// only externally powered devices can be polled
+		if (checkForConversion && !convPowered) {
+			if (!isConversionComplete() && now - windowStart < MAX_CONVERSION_TIMEOUT)
+				return false;
+		} else if (now - windowStart < windowMillis) {
+			return false;
+		}
+		closeWindow(now);
+		break;
+	case CONV_SINGLE:
+		if (now - windowStart < windowMillis)
+			return false;
+		closeWindow(now);
+		if (startNextParasite())
+			return false;
+		convPhase = CONV_EXTERNAL;
+		// fall through
+	case CONV_EXTERNAL:
+		if (now - convStart < externalMillis)
+			return false;
+		break;
+	default:
+		return true;
+	}
+
+	convPhase = CONV_IDLE;
+	convStats.totalMillis = now - convStart;
+	return true;
+}
+
+void DallasTemperature::openWindow(uint16_t length, bool powered) {
+	convPowered = powered;
+	if (powered)
+		activateExternalPullup();
+	windowStart = millis();
+	windowMillis = length;
+}
+
+void DallasTemperature::closeWindow(unsigned long now) {
+
+	uint32_t actual = now - windowStart;
+
+	if (convPowered) {
+		deactivateExternalPullup();
+		_wire->depower();
+		convPowered = false;
+	}
+	convStats.windows++;
+	convStats.expectedMillis += windowMillis;
+	convStats.actualMillis += actual;
+	if (actual > windowMillis && actual - windowMillis > convStats.worstOverrun)
+		convStats.worstOverrun = actual - windowMillis;
+}
+
+// copies the conversion windows of the last cycle
+void DallasTemperature::getConversionStats(conversionStats_t& stats) {
+	stats = convStats;
+}
+
 // Continue to check if the IC has responded with a temperature
 void DallasTemperature::blockTillConversionComplete(uint8_t bitResolution, unsigned long start) {
 	if (checkForConversion && !parasite) {
@@ -520,6 +986,9 @@ bool DallasTemperature::saveScratchPadByIndex(uint8_t deviceIndex) {
 // Returns true if no errors were encountered, false indicates failure
 bool DallasTemperature::saveScratchPad(const uint8_t* deviceAddress) {
 
+	if (!restoreAlarms(deviceAddress))
+		return false;
+
 	if (_wire->reset() == 0)
 		return false;
 
@@ -725,6 +1194,14 @@ int32_t DallasTemperature::calculateTemperature(const uint8_t* deviceAddress,
 // operating range of the device
 int32_t DallasTemperature::getTemp(const uint8_t* deviceAddress) {
 
+	// cached devices go through the fastRead policy and the read statistics
+	int8_t index = findDevice(deviceAddress);
+	if (index >= 0) {
+		reading_t reading;
+		readDevice(index, ONEWIRE_TXN_RESET_AFTER, reading);
+		return reading.raw;
+	}
+
 	ScratchPad scratchPad;
 	if (isConnected(deviceAddress, scratchPad))
 		return calculateTemperature(deviceAddress, scratchPad);
@@ -732,6 +1209,208 @@ int32_t DallasTemperature::getTemp(const uint8_t* deviceAddress) {
 
 }
 
+// reads every cached device after a conversion, see readAll() in the header.
+// the presence pulse of each transaction's reset replaces the separate
+// isConnected() round trip, and no trailing reset is needed because the
+// next device's reset ends the read.
+uint8_t DallasTemperature::readAll(reading_t* readings, uint8_t count) {
+
+	uint8_t good = 0;
+	uint8_t i = 0;
+
+	if (count > tableCount)
+		count = tableCount;
+
+	for (; i < count; i++) {
+		// nothing answering the reset means no other device will either
+		if (readDevice(i, 0, readings[i]) == ONEWIRE_TXN_NO_PRESENCE)
+			break;
+		if (readings[i].status == DALLAS_READ_OK)
+			good++;
+	}
+	for (; i < count; i++) {
+		readings[i].raw = DEVICE_DISCONNECTED_RAW;
+		readings[i].status = DALLAS_READ_DISCONNECTED;
+	}
+
+	return good;
+}
+
+// re-reads one cached device, see readByIndex() in the header
+bool DallasTemperature::readByIndex(uint8_t index, reading_t& reading) {
+
+	if (index >= tableCount) {
+		reading.raw = DEVICE_DISCONNECTED_RAW;
+		reading.status = DALLAS_READ_DISCONNECTED;
+		return false;
+	}
+	readDevice(index, ONEWIRE_TXN_RESET_AFTER, reading);
+	return reading.status == DALLAS_READ_OK;
+}
+
+uint8_t DallasTemperature::readDevice(uint8_t index, uint8_t flags, reading_t& reading) {
+
+	static const uint8_t command[] = { READSCRATCH };
+	DeviceInfo& info = deviceTable[index];
+	ScratchPad scratchPad;
+	unsigned long start;
+	uint8_t r;
+
+	reading.raw = DEVICE_DISCONNECTED_RAW;
+	reading.status = DALLAS_READ_DISCONNECTED;
+
+	// other 1-Wire devices in the table have no temperature to read
+	if (!validFamily(info.deviceAddress))
+		return ONEWIRE_TXN_INVALID;
+	if (info.unconverted) {
+		reading.status = DALLAS_READ_NOT_CONVERTED;
+		return ONEWIRE_TXN_OK;
+	}
+
+	// the DS18S20 needs COUNT_REMAIN and the MAX31850 its configuration
+	// byte, so they are always read in full
+	if (fastRead && info.lastRaw != DEVICE_DISCONNECTED_RAW
+	        && info.sinceAudit < DALLAS_FAST_READ_AUDIT
+	        && info.deviceAddress[DSROM_FAMILY] != DS18S20MODEL
+	        && info.deviceAddress[DSROM_FAMILY] != DS1825MODEL) {
+
+		memset(scratchPad, 0, sizeof(scratchPad));
+		OneWireTransaction txn = { info.deviceAddress, command, 1, scratchPad, 2,
+		                           (uint8_t)(ONEWIRE_TXN_RESET | flags) };
+		start = micros();
+		r = _wire->transaction(txn);
+		info.stats.fastMicros += micros() - start;
+		info.stats.fastReads++;
+		if (r == ONEWIRE_TXN_NO_PRESENCE) {
+			invalidateConfig();
+			return r;
+		}
+
+		int32_t raw = calculateTemperature(info.deviceAddress, scratchPad);
+		int32_t step = raw - info.lastRaw;
+		if (r == ONEWIRE_TXN_OK && raw != POWER_ON_RAW
+		        && !(scratchPad[TEMP_LSB] == 0xFF && scratchPad[TEMP_MSB] == 0xFF)
+		        && step <= DALLAS_FAST_READ_MAX_STEP && step >= -DALLAS_FAST_READ_MAX_STEP) {
+			info.sinceAudit++;
+			reading.raw = raw;
+			reading.status = DALLAS_READ_OK;
+			adaptResolution(index, raw);
+			return r;
+		}
+		info.stats.fastRejected++;
+	}
+
+	OneWireTransaction txn = { info.deviceAddress, command, 1, scratchPad, 9,
+	                           (uint8_t)(ONEWIRE_TXN_RESET | ONEWIRE_TXN_CHECK_CRC8 | flags) };
+	start = micros();
+	r = _wire->transaction(txn);
+	info.stats.fullMicros += micros() - start;
+	info.stats.fullReads++;
+
+	if (r == ONEWIRE_TXN_OK && !isAllZeros(scratchPad)) {
+		reading.raw = calculateTemperature(info.deviceAddress, scratchPad);
+		reading.status = DALLAS_READ_OK;
+		info.lastRaw = reading.raw;
+		info.sinceAudit = 0;
+		adaptResolution(index, reading.raw);
+		return r;
+	}
+
+	info.stats.fullErrors++;
+	info.lastRaw = DEVICE_DISCONNECTED_RAW;
+	info.configValid = false;
+	if (r == ONEWIRE_TXN_NO_PRESENCE)
+		invalidateConfig();
+	if (r == ONEWIRE_TXN_CRC_ERROR)
+		reading.status = DALLAS_READ_CRC_ERROR;
+	return r;
+}
+
+void DallasTemperature::adaptResolution(uint8_t index, int32_t raw) {
+
+	DeviceInfo& info = deviceTable[index];
+	int32_t step = raw - info.prevRaw;
+	bool first = info.prevRaw == DEVICE_DISCONNECTED_RAW;
+
+	info.prevRaw = raw;
+	// the DS18S20 and the MAX31850 have no resolution to adapt
+	if (!adaptiveResolution || info.resolution == 0
+	        || info.deviceAddress[DSROM_FAMILY] == DS18S20MODEL
+	        || info.deviceAddress[DSROM_FAMILY] == DS1825MODEL)
+		return;
+
+	if (info.precise || (!first && (step > DALLAS_ADAPTIVE_STEP || step < -DALLAS_ADAPTIVE_STEP))) {
+		info.steady = 0;
+		if (info.resolution != 12)
+			changeResolution(index, 12);
+	} else if (!first && info.steady < DALLAS_ADAPTIVE_HOLD) {
+		info.steady++;
+	} else if (info.steady >= DALLAS_ADAPTIVE_HOLD && info.resolution != adaptiveLowResolution) {
+		changeResolution(index, adaptiveLowResolution);
+	}
+}
+
+void DallasTemperature::changeResolution(uint8_t index, uint8_t newResolution) {
+
+	// resolution changes come and go with the signal, keep them out of EEPROM
+	bool save = autoSaveScratchPad;
+	autoSaveScratchPad = false;
+	setResolution(deviceTable[index].deviceAddress, newResolution, true);
+	autoSaveScratchPad = save;
+
+	bitResolution = 9;
+	updateBitResolution();
+}
+
+// enables or disables adaptive resolution, see the header
+void DallasTemperature::setAdaptiveResolution(bool flag, uint8_t lowResolution) {
+	adaptiveResolution = flag;
+	adaptiveLowResolution = constrain(lowResolution, 9, 12);
+	for (uint8_t i = 0; i < tableCount; i++)
+		deviceTable[i].steady = 0;
+}
+
+// gets the value of the adaptiveResolution flag
+bool DallasTemperature::getAdaptiveResolution(void) {
+	return adaptiveResolution;
+}
+
+// requests or releases 12 bit precision for a device
+void DallasTemperature::setPrecisionRequired(const uint8_t* deviceAddress, bool flag) {
+	int8_t index = findDevice(deviceAddress);
+	if (index < 0)
+		return;
+	deviceTable[index].precise = flag;
+	deviceTable[index].steady = 0;
+	if (flag && adaptiveResolution && deviceTable[index].resolution != 12)
+		changeResolution(index, 12);
+}
+
+// sets the value of the fastRead flag, see the header
+void DallasTemperature::setFastRead(bool flag) {
+	fastRead = flag;
+}
+
+// gets the value of the fastRead flag
+bool DallasTemperature::getFastRead(void) {
+	return fastRead;
+}
+
+// copies the read statistics of a cached device
+bool DallasTemperature::getReadStats(const uint8_t* deviceAddress, readStats_t& stats) {
+	int8_t index = findDevice(deviceAddress);
+	if (index < 0)
+		return false;
+	stats = deviceTable[index].stats;
+	return true;
+}
+
+// clears the read statistics of all cached devices
+void DallasTemperature::resetReadStats(void) {
+	for (uint8_t i = 0; i < tableCount; i++)
+		memset(&deviceTable[i].stats, 0, sizeof(readStats_t));
+}
+
 // returns temperature in degrees C or DEVICE_DISCONNECTED_C if the
 // device's scratch pad cannot be read successfully.
 // the numeric value of DEVICE_DISCONNECTED_C is defined in
@@ -768,6 +1447,7 @@ void DallasTemperature::setUserData(const uint8_t* deviceAddress,
 
 	ScratchPad scratchPad;
 	if (isConnected(deviceAddress, scratchPad)) {
+		takeBackAlarms(deviceAddress, scratchPad);
 		scratchPad[HIGH_ALARM_TEMP] = data >> 8;
 		scratchPad[LOW_ALARM_TEMP] = data & 255;
 		writeScratchPad(deviceAddress, scratchPad);
@@ -776,6 +1456,14 @@ void DallasTemperature::setUserData(const uint8_t* deviceAddress,
 
 int16_t DallasTemperature::getUserData(const uint8_t* deviceAddress) {
 	int16_t data = 0;
+
+	if (findDevice(deviceAddress) >= 0) {
+		DeviceInfo* info = cachedConfig(deviceAddress);
+		if (info)
+			data = (info->highAlarm << 8) + info->lowAlarm;
+		return data;
+	}
+
 	ScratchPad scratchPad;
 	if (isConnected(deviceAddress, scratchPad)) {
 		data = scratchPad[HIGH_ALARM_TEMP] << 8;
@@ -817,6 +1505,50 @@ float DallasTemperature::rawToCelsius(int32_t raw) {
 
 }
 
+// format raw as degrees Celsius text, e.g. 2752 -> "21.50"
+// the fraction is rounded half up in 1/128 steps, all in 32 bit integers
+uint8_t DallasTemperature::rawToDecimal(int32_t raw, char* buf, uint8_t decimals) {
+
+	static const uint16_t scale[] = { 1, 10, 100, 1000, 10000 };
+	char digits[10];
+	uint8_t n = 0;
+	uint8_t len = 0;
+
+	if (raw <= DEVICE_DISCONNECTED_RAW)
+		raw = (int32_t) DEVICE_DISCONNECTED_C * 128;
+	if (decimals > 4)
+		decimals = 4;
+
+	uint32_t magnitude = raw < 0 ? -(uint32_t) raw : (uint32_t) raw;
+	uint32_t whole = magnitude >> 7;
+	uint32_t fraction = ((magnitude & 0x7F) * scale[decimals] + 64) >> 7;
+	if (fraction >= scale[decimals]) {
+		whole++;
+		fraction -= scale[decimals];
+	}
+
+	if (raw < 0 && (whole || fraction))
+		buf[len++] = '-';
+	do {
+		digits[n++] = '0' + whole % 10;
+		whole /= 10;
+	} while (whole);
+	while (n)
+		buf[len++] = digits[--n];
+
+	if (decimals) {
+		buf[len++] = '.';
+		for (uint8_t i = decimals; i > 0; i--) {
+			buf[len + i - 1] = '0' + fraction % 10;
+			fraction /= 10;
+		}
+		len += decimals;
+	}
+	buf[len] = '\0';
+	return len;
+
+}
+
 // Convert from Celsius to raw returns temperature in raw integer format.
 // The rounding error in the conversion is smaller than 0.01°C
 // where the resolution of the sensor is at best 0.0625°C (in 12 bit mode).
@@ -892,6 +1624,7 @@ void DallasTemperature::setHighAlarmTemp(const uint8_t* deviceAddress,
 
 	ScratchPad scratchPad;
 	if (isConnected(deviceAddress, scratchPad)) {
+		takeBackAlarms(deviceAddress, scratchPad);
 		scratchPad[HIGH_ALARM_TEMP] = (uint8_t) celsius;
 		writeScratchPad(deviceAddress, scratchPad);
 	}
@@ -916,6 +1649,7 @@ void DallasTemperature::setLowAlarmTemp(const uint8_t* deviceAddress,
 
 	ScratchPad scratchPad;
 	if (isConnected(deviceAddress, scratchPad)) {
+		takeBackAlarms(deviceAddress, scratchPad);
 		scratchPad[LOW_ALARM_TEMP] = (uint8_t) celsius;
 		writeScratchPad(deviceAddress, scratchPad);
 	}
@@ -926,6 +1660,11 @@ void DallasTemperature::setLowAlarmTemp(const uint8_t* deviceAddress,
 // DEVICE_DISCONNECTED for an address
 int8_t DallasTemperature::getHighAlarmTemp(const uint8_t* deviceAddress) {
 
+	if (findDevice(deviceAddress) >= 0) {
+		DeviceInfo* info = cachedConfig(deviceAddress);
+		return info ? (int8_t) info->highAlarm : DEVICE_DISCONNECTED_C;
+	}
+
 	ScratchPad scratchPad;
 	if (isConnected(deviceAddress, scratchPad))
 		return (int8_t) scratchPad[HIGH_ALARM_TEMP];
@@ -937,6 +1676,11 @@ int8_t DallasTemperature::getHighAlarmTemp(const uint8_t* deviceAddress) {
 // DEVICE_DISCONNECTED for an address
 int8_t DallasTemperature::getLowAlarmTemp(const uint8_t* deviceAddress) {
 
+	if (findDevice(deviceAddress) >= 0) {
+		DeviceInfo* info = cachedConfig(deviceAddress);
+		return info ? (int8_t) info->lowAlarm : DEVICE_DISCONNECTED_C;
+	}
+
 	ScratchPad scratchPad;
 	if (isConnected(deviceAddress, scratchPad))
 		return (int8_t) scratchPad[LOW_ALARM_TEMP];
@@ -1084,6 +1828,84 @@ void DallasTemperature::processAlarms(void) {
 	}
 }
 
+// reads the devices that alarmed after a conversion, see the header
+uint8_t DallasTemperature::readByAlarm(reading_t* readings, uint8_t count) {
+
+	bool alarmed[DALLAS_MAX_DEVICES];
+	DeviceAddress alarmAddr;
+	uint8_t read = 0;
+	uint8_t i;
+
+	if (count > tableCount) {
+		for (i = tableCount; i < count; i++) {
+			readings[i].raw = DEVICE_DISCONNECTED_RAW;
+			readings[i].status = DALLAS_READ_DISCONNECTED;
+		}
+		count = tableCount;
+	}
+
+	bool refresh = false;
+	if (DALLAS_ALARM_REFRESH && ++alarmRefresh >= DALLAS_ALARM_REFRESH) {
+		alarmRefresh = 0;
+		refresh = true;
+	}
+
+	memset(alarmed, 0, sizeof(alarmed));
+	if (!refresh) {
+		resetAlarmSearch();
+		while (alarmSearch(alarmAddr)) {
+			int8_t index = findDevice(alarmAddr);
+			if (index >= 0)
+				alarmed[index] = true;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		DeviceInfo& info = deviceTable[i];
+		if (!refresh && !alarmed[i] && info.window)
+			continue;
+
+		readDevice(i, ONEWIRE_TXN_RESET_AFTER, readings[i]);
+		read++;
+		if (readings[i].status == DALLAS_READ_OK)
+			info.window = setAlarmWindow(i, readings[i].raw);
+		else
+			info.window = false;
+	}
+
+	return read;
+}
+
+// drops the alarm window of a table entry so readByAlarm() reads it again
+void DallasTemperature::refreshByIndex(uint8_t index) {
+	if (index < tableCount)
+		deviceTable[index].window = false;
+}
+
+bool DallasTemperature::setAlarmWindow(uint8_t index, int32_t raw) {
+
+	DeviceInfo& info = deviceTable[index];
+
+	// the MAX31850 uses these bytes for fault flags
+	if (info.deviceAddress[DSROM_FAMILY] == DS1825MODEL)
+		return false;
+
+	// the device compares the whole degrees of its temperature register,
+	// rounded down. the DS18S20 register holds the reading rounded to 0.5C
+	int32_t celsius = raw >> 7;
+	if (info.deviceAddress[DSROM_FAMILY] == DS18S20MODEL)
+		celsius = (raw + 32) >> 7;
+	int32_t high = constrain(celsius + DALLAS_ALARM_WINDOW, -55, 125);
+	int32_t low = constrain(celsius - DALLAS_ALARM_WINDOW, -55, 125);
+
+	// the caller's TH/TL stay in the cache, so they must be there before
+	// the first window takes their place
+	if (!info.borrowed && !cachedConfig(info.deviceAddress))
+		return false;
+	info.borrowed = true;
+	return writeAlarmBytes(info, (uint8_t)(int8_t)high, (uint8_t)(int8_t)low);
+}
+
 // sets the alarm handler
 void DallasTemperature::setAlarmHandler(const AlarmHandler *handler) {
 	_AlarmHandler = handler;
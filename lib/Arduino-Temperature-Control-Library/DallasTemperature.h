@@ -18,6 +18,65 @@
 #define REQUIRESALARMS true
 #endif
 
+// number of devices kept in the device table built by begin()/rescan().
+// Devices beyond this are still reachable by index through a ROM search.
+#ifndef DALLAS_MAX_DEVICES
+#define DALLAS_MAX_DEVICES 16
+#endif
+
+// consecutive failed presence checks before pollDevices() drops a device
+#ifndef DALLAS_POLL_MISSES
+#define DALLAS_POLL_MISSES 3
+#endif
+
+// fast read mode: truncated reads accepted in a row before a full CRC
+// checked read is forced as an audit
+#ifndef DALLAS_FAST_READ_AUDIT
+#define DALLAS_FAST_READ_AUDIT 16
+#endif
+
+// fast read mode: largest change from the last verified value, in 1/128
+// degrees C, a truncated read may show before it is re-read in full
+#ifndef DALLAS_FAST_READ_MAX_STEP
+#define DALLAS_FAST_READ_MAX_STEP 256
+#endif
+
+// adaptive resolution: change between two readings of a device, in 1/128
+// degrees C, above which it is switched to 12 bit
+#ifndef DALLAS_ADAPTIVE_STEP
+#define DALLAS_ADAPTIVE_STEP 128
+#endif
+
+// adaptive resolution: readings in a row within DALLAS_ADAPTIVE_STEP
+// before a device is switched back to the low resolution
+#ifndef DALLAS_ADAPTIVE_HOLD
+#define DALLAS_ADAPTIVE_HOLD 8
+#endif
+
+// alarm driven sampling: half width of the TH/TL window programmed around
+// a device's last value, in whole degrees C
+#ifndef DALLAS_ALARM_WINDOW
+#define DALLAS_ALARM_WINDOW 1
+#endif
+
+// alarm driven sampling: every this many readByAlarm() calls all devices
+// are read, so drift inside a window is picked up too. 0 disables
+#ifndef DALLAS_ALARM_REFRESH
+#define DALLAS_ALARM_REFRESH 10
+#endif
+
+// conversion scheduler: current the strong pull-up can supply and current
+// one parasite powered device draws while converting, in microamps. when
+// all parasite devices together would draw more, they are converted one
+// at a time
+#ifndef DALLAS_PULLUP_BUDGET_UA
+#define DALLAS_PULLUP_BUDGET_UA 12000
+#endif
+
+#ifndef DALLAS_CONVERSION_UA
+#define DALLAS_CONVERSION_UA 1500
+#endif
+
 #include <inttypes.h>
 #ifdef __STM32F1__
 #include <OneWireSTM.h>
@@ -50,6 +109,12 @@
 #define DEVICE_FAULT_SHORTVDD_F -421.599976
 #define DEVICE_FAULT_SHORTVDD_RAW -32256
 
+// Per-device status codes filled in by readAll()
+#define DALLAS_READ_OK           0
+#define DALLAS_READ_DISCONNECTED 1  // no presence pulse or an all-zero scratchpad
+#define DALLAS_READ_CRC_ERROR    2
+#define DALLAS_READ_NOT_CONVERTED 5 // startConversion() could not start it, 3 and 4 are DallasHealth's
+
 // For readPowerSupply on oneWire bus
 // definition of nullptr for C++ < 11, using official workaround:
 // http://www.open-std.org/jtc1/sc22/wg21/docs/papers/2007/n2431.pdf
@@ -88,6 +153,22 @@ public:
 	// initialise bus
 	void begin(void);
 
+	// enumerate the bus again and rebuild the device table, use after
+	// sensors were added or removed. returns the number of devices found
+	uint8_t rescan(void);
+
+	typedef void DeviceEventHandler(const uint8_t*, bool added);
+
+	// incremental hot-plug detection, call regularly (e.g. once per loop).
+	// every call spends one short bus operation: it either verifies one
+	// cached device or takes one search step looking for new DS18xxx
+	// devices. returns true if the device table changed
+	bool pollDevices(void);
+
+	// sets the handler called by pollDevices() when a device is added
+	// (added == true) or removed
+	void setDeviceEventHandler(const DeviceEventHandler *);
+
 	// returns the number of devices found on the bus
 	uint8_t getDeviceCount(void);
 
@@ -117,6 +198,7 @@ public:
 	void writeScratchPad(const uint8_t*, const uint8_t*);
 
 	// read device's power requirements
+	// cached devices are answered from the device table
 	bool readPowerSupply(const uint8_t* deviceAddress = nullptr);
 
 	// get global resolution
@@ -126,12 +208,26 @@ public:
 	void setResolution(uint8_t);
 
 	// returns the device resolution: 9, 10, 11, or 12 bits
+	// cached devices are answered from the device table
 	uint8_t getResolution(const uint8_t*);
 
 	// set resolution of a device to 9, 10, 11, or 12 bits
 	bool setResolution(const uint8_t*, uint8_t,
 	                   bool skipGlobalBitResolutionCalculation = false);
 
+	// adaptive resolution. when enabled every reading of a cached device
+	// feeds a per-device controller: devices run at lowResolution (9 or 10
+	// bit) while their readings are steady and at 12 bit while they change
+	// by more than DALLAS_ADAPTIVE_STEP per reading or precision has been
+	// requested for them. resolution changes are not saved to EEPROM, and
+	// the conversion wait follows the highest resolution in use
+	void setAdaptiveResolution(bool, uint8_t lowResolution = 9);
+	bool getAdaptiveResolution(void);
+
+	// request (or release) full 12 bit precision for a device regardless
+	// of its rate of change. takes effect from the next conversion
+	void setPrecisionRequired(const uint8_t*, bool);
+
 	// sets/gets the waitForConversion flag
 	void setWaitForConversion(bool);
 	bool getWaitForConversion(void);
@@ -158,6 +254,33 @@ public:
 	// sends command for one device to perform a temperature conversion by index
 	request_t requestTemperaturesByIndex(uint8_t);
 
+	// non-blocking conversion of every device, for parasite power as well
+	// as external power. startConversion() starts the conversions and
+	// returns at once; then call runConversion() regularly (e.g. once per
+	// loop) until it returns true, and read the devices. in between the
+	// bus belongs to the scheduler: the strong pull-up is held while
+	// parasite devices convert, and nothing else may use the bus.
+	// parasite devices that would draw more than DALLAS_PULLUP_BUDGET_UA
+	// together are converted one after the other by address, while
+	// externally powered devices convert alongside them. a parasite device
+	// whose reset gets no presence is skipped and counted in the stats;
+	// reading it gives DALLAS_READ_NOT_CONVERTED until it converts again.
+	// returns false if no device answered
+	bool startConversion(void);
+	bool runConversion(void);
+
+	struct conversionStats_t {
+		uint8_t windows;         // conversion windows in the last cycle
+		uint32_t expectedMillis; // planned length of those windows together
+		uint32_t actualMillis;   // time they actually took
+		uint32_t worstOverrun;   // most a window ran past its plan, in ms
+		uint32_t totalMillis;    // start to finish of the last cycle
+		uint8_t notConverted;    // parasite devices whose conversion could not be started
+	};
+
+	// copies the expected and actual conversion windows of the last cycle
+	void getConversionStats(conversionStats_t&);
+
 	// returns temperature raw value (12 bit integer of 1/128 degrees C)
 	int32_t getTemp(const uint8_t*);
 
@@ -167,6 +290,47 @@ public:
 	// returns temperature in degrees F
 	float getTempF(const uint8_t*);
 
+	struct reading_t {
+		int32_t raw;      // 1/128 degrees C, DEVICE_DISCONNECTED_RAW on failure
+		uint8_t status;   // DALLAS_READ_OK or a DALLAS_READ_* error
+	};
+
+	// reads the temperature of every device in the device table in one
+	// pass, one select + READSCRATCH per device and a single reset in
+	// between. readings[i] is for device index i; at most count entries
+	// are filled. returns the number of devices read without error
+	uint8_t readAll(reading_t*, uint8_t);
+
+	// reads the temperature of the device at table index 'index' again,
+	// e.g. to retry a readAll() entry that failed. returns true if the
+	// reading status is DALLAS_READ_OK
+	bool readByIndex(uint8_t, reading_t&);
+
+	// sets/gets the fastRead flag. when set, cached DS18B20/DS1822 class
+	// devices are read with a 2 byte truncated scratchpad read that has no
+	// CRC. a full CRC checked read is done instead when there is no verified
+	// value yet, every DALLAS_FAST_READ_AUDIT reads, and whenever a truncated
+	// read looks wrong (a step above DALLAS_FAST_READ_MAX_STEP, the 85C
+	// power-on value or a floating bus)
+	void setFastRead(bool);
+	bool getFastRead(void);
+
+	struct readStats_t {
+		uint32_t fastReads;     // truncated reads done
+		uint32_t fastRejected;  // truncated reads that had to be re-read in full
+		uint32_t fullReads;     // full CRC checked reads done
+		uint32_t fullErrors;    // full reads with a CRC error or no device
+		uint32_t fastMicros;    // time spent in truncated reads
+		uint32_t fullMicros;    // time spent in full reads
+	};
+
+	// copies the read statistics of a cached device, returns false if the
+	// device is not in the device table
+	bool getReadStats(const uint8_t*, readStats_t&);
+
+	// clears the read statistics of all cached devices
+	void resetReadStats(void);
+
 	// Get temperature for device index (slow)
 	float getTempCByIndex(uint8_t);
 
@@ -240,6 +404,27 @@ public:
 	// runs the alarm handler for all devices returned by alarmSearch()
 	void processAlarms(void);
 
+	// alarm driven sampling, call after requestTemperatures(). an alarm
+	// search finds the devices whose reading left the TH/TL window around
+	// their last value; only those (and devices without a window yet) are
+	// read, and their windows are re-centred in the scratchpad without an
+	// EEPROM copy. readings[] must be kept between calls: entries of
+	// devices that stayed inside their window are left as they are.
+	// DS1825/MAX31850 devices are read every time. returns the number of
+	// devices read.
+	// the windows take over TH/TL, which also hold the alarm temperatures
+	// and setUserData(): alarmSearch() and hasAlarm() see the windows, and
+	// alarm handlers fire on them. the alarm and user data getters keep
+	// returning the caller's values, the setters hand TH/TL back, and
+	// saveScratchPad(), also the one of autoSaveScratchPad, writes the
+	// caller's values back before the EEPROM copy
+	uint8_t readByAlarm(reading_t*, uint8_t);
+
+	// makes the next readByAlarm() read the device at table index 'index'
+	// whether it alarmed or not, e.g. to confirm a reading the caller did
+	// not accept
+	void refreshByIndex(uint8_t);
+
 	// sets the alarm handler
 	void setAlarmHandler(const AlarmHandler *);
 
@@ -267,6 +452,11 @@ public:
 	// convert from raw to Celsius
 	static float rawToCelsius(int32_t);
 
+	// format raw as degrees Celsius text with 0-4 decimals, without floating
+	// point. 4 decimals are exact for every value the supported sensors
+	// report. buf must hold 16 chars. returns the length written
+	static uint8_t rawToDecimal(int32_t, char*, uint8_t decimals = 2);
+
 	// convert from Celsius to raw
 	static int16_t celsiusToRaw(float);
 
@@ -310,12 +500,129 @@ private:
 	// used to determine if values will be saved from scratchpad to EEPROM on every scratchpad write
 	bool autoSaveScratchPad;
 
+	// used to read cached devices with truncated scratchpad reads
+	bool fastRead;
+
+	// adaptive resolution on/off and the resolution of steady devices
+	bool adaptiveResolution;
+	uint8_t adaptiveLowResolution;
+
 	// count of devices on the bus
 	uint8_t devices;
 
 	// count of DS18xxx Family devices on bus
 	uint8_t ds18Count;
 
+	// device table filled by rescan() so index based calls do not have
+	// to walk the ROM search tree. the family is deviceAddress[0].
+	struct DeviceInfo {
+		DeviceAddress deviceAddress;
+		uint8_t resolution; // 9-12, 0 if not a DS18xxx family device
+		bool parasite;      // device reported parasite power
+		uint8_t missed;     // consecutive failed presence checks
+		int32_t lastRaw;    // last CRC verified temperature, DEVICE_DISCONNECTED_RAW if none
+		uint8_t sinceAudit; // truncated reads since the last full read
+		readStats_t stats;
+		int32_t prevRaw;    // previous reading, DEVICE_DISCONNECTED_RAW if none
+		uint8_t steady;     // readings in a row within DALLAS_ADAPTIVE_STEP
+		bool precise;       // 12 bit requested by setPrecisionRequired()
+		bool window;        // a readByAlarm() window covers the last reading
+		bool borrowed;      // TH/TL on the device hold a window, not highAlarm/lowAlarm
+		bool unconverted;   // the last startConversion() could not start it
+		// configuration cache, filled by begin() and kept up to date by the
+		// setters. a failed presence check clears configValid and the next
+		// query reloads it from the device
+		bool configValid;
+		uint8_t highAlarm;  // TH, the caller's value while a window borrows it
+		uint8_t lowAlarm;   // TL, the caller's value while a window borrows it
+		uint8_t config;     // configuration register
+	};
+	DeviceInfo deviceTable[DALLAS_MAX_DEVICES];
+	uint8_t tableCount;
+
+	// returns the device table index for an address, -1 if not cached
+	int8_t findDevice(const uint8_t*);
+
+	// recompute bitResolution as the highest resolution in the table
+	void updateBitResolution(void);
+
+	// returns the resolution encoded in a device's scratchpad, 0 if unknown
+	uint8_t scratchPadResolution(const uint8_t*, const uint8_t*);
+
+	// returns the cached configuration of a device, reading it from the
+	// device first if the cache is not valid. nullptr if the device is not
+	// in the table or cannot be read
+	DeviceInfo* cachedConfig(const uint8_t*);
+
+	// copies a scratchpad's TH, TL and configuration into a table entry
+	void storeConfig(DeviceInfo&, const uint8_t*);
+
+	// marks the cached configuration of every device as stale
+	void invalidateConfig(void);
+
+	// writes TH, TL and the configuration register of a table entry
+	bool writeAlarmBytes(DeviceInfo&, uint8_t, uint8_t);
+
+	// writes the cached TH/TL back over a window, the caller's values of
+	// all devices if the address is nullptr
+	bool restoreAlarms(const uint8_t*);
+
+	// puts the cached TH/TL in a scratchpad read from a device that holds
+	// a window, before a setter changes and writes it
+	void takeBackAlarms(const uint8_t*, uint8_t*);
+
+	// reads the power supply mode from the bus, see readPowerSupply()
+	bool queryPowerSupply(const uint8_t*);
+
+	// conversion scheduler state: the phase, the next table entry to look
+	// at for a parasite device and the open conversion window
+	uint8_t convPhase;
+	uint8_t convNext;
+	bool convPowered;           // the open window holds the strong pull-up
+	unsigned long convStart;
+	unsigned long windowStart;
+	uint16_t windowMillis;
+	uint16_t externalMillis;    // time the externally powered devices need
+	conversionStats_t convStats;
+
+	// starts the next parasite device's conversion, false if none is left.
+	// devices that miss presence are marked unconverted and skipped
+	bool startNextParasite(void);
+
+	// opens and closes a conversion window
+	void openWindow(uint16_t, bool powered);
+	void closeWindow(unsigned long);
+
+	// pollDevices() progress: next table entry to verify, then the family
+	// being searched for new devices
+	uint8_t pollCursor;
+	uint8_t pollFamily;
+	bool pollSearching;
+
+	// the hot-plug event handler function pointer
+	DeviceEventHandler *_DeviceEventHandler;
+
+	// adds a device to the table (reads its power mode and resolution)
+	void addDevice(const uint8_t*);
+
+	// removes the table entry at the given index
+	void removeDevice(uint8_t);
+
+	// clears the cached reading state of a table entry
+	void clearReadState(DeviceInfo&);
+
+	// reads the temperature of a table entry, truncated or in full as the
+	// fastRead policy allows. flags are added to the reset that starts the
+	// transaction. returns the ONEWIRE_TXN_* result of the last read
+	uint8_t readDevice(uint8_t, uint8_t, reading_t&);
+
+	// runs the adaptive resolution controller on a new reading of a table entry
+	void adaptResolution(uint8_t, int32_t);
+
+	// sets the resolution of a table entry without saving it to EEPROM and
+	// recomputes bitResolution
+	void changeResolution(uint8_t, uint8_t);
+
 	// Take a pointer to one wire instance
 	OneWire* _wire;
 
@@ -340,6 +647,12 @@ private:
 	// the alarm handler function pointer
 	AlarmHandler *_AlarmHandler;
 
+	// readByAlarm() calls since all devices were last read
+	uint8_t alarmRefresh;
+
+	// programs the TH/TL window of a table entry around a reading
+	bool setAlarmWindow(uint8_t, int32_t);
+
 #endif
 
 };
@@ -0,0 +1,79 @@
+#include <WiFi.h>
+#include <AsyncTCP.h>
+
+// AsyncTCP write path benchmark
+//
+// Sends small framed messages (a 2 byte header and a payload, like a
+// WebSocket frame) over a loopback connection, once as add() + add() +
+// send() and once as one batched write(), and prints the CPU cycles each
+// frame costs the sending task.  Every add() and send() is a separate
+// call into the lwIP thread, so the difference is the cost of the two
+// extra tcpip_api_call round trips per frame.
+
+#define PORT 8888
+#define RUNS 2000
+#define PAYLOAD 64
+
+AsyncServer server(PORT);
+AsyncClient client;
+
+uint8_t header[2] = { 0x82, PAYLOAD };
+char payload[PAYLOAD];
+
+bool batched = false;
+uint32_t frames = 0;
+uint32_t cycles = 0;
+
+void sendFrame(void) {
+  uint32_t start = ESP.getCycleCount();
+  if (batched) {
+    async_write_t parts[2] = {
+      { (const char *)header, sizeof(header), ASYNC_WRITE_FLAG_COPY, NULL },
+      { payload, PAYLOAD, ASYNC_WRITE_FLAG_COPY, NULL }
+    };
+    client.write(parts, 2);
+  } else {
+    client.add((const char *)header, sizeof(header));
+    client.add(payload, PAYLOAD);
+    client.send();
+  }
+  cycles += ESP.getCycleCount() - start;
+  frames++;
+}
+
+void report(void) {
+  Serial.print(batched ? "write(parts)\t" : "add+add+send\t");
+  Serial.print((float)cycles / frames);
+  Serial.println(" cycles/frame");
+  batched = !batched;
+  frames = 0;
+  cycles = 0;
+}
+
+void setup(void) {
+  Serial.begin(115200);
+  memset(payload, 'x', sizeof(payload));
+  // brings up the TCP/IP stack; the loopback interface needs no network
+  WiFi.mode(WIFI_STA);
+
+  server.onClient([](void *arg, AsyncClient *c) {
+    c->onData([](void *arg, AsyncClient *c, void *data, size_t len) { }, NULL);
+    c->onDisconnect([](void *arg, AsyncClient *c) { delete c; }, NULL);
+  }, NULL);
+  server.begin();
+  client.connect(IPAddress(127, 0, 0, 1), PORT);
+}
+
+void loop(void) {
+  if (!client.connected()) {
+    delay(100);
+    return;
+  }
+  while (frames < RUNS && client.space() > sizeof(header) + PAYLOAD) {
+    sendFrame();
+  }
+  if (frames == RUNS) {
+    report();
+    delay(1000);
+  }
+}
@@ -25,6 +25,7 @@
 extern "C"{
 #include "lwip/opt.h"
 #include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
 #include "lwip/inet.h"
 #include "lwip/dns.h"
 #include "lwip/err.h"
@@ -39,9 +40,13 @@ typedef enum {
     LWIP_TCP_SENT, LWIP_TCP_RECV, LWIP_TCP_FIN, LWIP_TCP_ERROR, LWIP_TCP_POLL, LWIP_TCP_CLEAR, LWIP_TCP_ACCEPT, LWIP_TCP_CONNECTED, LWIP_TCP_DNS
 } lwip_event_t;
 
-typedef struct {
+typedef struct lwip_event_packet_t {
         lwip_event_t event;
         void *arg;
+        struct lwip_event_packet_t * next;  // in the front or overflow list
+        int16_t token;          // client's event token, -1 if it has none
+        uint8_t worker;         // worker the event is queued for
+        uint32_t generation;    // token generation the event was queued in
         union {
                 struct {
                         void * pcb;
@@ -76,87 +81,603 @@ typedef struct {
         };
 } lwip_event_packet_t;
 
-static xQueueHandle _async_queue;
-static TaskHandle_t _async_service_task_handle = NULL;
+// An async task and the events waiting for it. Every client is assigned
+// to one worker when it is constructed, so its events are handled in order
+// by one task while clients on other workers are served in parallel.
+typedef struct {
+    xQueueHandle queue;
+    TaskHandle_t task;
+    lwip_event_packet_t * front_head;    // handled before the queue
+    lwip_event_packet_t * front_tail;
+    lwip_event_packet_t * overflow_head; // handled after the queue
+    lwip_event_packet_t * overflow_tail;
+    uint32_t listed;                     // events in both lists
+    uint32_t clients;                    // clients assigned
+} async_worker_t;
+
+static const int _number_of_workers = CONFIG_ASYNC_TCP_WORKERS;
+static async_worker_t _workers[_number_of_workers];
+static const int _async_queue_length = CONFIG_ASYNC_TCP_QUEUE_SIZE;
 
+/*
+ * Lock-free Bitmaps
+ * */
 
-SemaphoreHandle_t _slots_lock;
-const int _number_of_closed_slots = CONFIG_LWIP_MAX_ACTIVE_TCP;
-static uint32_t _closed_slots[_number_of_closed_slots];
-static uint32_t _closed_index = []() {
-    _slots_lock = xSemaphoreCreateBinary();
-    xSemaphoreGive(_slots_lock);
-    for (int i = 0; i < _number_of_closed_slots; ++ i) {
-        _closed_slots[i] = 1;
+// Claims the lowest clear bit of the first 'bits' bits in 'words' and
+// returns its index, or -1 if all are set. Claims and releases may run on
+// different threads at the same time.
+static int _claim_bit(uint32_t * words, int bits){
+    for(int w = 0; w * 32 < bits; w++){
+        // bits past the end in the last word are never free
+        uint32_t valid = (bits - w * 32 < 32) ? (1UL << (bits - w * 32)) - 1 : 0xFFFFFFFF;
+        uint32_t used = __atomic_load_n(&words[w], __ATOMIC_RELAXED);
+        uint32_t free_bits;
+        while((free_bits = ~used & valid) != 0){
+            uint32_t bit = free_bits & (~free_bits + 1);
+            //a failed exchange reloads 'used' and tries again
+            if(__atomic_compare_exchange_n(&words[w], &used, used | bit, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+                return w * 32 + __builtin_ctz(bit);
+            }
+        }
     }
-    return 1;
-}();
+    return -1;
+}
 
+static void _release_bit(uint32_t * words, int bit){
+    __atomic_fetch_and(&words[bit / 32], ~(1UL << (bit % 32)), __ATOMIC_RELEASE);
+}
 
-static inline bool _init_async_event_queue(){
-    if(!_async_queue){
-        _async_queue = xQueueCreate(32, sizeof(lwip_event_packet_t *));
-        if(!_async_queue){
-            return false;
-        }
+/*
+ * Event Packet Pool
+ * */
+
+// Every lwIP callback needs a packet and the async task frees it after the
+// handler, so the pool holds one packet per queue entry plus the one being
+// handled, for every worker. Packets are taken on the lwIP thread and returned on the async
+// task, so a block is claimed and released with compare-and-swap on a bitmap
+// instead of a lock. When the pool is empty the packet comes from the heap.
+#if CONFIG_ASYNC_TCP_EVENT_POOL
+static const int _event_pool_size = (_async_queue_length + 1) * _number_of_workers;
+static const int _event_pool_words = (_event_pool_size + 31) / 32;
+static lwip_event_packet_t _event_pool[_event_pool_size];
+static uint32_t _event_pool_used[_event_pool_words];  // bit set: block taken
+
+static lwip_event_packet_t * _claim_pool_event(){
+    int i = _claim_bit(_event_pool_used, _event_pool_size);
+    return i < 0 ? NULL : &_event_pool[i];
+}
+
+static bool _release_pool_event(lwip_event_packet_t * e){
+    if(e < _event_pool || e >= _event_pool + _event_pool_size){
+        return false;
     }
+    _release_bit(_event_pool_used, e - _event_pool);
     return true;
 }
+#else
+static inline lwip_event_packet_t * _claim_pool_event(){
+    return NULL;
+}
 
-static inline bool _send_async_event(lwip_event_packet_t ** e){
-    return _async_queue && xQueueSend(_async_queue, e, portMAX_DELAY) == pdPASS;
+static inline bool _release_pool_event(lwip_event_packet_t * e){
+    return false;
 }
+#endif
 
-static inline bool _prepend_async_event(lwip_event_packet_t ** e){
-    return _async_queue && xQueueSendToFront(_async_queue, e, portMAX_DELAY) == pdPASS;
+static async_event_pool_stats_t _event_pool_stats;
+
+static void _count_alloc(){
+    uint32_t in_use = __atomic_add_fetch(&_event_pool_stats.in_use, 1, __ATOMIC_RELAXED);
+    uint32_t peak = __atomic_load_n(&_event_pool_stats.peak, __ATOMIC_RELAXED);
+    while(in_use > peak && !__atomic_compare_exchange_n(&_event_pool_stats.peak, &peak, in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    __atomic_fetch_add(&_event_pool_stats.allocs, 1, __ATOMIC_RELAXED);
 }
 
-static inline bool _get_async_event(lwip_event_packet_t ** e){
-    return _async_queue && xQueueReceive(_async_queue, e, portMAX_DELAY) == pdPASS;
+static lwip_event_packet_t * _alloc_event(){
+    uint32_t start = ESP.getCycleCount();
+    lwip_event_packet_t * e = _claim_pool_event();
+    if(!e){
+        e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+        __atomic_fetch_add(&_event_pool_stats.overflows, 1, __ATOMIC_RELAXED);
+    }
+    if(e){
+        _count_alloc();
+    }
+    __atomic_fetch_add(&_event_pool_stats.alloc_cycles, ESP.getCycleCount() - start, __ATOMIC_RELAXED);
+    return e;
 }
 
-static bool _remove_events_with_arg(void * arg){
-    lwip_event_packet_t * first_packet = NULL;
-    lwip_event_packet_t * packet = NULL;
+// A FIN or error is the last event of a connection and lwIP does not offer
+// it again, so every client reserves a heap packet for it when constructed.
+// The packet leaves the client with the event and is freed like any heap
+// packet after the handler, so a client deleted while its event waits does
+// not take the packet with it. Without a reserve (the client used it or
+// could not get one) the packet is allocated as usual.
+static lwip_event_packet_t * _alloc_terminal_event(void * arg){
+    lwip_event_packet_t * e = arg ? reinterpret_cast<AsyncClient*>(arg)->takeTerminalEvent() : NULL;
+    if(!e){
+        return _alloc_event();
+    }
+    _count_alloc();
+    __atomic_fetch_add(&_event_pool_stats.reserved, 1, __ATOMIC_RELAXED);
+    return e;
+}
 
-    if(!_async_queue){
-        return false;
+static void _free_event(lwip_event_packet_t * e){
+    uint32_t start = ESP.getCycleCount();
+    if(!_release_pool_event(e)){
+        free((void*)(e));
     }
-    //figure out which is the first packet so we can keep the order
-    while(!first_packet){
-        if(xQueueReceive(_async_queue, &first_packet, 0) != pdPASS){
-            return false;
+    __atomic_fetch_sub(&_event_pool_stats.in_use, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&_event_pool_stats.free_cycles, ESP.getCycleCount() - start, __ATOMIC_RELAXED);
+}
+
+void asyncTcpEventPoolStats(async_event_pool_stats_t * stats){
+    stats->allocs = __atomic_load_n(&_event_pool_stats.allocs, __ATOMIC_RELAXED);
+    stats->overflows = __atomic_load_n(&_event_pool_stats.overflows, __ATOMIC_RELAXED);
+    stats->reserved = __atomic_load_n(&_event_pool_stats.reserved, __ATOMIC_RELAXED);
+    stats->in_use = __atomic_load_n(&_event_pool_stats.in_use, __ATOMIC_RELAXED);
+    stats->peak = __atomic_load_n(&_event_pool_stats.peak, __ATOMIC_RELAXED);
+    stats->alloc_cycles = __atomic_load_n(&_event_pool_stats.alloc_cycles, __ATOMIC_RELAXED);
+    stats->free_cycles = __atomic_load_n(&_event_pool_stats.free_cycles, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Closed Slots
+ * */
+
+// A client holds a slot while its pcb is open, so calls queued into the
+// lwIP thread can tell that the pcb was closed (and maybe reused) meanwhile.
+// Slots are claimed from a bitmap and the handle a client gets carries a
+// generation from a global counter next to the slot index. The slot keeps
+// the handle of its holder until it is freed, so a call is valid when the
+// slot still holds its handle; a later holder of the same slot has another.
+static const int _number_of_closed_slots = CONFIG_LWIP_MAX_ACTIVE_TCP;
+static uint32_t _closed_slots_used[(_number_of_closed_slots + 31) / 32];
+static int32_t _closed_slots[_number_of_closed_slots];  // handle of the holder, 0 when free
+static uint32_t _closed_generation;
+
+static int32_t _claim_closed_slot(){
+    int i = _claim_bit(_closed_slots_used, _number_of_closed_slots);
+    if(i < 0){
+        return -1;
+    }
+    //generations run 1..0x7FFF, so a handle is never 0 or negative
+    uint32_t generation = __atomic_fetch_add(&_closed_generation, 1, __ATOMIC_RELAXED) % 0x7FFF + 1;
+    int32_t handle = (int32_t)(generation << 16) | i;
+    __atomic_store_n(&_closed_slots[i], handle, __ATOMIC_RELEASE);
+    return handle;
+}
+
+//frees the slot only while it still holds 'handle', so a stale or copied
+//handle leaves a later holder of the slot alone
+static void _release_closed_slot(int32_t handle){
+    if(handle != -1 && __atomic_compare_exchange_n(&_closed_slots[handle & 0xFFFF], &handle, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+        _release_bit(_closed_slots_used, handle & 0xFFFF);
+    }
+}
+
+// true unless the pcb of the client holding 'handle' was closed. clients
+// without a slot are never seen as closed
+static inline bool _closed_slot_open(int32_t handle){
+    return handle == -1 || __atomic_load_n(&_closed_slots[handle & 0xFFFF], __ATOMIC_ACQUIRE) == handle;
+}
+
+
+/*
+ * Event Cancellation
+ * */
+
+// Each client holds a token whose generation is stamped on every event
+// queued for it. Closing the client bumps the generation, which turns all
+// its queued events stale in O(1); the async task drops them when they come
+// up instead of rotating the whole queue to find them. The generations live
+// here rather than in the client so a stale event can still be checked
+// after the client is deleted. Clients that find no free token fall back to
+// the LWIP_TCP_CLEAR queue scan.
+static const int _number_of_event_tokens = CONFIG_LWIP_MAX_ACTIVE_TCP * 2;
+static uint32_t _event_tokens_used[(_number_of_event_tokens + 31) / 32];
+static uint32_t _event_generations[_number_of_event_tokens];
+
+static int16_t _alloc_event_token(){
+    return _claim_bit(_event_tokens_used, _number_of_event_tokens);
+}
+
+// turns every event queued so far under the token stale
+static void _cancel_events(int16_t token){
+    __atomic_fetch_add(&_event_generations[token], 1, __ATOMIC_RELEASE);
+}
+
+// cancels the token's queued events and returns it
+static void _free_event_token(int16_t token){
+    if(token >= 0){
+        _cancel_events(token);
+        _release_bit(_event_tokens_used, token);
+    }
+}
+
+// stamps an event with the current generation of its client's token and
+// the client's worker. the accept event's arg is the server, which has no
+// token; it goes to the worker of the accepted client
+static void _tag_event(lwip_event_packet_t * e){
+    e->token = -1;
+    e->worker = 0;
+    if(e->event == LWIP_TCP_ACCEPT){
+        e->worker = e->accept.client->eventWorker();
+    } else if(e->arg){
+        e->worker = reinterpret_cast<AsyncClient*>(e->arg)->eventWorker();
+    }
+    if(e->arg && e->event != LWIP_TCP_ACCEPT && e->event != LWIP_TCP_CLEAR){
+        e->token = reinterpret_cast<AsyncClient*>(e->arg)->eventToken();
+        if(e->token >= 0){
+            e->generation = __atomic_load_n(&_event_generations[e->token], __ATOMIC_ACQUIRE);
         }
-        //discard packet if matching
-        if((int)first_packet->arg == (int)arg){
-            free(first_packet);
-            first_packet = NULL;
-        //return first packet to the back of the queue
-        } else if(xQueueSend(_async_queue, &first_packet, portMAX_DELAY) != pdPASS){
-            return false;
+    }
+}
+
+// returns true if the client cancelled its events after this one was queued
+static bool _event_cancelled(lwip_event_packet_t * e){
+    return e->token >= 0 && __atomic_load_n(&_event_generations[e->token], __ATOMIC_ACQUIRE) != e->generation;
+}
+
+// frees an event that will not be handled, with the data it holds
+static void _drop_event(lwip_event_packet_t * e){
+    if(e->event == LWIP_TCP_RECV && e->recv.pb){
+        pbuf_free(e->recv.pb);
+    }
+    _free_event(e);
+}
+
+/*
+ * Event Coalescing
+ * */
+
+// A client needs at most one queued poll, and queued sent events only add
+// up lengths, so lwIP callbacks merge into the client's queued event while
+// it waits. The queued poll and sent packet of each client are recorded
+// here until the async task takes them; the table is shared with the lwIP
+// thread, so it is only touched under _pending_mux.
+typedef struct {
+    void * arg;
+    lwip_event_packet_t * sent;
+    lwip_event_packet_t * poll;
+} pending_events_t;
+
+static portMUX_TYPE _pending_mux = portMUX_INITIALIZER_UNLOCKED;
+static pending_events_t _pending[CONFIG_LWIP_MAX_ACTIVE_TCP];
+static async_queue_stats_t _queue_stats;
+
+// returns the record of 'arg', taking a free one if 'create' is set. call
+// under _pending_mux
+static pending_events_t * _find_pending(void * arg, bool create){
+    pending_events_t * free_record = NULL;
+    for(int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++){
+        if(_pending[i].arg == arg){
+            return &_pending[i];
+        }
+        if(!free_record && !_pending[i].arg){
+            free_record = &_pending[i];
+        }
+    }
+    if(!create || !free_record){
+        return NULL;
+    }
+    free_record->arg = arg;
+    return free_record;
+}
+
+// adds 'len' to the client's queued sent event. returns false if there is
+// none for this pcb or the sum would not fit its 16 bit length
+static bool _merge_sent(void * arg, tcp_pcb * pcb, uint16_t len){
+    bool merged = false;
+    portENTER_CRITICAL(&_pending_mux);
+    pending_events_t * p = _find_pending(arg, false);
+    if(p && p->sent && p->sent->sent.pcb == pcb && (uint32_t)p->sent->sent.len + len <= 0xFFFF){
+        p->sent->sent.len += len;
+        merged = true;
+    }
+    portEXIT_CRITICAL(&_pending_mux);
+    return merged;
+}
+
+// returns true if the client already has a poll queued for this pcb
+static bool _poll_pending(void * arg, tcp_pcb * pcb){
+    portENTER_CRITICAL(&_pending_mux);
+    pending_events_t * p = _find_pending(arg, false);
+    bool pending = p && p->poll && p->poll->poll.pcb == pcb;
+    portEXIT_CRITICAL(&_pending_mux);
+    return pending;
+}
+
+// records a sent or poll packet as the one later events merge into. without
+// a free record the packet is queued like any other
+static void _set_pending(lwip_event_packet_t * e){
+    portENTER_CRITICAL(&_pending_mux);
+    pending_events_t * p = _find_pending(e->arg, true);
+    if(p){
+        if(e->event == LWIP_TCP_SENT){
+            p->sent = e;
+        } else {
+            p->poll = e;
         }
     }
+    portEXIT_CRITICAL(&_pending_mux);
+}
 
-    while(xQueuePeek(_async_queue, &packet, 0) == pdPASS && packet != first_packet){
-        if(xQueueReceive(_async_queue, &packet, 0) != pdPASS){
-            return false;
+// stops merging into a packet before it is handled or dropped. a sent
+// length read after this is final
+static void _clear_pending(lwip_event_packet_t * e){
+    if(!e->arg || (e->event != LWIP_TCP_SENT && e->event != LWIP_TCP_POLL)){
+        return;
+    }
+    portENTER_CRITICAL(&_pending_mux);
+    pending_events_t * p = _find_pending(e->arg, false);
+    if(p){
+        if(p->sent == e){
+            p->sent = NULL;
         }
-        if((int)packet->arg == (int)arg){
-            free(packet);
-            packet = NULL;
-        } else if(xQueueSend(_async_queue, &packet, portMAX_DELAY) != pdPASS){
-            return false;
+        if(p->poll == e){
+            p->poll = NULL;
+        }
+        if(!p->sent && !p->poll){
+            p->arg = NULL;
         }
     }
+    portEXIT_CRITICAL(&_pending_mux);
+}
+
+// forgets the queued packets of a client that cancelled its events, so new
+// events do not merge into stale ones
+static void _forget_pending(void * arg){
+    portENTER_CRITICAL(&_pending_mux);
+    pending_events_t * p = _find_pending(arg, false);
+    if(p){
+        p->arg = NULL;
+        p->sent = NULL;
+        p->poll = NULL;
+    }
+    portEXIT_CRITICAL(&_pending_mux);
+}
+
+/*
+ * Event Queue
+ * */
+
+// lwIP callbacks run on the tcpip thread and must never wait for an async
+// task, so events are queued without blocking. When a worker's queue is
+// full, polls are shed, received data is refused with ERR_MEM so lwIP keeps
+// the pbuf and delivers it again later, and all other events wait in the
+// worker's overflow list, which is handled after the queue. New events
+// follow them into the overflow until it is empty, so they keep their
+// order. Prepended events that find the queue full, and the events the
+// CLEAR scan keeps, go to the front list, which is handled before the queue.
+static portMUX_TYPE _lists_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// list helpers, call under _lists_mux
+static void _list_append(lwip_event_packet_t ** head, lwip_event_packet_t ** tail, lwip_event_packet_t * e){
+    e->next = NULL;
+    if(*tail){
+        (*tail)->next = e;
+    } else {
+        *head = e;
+    }
+    *tail = e;
+}
+
+static lwip_event_packet_t * _list_pop(async_worker_t * w, lwip_event_packet_t ** head, lwip_event_packet_t ** tail){
+    lwip_event_packet_t * e = *head;
+    if(e){
+        *head = e->next;
+        if(!*head){
+            *tail = NULL;
+        }
+        w->listed--;
+    }
+    return e;
+}
+
+// moves the events of 'arg' from a list to 'dropped'
+static void _list_remove_arg(async_worker_t * w, lwip_event_packet_t ** head, lwip_event_packet_t ** tail, void * arg, lwip_event_packet_t ** dropped){
+    lwip_event_packet_t ** link = head;
+    *tail = NULL;
+    while(*link){
+        lwip_event_packet_t * e = *link;
+        if(e->arg == arg){
+            *link = e->next;
+            e->next = *dropped;
+            *dropped = e;
+            w->listed--;
+        } else {
+            *tail = e;
+            link = &e->next;
+        }
+    }
+}
+
+static uint32_t _worker_depth(async_worker_t * w){
+    return w->queue ? uxQueueMessagesWaiting(w->queue) + __atomic_load_n(&w->listed, __ATOMIC_RELAXED) : 0;
+}
+
+// queues an event without blocking. returns false if it was shed or
+// refused; the caller still owns it then
+static bool _queue_event(lwip_event_packet_t * e, bool front){
+    _tag_event(e);
+    async_worker_t * w = &_workers[e->worker];
+    if(!w->queue){
+        return false;
+    }
+    uint32_t start = micros();
+    bool queued = false;
+    //once queued the packet may be handled and freed at any time
+    lwip_event_t event = e->event;
+
+    portENTER_CRITICAL(&_lists_mux);
+    bool overflowing = w->overflow_head != NULL;
+    portEXIT_CRITICAL(&_lists_mux);
+    if(front){
+        queued = xQueueSendToFront(w->queue, &e, 0) == pdPASS;
+    } else if(!overflowing){
+        queued = xQueueSend(w->queue, &e, 0) == pdPASS;
+    }
+    if(!queued && event == LWIP_TCP_POLL){
+        __atomic_fetch_add(&_queue_stats.polls_shed, 1, __ATOMIC_RELAXED);
+    } else if(!queued && event == LWIP_TCP_RECV){
+        __atomic_fetch_add(&_queue_stats.recv_refused, 1, __ATOMIC_RELAXED);
+    } else if(!queued){
+        portENTER_CRITICAL(&_lists_mux);
+        if(front){
+            _list_append(&w->front_head, &w->front_tail, e);
+        } else {
+            _list_append(&w->overflow_head, &w->overflow_tail, e);
+        }
+        w->listed++;
+        portEXIT_CRITICAL(&_lists_mux);
+        __atomic_fetch_add(&_queue_stats.overflowed, 1, __ATOMIC_RELAXED);
+        queued = true;
+    }
+
+    if(queued){
+        uint32_t depth = _worker_depth(w);
+        uint32_t high = __atomic_load_n(&_queue_stats.high_water, __ATOMIC_RELAXED);
+        while(depth > high && !__atomic_compare_exchange_n(&_queue_stats.high_water, &high, depth, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        __atomic_fetch_add(&_queue_stats.queued[event], 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&_queue_stats.blocked_us, micros() - start, __ATOMIC_RELAXED);
+    return queued;
+}
+
+static inline bool _send_async_event(lwip_event_packet_t ** e){
+    return _queue_event(*e, false);
+}
+
+static inline bool _prepend_async_event(lwip_event_packet_t ** e){
+    return _queue_event(*e, true);
+}
+
+// takes the worker's next event: the front list, then the queue, then the
+// overflow. waits on the queue for up to 'wait' ticks only when all are
+// empty; the overflow only fills while the queue is full, so nothing is
+// left waiting in a list
+static bool _get_async_event(async_worker_t * w, lwip_event_packet_t ** e, TickType_t wait){
+    if(!w->queue){
+        return false;
+    }
+    portENTER_CRITICAL(&_lists_mux);
+    *e = _list_pop(w, &w->front_head, &w->front_tail);
+    portEXIT_CRITICAL(&_lists_mux);
+    if(*e || xQueueReceive(w->queue, e, 0) == pdPASS){
+        return true;
+    }
+    portENTER_CRITICAL(&_lists_mux);
+    *e = _list_pop(w, &w->overflow_head, &w->overflow_tail);
+    portEXIT_CRITICAL(&_lists_mux);
+    return *e || xQueueReceive(w->queue, e, wait) == pdPASS;
+}
+
+// drops the queued events of a client without an event token. runs on the
+// client's worker, which is the only task taking from its queue. everything
+// queued so far is taken out and the kept events go to the end of the front
+// list in their order; what lwIP queues meanwhile is newer and stays behind
+// them
+static bool _remove_events_with_arg(async_worker_t * w, void * arg){
+    lwip_event_packet_t * kept_head = NULL;
+    lwip_event_packet_t * kept_tail = NULL;
+    lwip_event_packet_t * dropped = NULL;
+    lwip_event_packet_t * packet = NULL;
+    uint32_t kept = 0;
+
+    if(!w->queue){
+        return false;
+    }
+    UBaseType_t waiting = uxQueueMessagesWaiting(w->queue);
+    while(waiting-- && xQueueReceive(w->queue, &packet, 0) == pdPASS){
+        if(packet->arg == arg){
+            packet->next = dropped;
+            dropped = packet;
+        } else {
+            _list_append(&kept_head, &kept_tail, packet);
+            kept++;
+        }
+    }
+
+    portENTER_CRITICAL(&_lists_mux);
+    _list_remove_arg(w, &w->front_head, &w->front_tail, arg, &dropped);
+    _list_remove_arg(w, &w->overflow_head, &w->overflow_tail, arg, &dropped);
+    if(kept_head){
+        // the front list was due before the queue, so the kept events
+        // follow it
+        if(w->front_tail){
+            w->front_tail->next = kept_head;
+        } else {
+            w->front_head = kept_head;
+        }
+        w->front_tail = kept_tail;
+        w->listed += kept;
+    }
+    portEXIT_CRITICAL(&_lists_mux);
+
+    while(dropped){
+        packet = dropped;
+        dropped = packet->next;
+        _clear_pending(packet);
+        _drop_event(packet);
+    }
     return true;
 }
 
-static void _handle_async_event(lwip_event_packet_t * e){
+// picks the worker with the fewest clients for a new client
+static uint8_t _assign_worker(){
+    uint8_t best = 0;
+    for(int i = 1; i < _number_of_workers; i++){
+        if(__atomic_load_n(&_workers[i].clients, __ATOMIC_RELAXED) < __atomic_load_n(&_workers[best].clients, __ATOMIC_RELAXED)){
+            best = i;
+        }
+    }
+    __atomic_fetch_add(&_workers[best].clients, 1, __ATOMIC_RELAXED);
+    return best;
+}
+
+static void _release_worker(uint8_t worker){
+    __atomic_fetch_sub(&_workers[worker].clients, 1, __ATOMIC_RELAXED);
+}
+
+void asyncTcpQueueStats(async_queue_stats_t * stats){
+    stats->handled = __atomic_load_n(&_queue_stats.handled, __ATOMIC_RELAXED);
+    stats->sent_merged = __atomic_load_n(&_queue_stats.sent_merged, __ATOMIC_RELAXED);
+    stats->poll_dropped = __atomic_load_n(&_queue_stats.poll_dropped, __ATOMIC_RELAXED);
+    stats->cancelled = __atomic_load_n(&_queue_stats.cancelled, __ATOMIC_RELAXED);
+    stats->depth = 0;
+    for(int i = 0; i < _number_of_workers; i++){
+        stats->depth += _worker_depth(&_workers[i]);
+    }
+    stats->high_water = __atomic_load_n(&_queue_stats.high_water, __ATOMIC_RELAXED);
+    stats->overflowed = __atomic_load_n(&_queue_stats.overflowed, __ATOMIC_RELAXED);
+    stats->polls_shed = __atomic_load_n(&_queue_stats.polls_shed, __ATOMIC_RELAXED);
+    stats->recv_refused = __atomic_load_n(&_queue_stats.recv_refused, __ATOMIC_RELAXED);
+    stats->blocked_us = __atomic_load_n(&_queue_stats.blocked_us, __ATOMIC_RELAXED);
+    for(int i = 0; i < ASYNC_TCP_EVENT_TYPES; i++){
+        stats->queued[i] = __atomic_load_n(&_queue_stats.queued[i], __ATOMIC_RELAXED);
+    }
+    stats->batches = __atomic_load_n(&_queue_stats.batches, __ATOMIC_RELAXED);
+    stats->slow_events = __atomic_load_n(&_queue_stats.slow_events, __ATOMIC_RELAXED);
+    stats->handler_us = __atomic_load_n(&_queue_stats.handler_us, __ATOMIC_RELAXED);
+    stats->max_handler_us = __atomic_load_n(&_queue_stats.max_handler_us, __ATOMIC_RELAXED);
+}
+
+static void _handle_async_event(async_worker_t * w, lwip_event_packet_t * e){
+    _clear_pending(e);
+    if(_event_cancelled(e)){
+        __atomic_fetch_add(&_queue_stats.cancelled, 1, __ATOMIC_RELAXED);
+        _drop_event(e);
+        return;
+    }
+    __atomic_fetch_add(&_queue_stats.handled, 1, __ATOMIC_RELAXED);
     if(e->arg == NULL){
         // do nothing when arg is NULL
         //ets_printf("event arg == NULL: 0x%08x\n", e->recv.pcb);
     } else if(e->event == LWIP_TCP_CLEAR){
-        _remove_events_with_arg(e->arg);
+        _remove_events_with_arg(w, e->arg);
     } else if(e->event == LWIP_TCP_RECV){
         //ets_printf("-R: 0x%08x\n", e->recv.pcb);
         AsyncClient::_s_recv(e->arg, e->recv.pcb, e->recv.pb, e->recv.err);
@@ -182,45 +703,94 @@ static void _handle_async_event(lwip_event_packet_t * e){
         //ets_printf("D: 0x%08x %s = %s\n", e->arg, e->dns.name, ipaddr_ntoa(&e->dns.addr));
         AsyncClient::_s_dns_found(e->dns.name, &e->dns.addr, e->arg);
     }
-    free((void*)(e));
+    _free_event(e);
 }
 
+#if CONFIG_ASYNC_TCP_USE_WDT
+// the task stays subscribed to the WDT, so an idle wait has to end in time
+// to feed it
+#ifndef CONFIG_ESP_TASK_WDT_TIMEOUT_S
+#define CONFIG_ESP_TASK_WDT_TIMEOUT_S 5
+#endif
+static const TickType_t _async_queue_wait = pdMS_TO_TICKS(CONFIG_ESP_TASK_WDT_TIMEOUT_S * 500);
+#else
+static const TickType_t _async_queue_wait = portMAX_DELAY;
+#endif
+
 static void _async_service_task(void *pvParameters){
+    async_worker_t * w = (async_worker_t *)pvParameters;
     lwip_event_packet_t * packet = NULL;
-    for (;;) {
-        if(_get_async_event(&packet)){
 #if CONFIG_ASYNC_TCP_USE_WDT
-            if(esp_task_wdt_add(NULL) != ESP_OK){
-                log_e("Failed to add async task to WDT");
-            }
+    if(esp_task_wdt_add(NULL) != ESP_OK){
+        log_e("Failed to add async task to WDT");
+    }
 #endif
-            _handle_async_event(packet);
-#if CONFIG_ASYNC_TCP_USE_WDT
-            if(esp_task_wdt_delete(NULL) != ESP_OK){
-                log_e("Failed to remove loop task from WDT");
+    for (;;) {
+        // waits for an event, then handles what is queued up to a batch and
+        // feeds the WDT once. a handler that runs over its budget ends the
+        // batch early; one that never returns starves the WDT
+        uint32_t handled = 0;
+        while(handled < CONFIG_ASYNC_TCP_EVENT_BATCH && _get_async_event(w, &packet, handled ? 0 : _async_queue_wait)){
+            //the packet is freed by the handler, the type is kept for log_w
+            lwip_event_t event = packet->event;
+            (void)event;
+            uint32_t start = micros();
+            _handle_async_event(w, packet);
+            uint32_t took = micros() - start;
+            handled++;
+
+            __atomic_fetch_add(&_queue_stats.handler_us, took, __ATOMIC_RELAXED);
+            uint32_t longest = __atomic_load_n(&_queue_stats.max_handler_us, __ATOMIC_RELAXED);
+            while(took > longest && !__atomic_compare_exchange_n(&_queue_stats.max_handler_us, &longest, took, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+            if(took > CONFIG_ASYNC_TCP_EVENT_BUDGET_MS * 1000){
+                __atomic_fetch_add(&_queue_stats.slow_events, 1, __ATOMIC_RELAXED);
+                log_w("event %d handler took %u us", (int)event, took);
+                break;
             }
-#endif
         }
+        if(handled){
+            __atomic_fetch_add(&_queue_stats.batches, 1, __ATOMIC_RELAXED);
+        }
+#if CONFIG_ASYNC_TCP_USE_WDT
+        esp_task_wdt_reset();
+#endif
     }
+#if CONFIG_ASYNC_TCP_USE_WDT
+    if(esp_task_wdt_delete(NULL) != ESP_OK){
+        log_e("Failed to remove loop task from WDT");
+    }
+#endif
     vTaskDelete(NULL);
-    _async_service_task_handle = NULL;
+    w->task = NULL;
 }
 /*
 static void _stop_async_task(){
-    if(_async_service_task_handle){
-        vTaskDelete(_async_service_task_handle);
-        _async_service_task_handle = NULL;
+    for(int i = 0; i < _number_of_workers; i++){
+        if(_workers[i].task){
+            vTaskDelete(_workers[i].task);
+            _workers[i].task = NULL;
+        }
     }
 }
 */
 static bool _start_async_task(){
-    if(!_init_async_event_queue()){
-        return false;
-    }
-    if(!_async_service_task_handle){
-        xTaskCreateUniversal(_async_service_task, "async_tcp", 8192 * 2, NULL, 3, &_async_service_task_handle, CONFIG_ASYNC_TCP_RUNNING_CORE);
-        if(!_async_service_task_handle){
-            return false;
+    for(int i = 0; i < _number_of_workers; i++){
+        async_worker_t * w = &_workers[i];
+        if(!w->queue){
+            w->queue = xQueueCreate(_async_queue_length, sizeof(lwip_event_packet_t *));
+            if(!w->queue){
+                return false;
+            }
+        }
+        if(!w->task){
+            //a single worker runs where configured, more are spread over the cores
+            char name[16];
+            int core = _number_of_workers > 1 ? i % portNUM_PROCESSORS : CONFIG_ASYNC_TCP_RUNNING_CORE;
+            snprintf(name, sizeof(name), i ? "async_tcp_%d" : "async_tcp", i);
+            xTaskCreateUniversal(_async_service_task, name, 8192 * 2, w, 3, &w->task, core);
+            if(!w->task){
+                return false;
+            }
         }
     }
     return true;
@@ -231,42 +801,70 @@ static bool _start_async_task(){
  * */
 
 static int8_t _tcp_clear_events(void * arg) {
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    AsyncClient * client = reinterpret_cast<AsyncClient*>(arg);
+    _forget_pending(arg);
+    if (client->eventToken() >= 0) {
+        _cancel_events(client->eventToken());
+        return ERR_OK;
+    }
+    lwip_event_packet_t * e = _alloc_event();
+    if (!e) {
+        return ERR_MEM;
+    }
     e->event = LWIP_TCP_CLEAR;
     e->arg = arg;
     if (!_prepend_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
     return ERR_OK;
 }
 
 static int8_t _tcp_connected(void * arg, tcp_pcb * pcb, int8_t err) {
     //ets_printf("+C: 0x%08x\n", pcb);
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_event();
+    if (!e) {
+        return ERR_MEM;
+    }
     e->event = LWIP_TCP_CONNECTED;
     e->arg = arg;
     e->connected.pcb = pcb;
     e->connected.err = err;
     if (!_prepend_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
     return ERR_OK;
 }
 
 static int8_t _tcp_poll(void * arg, struct tcp_pcb * pcb) {
     //ets_printf("+P: 0x%08x\n", pcb);
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    if (arg && _poll_pending(arg, pcb)) {
+        __atomic_fetch_add(&_queue_stats.poll_dropped, 1, __ATOMIC_RELAXED);
+        return ERR_OK;
+    }
+    lwip_event_packet_t * e = _alloc_event();
+    if (!e) {
+        return ERR_OK;
+    }
     e->event = LWIP_TCP_POLL;
     e->arg = arg;
     e->poll.pcb = pcb;
+    if (arg) {
+        _set_pending(e);
+    }
     if (!_send_async_event(&e)) {
-        free((void*)(e));
+        _clear_pending(e);
+        _free_event(e);
     }
     return ERR_OK;
 }
 
 static int8_t _tcp_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_t err) {
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = pb ? _alloc_event() : _alloc_terminal_event(arg);
+    if (!e) {
+        //lwIP keeps the data and offers it again
+        return pb ? (int8_t)ERR_MEM : AsyncClient::_s_lwip_fin(arg, pcb, err);
+    }
+    int8_t res = ERR_OK;
     e->arg = arg;
     if(pb){
         //ets_printf("+R: 0x%08x\n", pcb);
@@ -279,41 +877,61 @@ static int8_t _tcp_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_
         e->event = LWIP_TCP_FIN;
         e->fin.pcb = pcb;
         e->fin.err = err;
-        //close the PCB in LwIP thread
-        AsyncClient::_s_lwip_fin(e->arg, e->fin.pcb, e->fin.err);
+        //close the PCB in LwIP thread, ERR_ABRT if it was aborted
+        res = AsyncClient::_s_lwip_fin(e->arg, e->fin.pcb, e->fin.err);
     }
     if (!_send_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
+        //a full queue refuses data; lwIP keeps the pbuf and offers it again.
+        //a FIN is never refused, the pcb is closed already
+        return pb ? (int8_t)ERR_MEM : res;
     }
-    return ERR_OK;
+    return res;
 }
 
 static int8_t _tcp_sent(void * arg, struct tcp_pcb * pcb, uint16_t len) {
     //ets_printf("+S: 0x%08x\n", pcb);
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    if (arg && _merge_sent(arg, pcb, len)) {
+        __atomic_fetch_add(&_queue_stats.sent_merged, 1, __ATOMIC_RELAXED);
+        return ERR_OK;
+    }
+    lwip_event_packet_t * e = _alloc_event();
+    if (!e) {
+        return ERR_OK;
+    }
     e->event = LWIP_TCP_SENT;
     e->arg = arg;
     e->sent.pcb = pcb;
     e->sent.len = len;
+    if (arg) {
+        _set_pending(e);
+    }
     if (!_send_async_event(&e)) {
-        free((void*)(e));
+        _clear_pending(e);
+        _free_event(e);
     }
     return ERR_OK;
 }
 
 static void _tcp_error(void * arg, int8_t err) {
     //ets_printf("+E: 0x%08x\n", arg);
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_terminal_event(arg);
+    if (!e) {
+        return;
+    }
     e->event = LWIP_TCP_ERROR;
     e->arg = arg;
     e->error.err = err;
     if (!_send_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
 }
 
 static void _tcp_dns_found(const char * name, struct ip_addr * ipaddr, void * arg) {
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_event();
+    if (!e) {
+        return;
+    }
     //ets_printf("+DNS: name=%s ipaddr=0x%08x arg=%x\n", name, ipaddr, arg);
     e->event = LWIP_TCP_DNS;
     e->arg = arg;
@@ -324,22 +942,127 @@ static void _tcp_dns_found(const char * name, struct ip_addr * ipaddr, void * ar
         memset(&e->dns.addr, 0, sizeof(e->dns.addr));
     }
     if (!_send_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
 }
 
 //Used to switch out from LwIP thread
 static int8_t _tcp_accept(void * arg, AsyncClient * client) {
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_event();
+    if (!e) {
+        return ERR_MEM;
+    }
     e->event = LWIP_TCP_ACCEPT;
     e->arg = arg;
     e->accept.client = client;
     if (!_prepend_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
     return ERR_OK;
 }
 
+/*
+ * Buffers Of Closed Clients
+ * */
+
+// lwIP goes on sending the unacked data of a closed pcb, so the buffers a
+// client sent from without copying outlive it: close hands their references
+// to a holder that becomes the pcb's arg. It lets them go once no data is
+// left to send, or when the pcb fails. All in the lwIP thread, so for a
+// closed client the free handlers of the buffers run there.
+typedef struct tx_buffer_holder_t {
+        AsyncTxBuffer * buffers[CONFIG_ASYNC_TCP_TX_BUFFERS];
+        uint8_t count;
+} tx_buffer_holder_t;
+
+static void _release_holder(tx_buffer_holder_t * holder){
+    for(uint8_t i = 0; i < holder->count; i++) {
+        holder->buffers[i]->unref();
+    }
+    free(holder);
+}
+
+static bool _pcb_has_data(tcp_pcb * pcb){
+    //a FIN alone takes a segment without data
+    for(struct tcp_seg * seg = pcb->unsent; seg; seg = seg->next) {
+        if(seg->len) {
+            return true;
+        }
+    }
+    for(struct tcp_seg * seg = pcb->unacked; seg; seg = seg->next) {
+        if(seg->len) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//true if after tcp_close() the pcb still sends data. lwIP frees it at once
+//in the states before a connection, and resets it when data is left unread
+static bool _close_keeps_sending(tcp_pcb * pcb){
+    switch(pcb->state) {
+        case CLOSED:
+        case LISTEN:
+        case SYN_SENT:
+            return false;
+        case ESTABLISHED:
+        case CLOSE_WAIT:
+            if(pcb->refused_data || pcb->rcv_wnd != TCP_WND_MAX(pcb)) {
+                return false;
+            }
+            break;
+        default:
+            break;
+    }
+    return _pcb_has_data(pcb);
+}
+
+static int8_t _holder_sent(void * arg, struct tcp_pcb * pcb, uint16_t len) {
+    (void)len;
+    if(arg && !_pcb_has_data(pcb)) {
+        tcp_arg(pcb, NULL);
+        tcp_sent(pcb, NULL);
+        tcp_err(pcb, NULL);
+        _release_holder((tx_buffer_holder_t *)arg);
+    }
+    return ERR_OK;
+}
+
+static void _holder_error(void * arg, int8_t err) {
+    (void)err;
+    //the pcb is freed, with the segments that pointed into the buffers
+    if(arg) {
+        _release_holder((tx_buffer_holder_t *)arg);
+    }
+}
+
+static void _attach_holder(tcp_pcb * pcb, tx_buffer_holder_t * holder){
+    tcp_arg(pcb, holder);
+    tcp_sent(pcb, &_holder_sent);
+    tcp_err(pcb, &_holder_error);
+}
+
+//In LwIP Thread. closes 'pcb', leaving 'holder' with it while it sends. if
+//the close fails, the holder stays attached for the caller to abort the pcb
+static err_t _tcp_close_holding(tcp_pcb * pcb, tx_buffer_holder_t * holder){
+    if(!holder) {
+        return tcp_close(pcb);
+    }
+    bool sending = _close_keeps_sending(pcb);
+    if(sending) {
+        _attach_holder(pcb, holder);
+    }
+    err_t err = tcp_close(pcb);
+    if(!sending) {
+        if(err == ERR_OK) {
+            _release_holder(holder);
+        } else {
+            _attach_holder(pcb, holder);
+        }
+    }
+    return err;
+}
+
 /*
  * TCP/IP API Calls
  * */
@@ -349,7 +1072,7 @@ static int8_t _tcp_accept(void * arg, AsyncClient * client) {
 typedef struct {
     struct tcpip_api_call_data call;
     tcp_pcb * pcb;
-    int8_t closed_slot;
+    int32_t closed_slot;
     int8_t err;
     union {
             struct {
@@ -357,6 +1080,11 @@ typedef struct {
                     size_t size;
                     uint8_t apiflags;
             } write;
+            struct {
+                    const async_write_t* parts;
+                    size_t count;
+                    size_t written;
+            } parts;
             size_t received;
             struct {
                     ip_addr_t * addr;
@@ -368,19 +1096,20 @@ typedef struct {
                     uint16_t port;
             } bind;
             uint8_t backlog;
+            tx_buffer_holder_t * holder;
     };
 } tcp_api_call_t;
 
 static err_t _tcp_output_api(struct tcpip_api_call_data *api_call_msg){
     tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
     msg->err = ERR_CONN;
-    if(msg->closed_slot == -1 || !_closed_slots[msg->closed_slot]) {
+    if(_closed_slot_open(msg->closed_slot)) {
         msg->err = tcp_output(msg->pcb);
     }
     return msg->err;
 }
 
-static esp_err_t _tcp_output(tcp_pcb * pcb, int8_t closed_slot) {
+static esp_err_t _tcp_output(tcp_pcb * pcb, int32_t closed_slot) {
     if(!pcb){
         return ERR_CONN;
     }
@@ -394,13 +1123,13 @@ static esp_err_t _tcp_output(tcp_pcb * pcb, int8_t closed_slot) {
 static err_t _tcp_write_api(struct tcpip_api_call_data *api_call_msg){
     tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
     msg->err = ERR_CONN;
-    if(msg->closed_slot == -1 || !_closed_slots[msg->closed_slot]) {
+    if(_closed_slot_open(msg->closed_slot)) {
         msg->err = tcp_write(msg->pcb, msg->write.data, msg->write.size, msg->write.apiflags);
     }
     return msg->err;
 }
 
-static esp_err_t _tcp_write(tcp_pcb * pcb, int8_t closed_slot, const char* data, size_t size, uint8_t apiflags) {
+static esp_err_t _tcp_write(tcp_pcb * pcb, int32_t closed_slot, const char* data, size_t size, uint8_t apiflags) {
     if(!pcb){
         return ERR_CONN;
     }
@@ -414,17 +1143,68 @@ static esp_err_t _tcp_write(tcp_pcb * pcb, int8_t closed_slot, const char* data,
     return msg.err;
 }
 
+//writes the parts until the send buffer is full and outputs them, so a whole
+//frame costs one trip into the lwIP thread instead of one per add() and send()
+static err_t _tcp_write_parts_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    msg->err = ERR_CONN;
+    msg->parts.written = 0;
+    if(!_closed_slot_open(msg->closed_slot)) {
+        return msg->err;
+    }
+    msg->err = ERR_OK;
+    for(size_t i = 0; i < msg->parts.count; i++) {
+        const async_write_t* part = &msg->parts.parts[i];
+        if(!part->size) {
+            continue;
+        }
+        size_t room = tcp_sndbuf(msg->pcb);
+        size_t size = (room < part->size) ? room : part->size;
+        if(!size) {
+            break;
+        }
+        uint8_t apiflags = part->buffer ? (part->apiflags & ~ASYNC_WRITE_FLAG_COPY) : part->apiflags;
+        msg->err = tcp_write(msg->pcb, part->data, size, apiflags);
+        if(msg->err != ERR_OK) {
+            break;
+        }
+        msg->parts.written += size;
+        if(size < part->size) {
+            break;
+        }
+    }
+    if(msg->parts.written) {
+        msg->err = tcp_output(msg->pcb);
+    }
+    return msg->err;
+}
+
+static esp_err_t _tcp_write_parts(tcp_pcb * pcb, int32_t closed_slot, const async_write_t* parts, size_t count, size_t* written) {
+    *written = 0;
+    if(!pcb){
+        return ERR_CONN;
+    }
+    tcp_api_call_t msg;
+    msg.pcb = pcb;
+    msg.closed_slot = closed_slot;
+    msg.parts.parts = parts;
+    msg.parts.count = count;
+    tcpip_api_call(_tcp_write_parts_api, (struct tcpip_api_call_data*)&msg);
+    *written = msg.parts.written;
+    return msg.err;
+}
+
 static err_t _tcp_recved_api(struct tcpip_api_call_data *api_call_msg){
     tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
     msg->err = ERR_CONN;
-    if(msg->closed_slot == -1 || !_closed_slots[msg->closed_slot]) {
+    if(_closed_slot_open(msg->closed_slot)) {
         msg->err = 0;
         tcp_recved(msg->pcb, msg->received);
     }
     return msg->err;
 }
 
-static esp_err_t _tcp_recved(tcp_pcb * pcb, int8_t closed_slot, size_t len) {
+static esp_err_t _tcp_recved(tcp_pcb * pcb, int32_t closed_slot, size_t len) {
     if(!pcb){
         return ERR_CONN;
     }
@@ -439,19 +1219,23 @@ static esp_err_t _tcp_recved(tcp_pcb * pcb, int8_t closed_slot, size_t len) {
 static err_t _tcp_close_api(struct tcpip_api_call_data *api_call_msg){
     tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
     msg->err = ERR_CONN;
-    if(msg->closed_slot == -1 || !_closed_slots[msg->closed_slot]) {
-        msg->err = tcp_close(msg->pcb);
+    if(_closed_slot_open(msg->closed_slot)) {
+        msg->err = _tcp_close_holding(msg->pcb, msg->holder);
+    } else if(msg->holder) {
+        //the pcb is gone, and its segments with it
+        _release_holder(msg->holder);
     }
     return msg->err;
 }
 
-static esp_err_t _tcp_close(tcp_pcb * pcb, int8_t closed_slot) {
+static esp_err_t _tcp_close(tcp_pcb * pcb, int32_t closed_slot, tx_buffer_holder_t * holder) {
     if(!pcb){
         return ERR_CONN;
     }
     tcp_api_call_t msg;
     msg.pcb = pcb;
     msg.closed_slot = closed_slot;
+    msg.holder = holder;
     tcpip_api_call(_tcp_close_api, (struct tcpip_api_call_data*)&msg);
     return msg.err;
 }
@@ -459,13 +1243,13 @@ static esp_err_t _tcp_close(tcp_pcb * pcb, int8_t closed_slot) {
 static err_t _tcp_abort_api(struct tcpip_api_call_data *api_call_msg){
     tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
     msg->err = ERR_CONN;
-    if(msg->closed_slot == -1 || !_closed_slots[msg->closed_slot]) {
+    if(_closed_slot_open(msg->closed_slot)) {
         tcp_abort(msg->pcb);
     }
     return msg->err;
 }
 
-static esp_err_t _tcp_abort(tcp_pcb * pcb, int8_t closed_slot) {
+static esp_err_t _tcp_abort(tcp_pcb * pcb, int32_t closed_slot) {
     if(!pcb){
         return ERR_CONN;
     }
@@ -482,7 +1266,7 @@ static err_t _tcp_connect_api(struct tcpip_api_call_data *api_call_msg){
     return msg->err;
 }
 
-static esp_err_t _tcp_connect(tcp_pcb * pcb, int8_t closed_slot, ip_addr_t * addr, uint16_t port, tcp_connected_fn cb) {
+static esp_err_t _tcp_connect(tcp_pcb * pcb, int32_t closed_slot, ip_addr_t * addr, uint16_t port, tcp_connected_fn cb) {
     if(!pcb){
         return ESP_FAIL;
     }
@@ -536,6 +1320,38 @@ static tcp_pcb * _tcp_listen_with_backlog(tcp_pcb * pcb, uint8_t backlog) {
 
 
 
+/*
+  Async TX Buffer
+ */
+
+AsyncTxBuffer::AsyncTxBuffer(const char* data, size_t size, AcTxFreeHandler cb, void* arg)
+: _data(data)
+, _size(size)
+, _free_cb(cb)
+, _free_cb_arg(arg)
+, _refs(1)
+{}
+
+AsyncTxBuffer::~AsyncTxBuffer(){
+    if(_free_cb) {
+        _free_cb(_free_cb_arg, _data);
+    }
+}
+
+void AsyncTxBuffer::ref(){
+    __atomic_fetch_add(&_refs, 1, __ATOMIC_RELAXED);
+}
+
+void AsyncTxBuffer::unref(){
+    if(__atomic_sub_fetch(&_refs, 1, __ATOMIC_ACQ_REL) == 0){
+        delete this;
+    }
+}
+
+// guards the buffer references of all clients; they are added from the
+// sending task and released from the async task
+static portMUX_TYPE _tx_buffers_mux = portMUX_INITIALIZER_UNLOCKED;
+
 /*
   Async TCP Client
  */
@@ -562,11 +1378,19 @@ AsyncClient::AsyncClient(tcp_pcb* pcb)
 , _rx_since_timeout(0)
 , _ack_timeout(ASYNC_MAX_ACK_TIME)
 , _connect_port(0)
+, _tx_buffers_head(0)
+, _tx_buffers_count(0)
+, _tx_written(0)
+, _tx_acked(0)
 , prev(NULL)
 , next(NULL)
 {
     _pcb = pcb;
     _closed_slot = -1;
+    _recv_deleted = NULL;
+    _terminal_event = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    _event_token = _alloc_event_token();
+    _event_worker = _assign_worker();
     if(_pcb){
         _allocate_closed_slot();
         _rx_last_packet = millis();
@@ -582,7 +1406,15 @@ AsyncClient::~AsyncClient(){
     if(_pcb) {
         _close();
     }
+    _release_tx_buffers(true);
     _free_closed_slot();
+    _free_event_token(_event_token);
+    _event_token = -1;
+    _release_worker(_event_worker);
+    ::free(takeTerminalEvent());
+    if(_recv_deleted) {
+        *_recv_deleted = true;
+    }
 }
 
 /*
@@ -735,6 +1567,7 @@ int8_t AsyncClient::abort(){
         _tcp_abort(_pcb, _closed_slot );
         _pcb = NULL;
     }
+    _release_tx_buffers(true);
     return ERR_ABRT;
 }
 
@@ -759,9 +1592,101 @@ size_t AsyncClient::add(const char* data, size_t size, uint8_t apiflags) {
     if(err != ERR_OK) {
         return 0;
     }
+    _tx_written += will_send;
+    return will_send;
+}
+
+size_t AsyncClient::add(AsyncTxBuffer* buffer, size_t offset, size_t size, uint8_t apiflags) {
+    if(!buffer || offset >= buffer->size()) {
+        return 0;
+    }
+    if(size > buffer->size() - offset) {
+        size = buffer->size() - offset;
+    }
+    //parts of the same buffer added in a row share one reference
+    portENTER_CRITICAL(&_tx_buffers_mux);
+    uint8_t last = (_tx_buffers_head + _tx_buffers_count + CONFIG_ASYNC_TCP_TX_BUFFERS - 1) % CONFIG_ASYNC_TCP_TX_BUFFERS;
+    bool append = !_tx_buffers_count || _tx_buffers[last].buffer != buffer;
+    bool full = append && _tx_buffers_count == CONFIG_ASYNC_TCP_TX_BUFFERS;
+    portEXIT_CRITICAL(&_tx_buffers_mux);
+    if(full) {
+        return 0;
+    }
+    size_t will_send = add(buffer->data() + offset, size, apiflags & ~ASYNC_WRITE_FLAG_COPY);
+    if(!will_send) {
+        return 0;
+    }
+    _hold_tx_buffer(buffer);
+    //the data may have been acked already
+    _release_tx_buffers(false);
     return will_send;
 }
 
+//holds 'buffer' until the data written so far is acked. the caller has
+//checked that the ring has room
+void AsyncClient::_hold_tx_buffer(AsyncTxBuffer* buffer){
+    portENTER_CRITICAL(&_tx_buffers_mux);
+    uint8_t last = (_tx_buffers_head + _tx_buffers_count + CONFIG_ASYNC_TCP_TX_BUFFERS - 1) % CONFIG_ASYNC_TCP_TX_BUFFERS;
+    if(!_tx_buffers_count || _tx_buffers[last].buffer != buffer) {
+        buffer->ref();
+        last = (_tx_buffers_head + _tx_buffers_count) % CONFIG_ASYNC_TCP_TX_BUFFERS;
+        _tx_buffers[last].buffer = buffer;
+        _tx_buffers_count++;
+    }
+    _tx_buffers[last].end = _tx_written;
+    portEXIT_CRITICAL(&_tx_buffers_mux);
+}
+
+void AsyncClient::_release_tx_buffers(bool all){
+    for(;;) {
+        AsyncTxBuffer* buffer = NULL;
+        portENTER_CRITICAL(&_tx_buffers_mux);
+        if(_tx_buffers_count) {
+            tx_buffer_ref_t* r = &_tx_buffers[_tx_buffers_head];
+            if(all || (int32_t)(_tx_acked - r->end) >= 0) {
+                buffer = r->buffer;
+                _tx_buffers_head = (_tx_buffers_head + 1) % CONFIG_ASYNC_TCP_TX_BUFFERS;
+                _tx_buffers_count--;
+            }
+        }
+        portEXIT_CRITICAL(&_tx_buffers_mux);
+        if(!buffer) {
+            return;
+        }
+        buffer->unref();
+    }
+}
+
+//moves the buffer references to a new holder, NULL if there are none.
+//false if no holder could be allocated, the references stay then
+bool AsyncClient::_take_tx_buffers(tx_buffer_holder_t ** holder){
+    *holder = NULL;
+    portENTER_CRITICAL(&_tx_buffers_mux);
+    bool held = _tx_buffers_count != 0;
+    portEXIT_CRITICAL(&_tx_buffers_mux);
+    if(!held) {
+        return true;
+    }
+    tx_buffer_holder_t * h = (tx_buffer_holder_t *)malloc(sizeof(tx_buffer_holder_t));
+    if(!h) {
+        return false;
+    }
+    portENTER_CRITICAL(&_tx_buffers_mux);
+    for(uint8_t i = 0; i < _tx_buffers_count; i++) {
+        h->buffers[i] = _tx_buffers[(_tx_buffers_head + i) % CONFIG_ASYNC_TCP_TX_BUFFERS].buffer;
+    }
+    h->count = _tx_buffers_count;
+    _tx_buffers_count = 0;
+    portEXIT_CRITICAL(&_tx_buffers_mux);
+    //the async task may have released them meanwhile
+    if(!h->count) {
+        ::free(h);
+        return true;
+    }
+    *holder = h;
+    return true;
+}
+
 bool AsyncClient::send(){
     int8_t err = ERR_OK;
     err = _tcp_output(_pcb, _closed_slot);
@@ -806,7 +1731,10 @@ int8_t AsyncClient::_close(){
         tcp_err(_pcb, NULL);
         tcp_poll(_pcb, NULL, 0);
         _tcp_clear_events(this);
-        err = _tcp_close(_pcb, _closed_slot);
+        //the pcb keeps the buffers it still sends from. without memory for
+        //that the connection is reset
+        tx_buffer_holder_t * holder = NULL;
+        err = _take_tx_buffers(&holder) ? _tcp_close(_pcb, _closed_slot, holder) : ERR_ABRT;
         if(err != ERR_OK) {
             err = abort();
         }
@@ -819,26 +1747,19 @@ int8_t AsyncClient::_close(){
 }
 
 void AsyncClient::_allocate_closed_slot(){
-    xSemaphoreTake(_slots_lock, portMAX_DELAY);
-    uint32_t closed_slot_min_index = 0;
-    for (int i = 0; i < _number_of_closed_slots; ++ i) {
-        if ((_closed_slot == -1 || _closed_slots[i] <= closed_slot_min_index) && _closed_slots[i] != 0) {
-            closed_slot_min_index = _closed_slots[i];
-            _closed_slot = i;
-        }
-    }
-    if (_closed_slot != -1) {
-        _closed_slots[_closed_slot] = 0;
-    }
-    xSemaphoreGive(_slots_lock);
+    _closed_slot = _claim_closed_slot();
 }
 
+//runs on the lwIP thread from _lwip_fin() and on the async task from the
+//destructor, whichever comes first frees the slot
 void AsyncClient::_free_closed_slot(){
-    if (_closed_slot != -1) {
-        _closed_slots[_closed_slot] = _closed_index;
-        _closed_slot = -1;
-        ++ _closed_index;
-    }
+    _release_closed_slot(__atomic_exchange_n(&_closed_slot, -1, __ATOMIC_ACQ_REL));
+}
+
+//runs on the lwIP thread for the FIN or error event and on the async task
+//from the destructor, only one of them gets the packet
+lwip_event_packet_t * AsyncClient::takeTerminalEvent(){
+    return __atomic_exchange_n(&_terminal_event, (lwip_event_packet_t *)NULL, __ATOMIC_ACQ_REL);
 }
 
 /*
@@ -861,6 +1782,7 @@ int8_t AsyncClient::_connected(void* pcb, int8_t err){
 }
 
 void AsyncClient::_error(int8_t err) {
+    _release_tx_buffers(true);
     if(_pcb){
         tcp_arg(_pcb, NULL);
         if(_pcb->state == LISTEN) {
@@ -885,6 +1807,7 @@ int8_t AsyncClient::_lwip_fin(tcp_pcb* pcb, int8_t err) {
         log_e("0x%08x != 0x%08x", (uint32_t)pcb, (uint32_t)_pcb);
         return ERR_OK;
     }
+    int8_t res = ERR_OK;
     tcp_arg(_pcb, NULL);
     if(_pcb->state == LISTEN) {
         tcp_sent(_pcb, NULL);
@@ -892,16 +1815,23 @@ int8_t AsyncClient::_lwip_fin(tcp_pcb* pcb, int8_t err) {
         tcp_err(_pcb, NULL);
         tcp_poll(_pcb, NULL, 0);
     }
-    if(tcp_close(_pcb) != ERR_OK) {
+    //the pcb keeps the buffers it still sends from, like in _close()
+    tx_buffer_holder_t * holder = NULL;
+    if(!_take_tx_buffers(&holder) || _tcp_close_holding(_pcb, holder) != ERR_OK) {
+        if(!holder) {
+            tcp_err(_pcb, NULL);
+        }
         tcp_abort(_pcb);
+        res = ERR_ABRT;
     }
     _free_closed_slot();
     _pcb = NULL;
-    return ERR_OK;
+    return res;
 }
 
 //In Async Thread
 int8_t AsyncClient::_fin(tcp_pcb* pcb, int8_t err) {
+    _release_tx_buffers(true);
     _tcp_clear_events(this);
     if(_discard_cb) {
         _discard_cb(_discard_cb_arg, this);
@@ -913,6 +1843,8 @@ int8_t AsyncClient::_sent(tcp_pcb* pcb, uint16_t len) {
     _rx_last_packet = millis();
     //log_i("%u", len);
     _pcb_busy = false;
+    _tx_acked += len;
+    _release_tx_buffers(false);
     if(_sent_cb) {
         _sent_cb(_sent_cb_arg, this, len, (millis() - _pcb_sent_at));
     }
@@ -920,6 +1852,10 @@ int8_t AsyncClient::_sent(tcp_pcb* pcb, uint16_t len) {
 }
 
 int8_t AsyncClient::_recv(tcp_pcb* pcb, pbuf* pb, int8_t err) {
+    //a handler may close the client, which deletes it. the rest of the
+    //chain is freed then, without touching the client
+    bool deleted = false;
+    _recv_deleted = &deleted;
     while(pb != NULL) {
         _rx_last_packet = millis();
         //we should not ack before we assimilate the data
@@ -933,14 +1869,23 @@ int8_t AsyncClient::_recv(tcp_pcb* pcb, pbuf* pb, int8_t err) {
             if(_recv_cb) {
                 _recv_cb(_recv_cb_arg, this, b->payload, b->len);
             }
-            if(!_ack_pcb) {
+            if(deleted) {
+                //nothing to ack, the pcb went with the client
+            } else if(!_ack_pcb) {
                 _rx_ack_len += b->len;
             } else if(_pcb) {
                 _tcp_recved(_pcb, _closed_slot, b->len);
             }
             pbuf_free(b);
         }
+        if(deleted) {
+            if(pb) {
+                pbuf_free(pb);
+            }
+            return ERR_OK;
+        }
     }
+    _recv_deleted = NULL;
     return ERR_OK;
 }
 
@@ -1023,6 +1968,52 @@ size_t AsyncClient::write(const char* data, size_t size, uint8_t apiflags) {
     return will_send;
 }
 
+size_t AsyncClient::write(const async_write_t* parts, size_t count) {
+    if(!_pcb || !parts || !count) {
+        return 0;
+    }
+    //only as many parts as the buffer ring can hold references for
+    portENTER_CRITICAL(&_tx_buffers_mux);
+    uint8_t room = CONFIG_ASYNC_TCP_TX_BUFFERS - _tx_buffers_count;
+    AsyncTxBuffer* held = NULL;
+    if(_tx_buffers_count) {
+        held = _tx_buffers[(_tx_buffers_head + _tx_buffers_count - 1) % CONFIG_ASYNC_TCP_TX_BUFFERS].buffer;
+    }
+    portEXIT_CRITICAL(&_tx_buffers_mux);
+    size_t fit = 0;
+    for(; fit < count; fit++) {
+        AsyncTxBuffer* buffer = parts[fit].buffer;
+        if(buffer && buffer != held) {
+            if(!room) {
+                break;
+            }
+            room--;
+            held = buffer;
+        }
+    }
+    if(!fit) {
+        return 0;
+    }
+    size_t written = 0;
+    int8_t err = _tcp_write_parts(_pcb, _closed_slot, parts, fit, &written);
+    size_t left = written;
+    for(size_t i = 0; i < fit && left; i++) {
+        size_t size = (parts[i].size < left) ? parts[i].size : left;
+        _tx_written += size;
+        left -= size;
+        if(parts[i].buffer && size) {
+            _hold_tx_buffer(parts[i].buffer);
+        }
+    }
+    if(written && err == ERR_OK) {
+        _pcb_busy = true;
+        _pcb_sent_at = millis();
+    }
+    //the data may have been acked already
+    _release_tx_buffers(false);
+    return written;
+}
+
 void AsyncClient::setRxTimeout(uint32_t timeout){
     _rx_since_timeout = timeout;
 }
@@ -1283,7 +2274,7 @@ void AsyncServer::begin(){
     err = _tcp_bind(_pcb, &local_addr, _port);
 
     if (err != ERR_OK) {
-        _tcp_close(_pcb, -1);
+        _tcp_close(_pcb, -1, NULL);
         log_e("bind error: %d", err);
         return;
     }
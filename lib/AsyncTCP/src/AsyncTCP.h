@@ -33,9 +33,66 @@ extern "C" {
 //If core is not defined, then we are running in Arduino or PIO
 #ifndef CONFIG_ASYNC_TCP_RUNNING_CORE
 #define CONFIG_ASYNC_TCP_RUNNING_CORE -1 //any available core
-#define CONFIG_ASYNC_TCP_USE_WDT 1 //if enabled, adds between 33us and 200us per event
+#define CONFIG_ASYNC_TCP_USE_WDT 1 //if enabled, the async task is watched by the task WDT and feeds it once per batch of events
+#define CONFIG_ASYNC_TCP_EVENT_POOL 1 //if enabled, event packets come from a preallocated pool instead of the heap
 #endif
 
+typedef struct {
+    uint32_t allocs;        //event packets allocated
+    uint32_t overflows;     //allocations the pool could not serve, taken from the heap
+    uint32_t reserved;      //FIN and error events that used their client's reserved packet
+    uint32_t in_use;        //packets allocated and not freed yet
+    uint32_t peak;          //highest in_use seen
+    uint32_t alloc_cycles;  //CPU cycles spent allocating packets, wraps around
+    uint32_t free_cycles;   //CPU cycles spent freeing packets, wraps around
+} async_event_pool_stats_t;
+
+//copies the event packet counters, compare two copies for the cost per event
+void asyncTcpEventPoolStats(async_event_pool_stats_t * stats);
+
+#ifndef CONFIG_ASYNC_TCP_QUEUE_SIZE
+#define CONFIG_ASYNC_TCP_QUEUE_SIZE 32 //events the async task queue holds before lwIP callbacks shed or hold back events
+#endif
+
+#ifndef CONFIG_ASYNC_TCP_WORKERS
+#define CONFIG_ASYNC_TCP_WORKERS 1 //async tasks serving clients, each client's callbacks always run on the same one
+#endif
+
+#ifndef CONFIG_ASYNC_TCP_EVENT_BATCH
+#define CONFIG_ASYNC_TCP_EVENT_BATCH 16 //events the async task handles per wakeup before it feeds the WDT
+#endif
+
+#ifndef CONFIG_ASYNC_TCP_EVENT_BUDGET_MS
+#define CONFIG_ASYNC_TCP_EVENT_BUDGET_MS 100 //handlers running longer are logged and end the batch early
+#endif
+
+#ifndef CONFIG_ASYNC_TCP_TX_BUFFERS
+#define CONFIG_ASYNC_TCP_TX_BUFFERS 8 //buffers a client can send from without copying before their data is acked
+#endif
+
+#define ASYNC_TCP_EVENT_TYPES 9
+
+typedef struct {
+    uint32_t handled;       //events handled by the async task
+    uint32_t sent_merged;   //sent events added to one already queued for the client
+    uint32_t poll_dropped;  //poll events dropped, one was already queued for the client
+    uint32_t cancelled;     //events dropped because their client was closed after they were queued
+    uint32_t depth;         //events waiting now, in the queue and the overflow list
+    uint32_t high_water;    //highest depth seen
+    uint32_t overflowed;    //events that found the queue full and waited in the overflow list
+    uint32_t polls_shed;    //poll events dropped because the queue was full
+    uint32_t recv_refused;  //received data handed back to lwIP because the queue was full
+    uint32_t blocked_us;    //time lwIP callbacks spent queueing events, wraps around
+    uint32_t queued[ASYNC_TCP_EVENT_TYPES]; //events queued by type: sent, recv, fin, error, poll, clear, accept, connected, dns
+    uint32_t batches;       //wakeups of the async tasks that handled events, handled / batches is the batch size
+    uint32_t slow_events;   //handlers that ran over CONFIG_ASYNC_TCP_EVENT_BUDGET_MS
+    uint32_t handler_us;    //time spent in handlers, wraps around
+    uint32_t max_handler_us; //longest handler seen
+} async_queue_stats_t;
+
+//copies the event queue counters
+void asyncTcpQueueStats(async_queue_stats_t * stats);
+
 class AsyncClient;
 
 #define ASYNC_MAX_ACK_TIME 5000
@@ -48,9 +105,44 @@ typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
 typedef std::function<void(void*, AsyncClient*, void *data, size_t len)> AcDataHandler;
 typedef std::function<void(void*, AsyncClient*, struct pbuf *pb)> AcPacketHandler;
 typedef std::function<void(void*, AsyncClient*, uint32_t time)> AcTimeoutHandler;
+typedef std::function<void(void*, const char* data)> AcTxFreeHandler;
 
 struct tcp_pcb;
 struct ip_addr;
+struct lwip_event_packet_t;
+struct tx_buffer_holder_t;
+
+//Data sent without copying. lwIP references the bytes until the peer acks
+//them, so the buffer counts its references: the creator holds one and every
+//client sending from it holds one until its part is acked. The last unref()
+//calls the free handler and deletes the buffer.
+class AsyncTxBuffer {
+  public:
+    AsyncTxBuffer(const char* data, size_t size, AcTxFreeHandler cb = NULL, void* arg = NULL);
+
+    const char* data(){ return _data; }
+    size_t size(){ return _size; }
+    void ref();
+    void unref();
+
+  private:
+    ~AsyncTxBuffer();
+
+    const char* _data;
+    size_t _size;
+    AcTxFreeHandler _free_cb;
+    void* _free_cb_arg;
+    uint32_t _refs;
+};
+
+//one part of a batched write(). with 'buffer' set, 'data' points into it and
+//is sent without copying, the buffer is held until the part is acked
+typedef struct {
+    const char* data;
+    size_t size;
+    uint8_t apiflags;
+    AsyncTxBuffer* buffer;
+} async_write_t;
 
 class AsyncClient {
   public:
@@ -75,11 +167,13 @@ class AsyncClient {
     bool canSend();//ack is not pending
     size_t space();//space available in the TCP window
     size_t add(const char* data, size_t size, uint8_t apiflags=ASYNC_WRITE_FLAG_COPY);//add for sending
+    size_t add(AsyncTxBuffer* buffer, size_t offset, size_t size, uint8_t apiflags=0);//add part of a buffer for sending without copying, referenced until acked
     bool send();//send all data added with the method above
 
     //write equals add()+send()
     size_t write(const char* data);
     size_t write(const char* data, size_t size, uint8_t apiflags=ASYNC_WRITE_FLAG_COPY); //only when canSend() == true
+    size_t write(const async_write_t* parts, size_t count); //adds all parts and sends them in one call into the lwIP thread
 
     uint8_t state();
     bool connecting();
@@ -138,10 +232,17 @@ class AsyncClient {
 
     int8_t _recv(tcp_pcb* pcb, pbuf* pb, int8_t err);
     tcp_pcb * pcb(){ return _pcb; }
+    int16_t eventToken(){ return _event_token; }
+    uint8_t eventWorker(){ return _event_worker; }
+    lwip_event_packet_t * takeTerminalEvent();
 
   protected:
     tcp_pcb* _pcb;
-    int8_t  _closed_slot;
+    int32_t _closed_slot;
+    int16_t _event_token;
+    uint8_t _event_worker;
+    lwip_event_packet_t * _terminal_event; //reserved for the FIN or error event
+    bool* _recv_deleted;    //set while _recv() runs, the destructor sets it
 
     AcConnectHandler _connect_cb;
     void* _connect_cb_arg;
@@ -169,7 +270,22 @@ class AsyncClient {
     uint32_t _ack_timeout;
     uint16_t _connect_port;
 
+    //buffers sent from without copying, with the stream position their
+    //data ends at. released in order as _tx_acked passes them
+    typedef struct {
+        AsyncTxBuffer* buffer;
+        uint32_t end;
+    } tx_buffer_ref_t;
+    tx_buffer_ref_t _tx_buffers[CONFIG_ASYNC_TCP_TX_BUFFERS];
+    uint8_t _tx_buffers_head;
+    uint8_t _tx_buffers_count;
+    uint32_t _tx_written;
+    uint32_t _tx_acked;
+
     int8_t _close();
+    void _hold_tx_buffer(AsyncTxBuffer* buffer);
+    void _release_tx_buffers(bool all);
+    bool _take_tx_buffers(tx_buffer_holder_t** holder);
     void _free_closed_slot();
     void _allocate_closed_slot();
     int8_t _connected(void* pcb, int8_t err);
@@ -0,0 +1,497 @@
+#include <Arduino.h>
+
+#ifdef ASYNC_TCP_SIM_NATIVE
+
+#include <stdarg.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <thread>
+#include "AsyncTCPSim.h"
+extern "C" {
+#include "lwip/dns.h"
+#include "lwip/priv/tcp_priv.h"
+}
+#include "lwip/priv/tcpip_priv.h"
+
+//
+// Arduino and ESP-IDF
+//
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+static uint64_t elapsed(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long millis(void) { return (unsigned long)(elapsed() / 1000000); }
+unsigned long micros(void) { return (unsigned long)(elapsed() / 1000); }
+
+void ets_printf(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+}
+
+EspClass ESP;
+uint32_t EspClass::getCycleCount(void) { return (uint32_t)(elapsed() / 4); }	// 250 MHz
+uint32_t EspClass::getFreeHeap(void) { return 100000; }
+
+static uint32_t wdtAddCount, wdtDeleteCount, wdtResetCount;
+
+esp_err_t esp_task_wdt_add(TaskHandle_t) { __atomic_fetch_add(&wdtAddCount, 1, __ATOMIC_RELAXED); return ESP_OK; }
+esp_err_t esp_task_wdt_delete(TaskHandle_t) { __atomic_fetch_add(&wdtDeleteCount, 1, __ATOMIC_RELAXED); return ESP_OK; }
+esp_err_t esp_task_wdt_reset(void) { __atomic_fetch_add(&wdtResetCount, 1, __ATOMIC_RELAXED); return ESP_OK; }
+
+//
+// FreeRTOS
+//
+
+struct SimQueue
+{
+	std::mutex lock;
+	std::condition_variable changed;
+	std::deque<std::vector<char> > items;
+	UBaseType_t length;
+	UBaseType_t itemSize;
+};
+
+template <typename Ready>
+static bool waitFor(SimQueue *q, std::unique_lock<std::mutex> &held, TickType_t wait, Ready ready)
+{
+	if (ready()) return true;
+	if (wait == 0) return false;
+	if (wait == portMAX_DELAY) {
+		q->changed.wait(held, ready);
+		return true;
+	}
+	return q->changed.wait_for(held, std::chrono::milliseconds(wait), ready);
+}
+
+static BaseType_t queuePut(QueueHandle_t queue, const void *item, TickType_t wait, bool front)
+{
+	SimQueue *q = (SimQueue *)queue;
+	std::unique_lock<std::mutex> held(q->lock);
+	if (!waitFor(q, held, wait, [q] { return q->items.size() < q->length; })) return pdFAIL;
+	std::vector<char> copy((const char *)item, (const char *)item + q->itemSize);
+	if (front) q->items.push_front(copy);
+	else q->items.push_back(copy);
+	q->changed.notify_all();
+	return pdPASS;
+}
+
+static BaseType_t queueGet(QueueHandle_t queue, void *item, TickType_t wait, bool remove)
+{
+	SimQueue *q = (SimQueue *)queue;
+	std::unique_lock<std::mutex> held(q->lock);
+	if (!waitFor(q, held, wait, [q] { return !q->items.empty(); })) return pdFAIL;
+	memcpy(item, q->items.front().data(), q->itemSize);
+	if (remove) {
+		q->items.pop_front();
+		q->changed.notify_all();
+	}
+	return pdPASS;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+	SimQueue *q = new SimQueue;
+	q->length = length;
+	q->itemSize = itemSize;
+	return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait) { return queuePut(q, item, wait, false); }
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t wait) { return queuePut(q, item, wait, false); }
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t wait) { return queuePut(q, item, wait, true); }
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait) { return queueGet(q, item, wait, true); }
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t wait) { return queueGet(q, item, wait, false); }
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+	SimQueue *q = (SimQueue *)queue;
+	std::lock_guard<std::mutex> held(q->lock);
+	return q->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+	SimQueue *q = (SimQueue *)queue;
+	std::lock_guard<std::mutex> held(q->lock);
+	return q->length - q->items.size();
+}
+
+struct SimSemaphore
+{
+	std::mutex lock;
+	std::condition_variable given;
+	bool available;
+};
+
+static SemaphoreHandle_t semaphoreCreate(bool available)
+{
+	SimSemaphore *s = new SimSemaphore;
+	s->available = available;
+	return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return semaphoreCreate(false); }
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return semaphoreCreate(true); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t)
+{
+	SimSemaphore *s = (SimSemaphore *)sem;
+	std::unique_lock<std::mutex> held(s->lock);
+	s->given.wait(held, [s] { return s->available; });
+	s->available = false;
+	return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+	SimSemaphore *s = (SimSemaphore *)sem;
+	std::lock_guard<std::mutex> held(s->lock);
+	s->available = true;
+	s->given.notify_all();
+	return pdTRUE;
+}
+
+static std::recursive_mutex critical;
+
+void vPortCPUInitializeMutex(portMUX_TYPE *) { }
+void portENTER_CRITICAL(portMUX_TYPE *) { critical.lock(); }
+void portEXIT_CRITICAL(portMUX_TYPE *) { critical.unlock(); }
+void portENTER_CRITICAL_ISR(portMUX_TYPE *) { critical.lock(); }
+void portEXIT_CRITICAL_ISR(portMUX_TYPE *) { critical.unlock(); }
+
+BaseType_t xTaskCreateUniversal(TaskFunction_t fn, const char *, uint32_t, void *param,
+                                UBaseType_t, TaskHandle_t *handle, BaseType_t)
+{
+	std::thread *task = new std::thread(fn, param);
+	task->detach();
+	if (handle) *handle = task;
+	return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+	return xTaskCreateUniversal(fn, name, stack, param, priority, handle, core);
+}
+
+void vTaskDelete(TaskHandle_t)
+{
+	for (;;) std::this_thread::sleep_for(std::chrono::hours(1));
+}
+
+static thread_local int currentTask;
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return &currentTask; }
+TickType_t xTaskGetTickCount(void) { return millis(); }
+void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+BaseType_t xPortGetCoreID(void) { return 0; }
+
+//
+// lwIP
+//
+
+struct SimPcbState
+{
+	AsyncTCPSimPcb callbacks;
+	std::vector<char> written;
+	uint32_t outputs = 0;
+	uint32_t recved = 0;
+	uint32_t closes = 0;
+	uint32_t aborts = 0;
+	uint32_t resets = 0;
+};
+
+static std::recursive_mutex lwipThread;
+static std::map<tcp_pcb *, SimPcbState> pcbs;
+static tcp_pcb *listening;
+static uint32_t apiCallCount;
+static int32_t pbufCount;
+
+AsyncTCPSim::Lock::Lock() { lwipThread.lock(); }
+AsyncTCPSim::Lock::~Lock() { lwipThread.unlock(); }
+
+err_t tcpip_api_call(tcpip_api_call_fn fn, struct tcpip_api_call_data *call)
+{
+	AsyncTCPSim::Lock lwip;
+	apiCallCount++;
+	return fn(call);
+}
+
+static void appendSegment(tcp_seg **list, uint16_t len)
+{
+	while (*list) list = &(*list)->next;
+	*list = new tcp_seg();
+	(*list)->len = len;
+}
+
+static void freeSegments(tcp_pcb *pcb)
+{
+	tcp_seg **lists[] = { &pcb->unsent, &pcb->unacked };
+	for (tcp_seg **list : lists) {
+		while (*list) {
+			tcp_seg *seg = *list;
+			*list = seg->next;
+			delete seg;
+		}
+	}
+}
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg) { pcbs[pcb].callbacks.arg = arg; }
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv) { pcbs[pcb].callbacks.recv = recv; }
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent) { pcbs[pcb].callbacks.sent = sent; }
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err) { pcbs[pcb].callbacks.err = err; }
+void tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, uint8_t) { pcbs[pcb].callbacks.poll = poll; }
+
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept)
+{
+	pcbs[pcb].callbacks.accept = accept;
+	if (accept) listening = pcb;
+}
+
+// Sent at once: the data goes straight to the unacked segments
+err_t tcp_write(struct tcp_pcb *pcb, const void *data, uint16_t len, uint8_t)
+{
+	if (len > pcb->snd_buf) return ERR_MEM;
+	std::vector<char> &written = pcbs[pcb].written;
+	written.insert(written.end(), (const char *)data, (const char *)data + len);
+	pcb->snd_buf -= len;
+	appendSegment(&pcb->unacked, len);
+	return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb *pcb) { pcbs[pcb].outputs++; return ERR_OK; }
+void tcp_recved(struct tcp_pcb *pcb, uint16_t len) { pcbs[pcb].recved += len; }
+
+// As lwIP 2.1: a pcb that is not connected yet is freed, one with unread
+// data is reset, any other queues a FIN
+err_t tcp_close(struct tcp_pcb *pcb)
+{
+	SimPcbState &sim = pcbs[pcb];
+	sim.closes++;
+	switch (pcb->state) {
+	case CLOSED:
+	case LISTEN:
+	case SYN_SENT:
+		freeSegments(pcb);
+		pcb->state = CLOSED;
+		return ERR_OK;
+	case ESTABLISHED:
+	case CLOSE_WAIT:
+		if (pcb->refused_data || pcb->rcv_wnd != TCP_WND_MAX(pcb)) {
+			sim.resets++;
+			freeSegments(pcb);
+			pcb->state = CLOSED;
+			return ERR_OK;
+		}
+		pcb->state = pcb->state == CLOSE_WAIT ? LAST_ACK : FIN_WAIT_1;
+		break;
+	case SYN_RCVD:
+		pcb->state = FIN_WAIT_1;
+		break;
+	default:
+		return ERR_OK;
+	}
+	appendSegment(&pcb->unsent, 0);
+	return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb *pcb)
+{
+	SimPcbState &sim = pcbs[pcb];
+	AsyncTCPSimPcb callbacks = sim.callbacks;
+	sim.closes++;
+	sim.aborts++;
+	sim.callbacks = AsyncTCPSimPcb();
+	freeSegments(pcb);
+	pcb->state = CLOSED;
+	if (callbacks.err) callbacks.err(callbacks.arg, ERR_ABRT);
+}
+
+err_t tcp_connect(struct tcp_pcb *, const ip_addr_t *, uint16_t, tcp_connected_fn) { return ERR_OK; }
+err_t tcp_bind(struct tcp_pcb *, const ip_addr_t *, uint16_t) { return ERR_OK; }
+
+struct tcp_pcb *tcp_listen_with_backlog(struct tcp_pcb *pcb, uint8_t)
+{
+	pcb->state = LISTEN;
+	return pcb;
+}
+
+struct tcp_pcb *tcp_new_ip_type(uint8_t)
+{
+	tcp_pcb *pcb = new tcp_pcb();
+	pcb->snd_buf = TCP_WND;
+	pcb->mss = 1436;
+	pcb->rcv_wnd = TCP_WND;
+	return pcb;
+}
+
+err_t dns_gethostbyname(const char *, ip_addr_t *, dns_found_callback, void *) { return ERR_VAL; }
+const char *ipaddr_ntoa(const ip_addr_t *) { return "0.0.0.0"; }
+
+struct pbuf *pbuf_alloc(pbuf_layer, uint16_t length, pbuf_type)
+{
+	pbuf *p = (pbuf *)calloc(1, sizeof(pbuf) + length);
+	p->payload = p + 1;
+	p->len = p->tot_len = length;
+	p->ref = 1;
+	__atomic_fetch_add(&pbufCount, 1, __ATOMIC_RELAXED);
+	return p;
+}
+
+uint8_t pbuf_free(struct pbuf *p)
+{
+	uint8_t freed = 0;
+	while (p && --p->ref == 0) {
+		pbuf *next = p->next;
+		free(p);
+		__atomic_fetch_sub(&pbufCount, 1, __ATOMIC_RELAXED);
+		freed++;
+		p = next;
+	}
+	return freed;
+}
+
+void pbuf_ref(struct pbuf *p) { p->ref++; }
+
+void pbuf_cat(struct pbuf *head, struct pbuf *tail)
+{
+	pbuf *p = head;
+	for (; p->next; p = p->next) p->tot_len += tail->tot_len;
+	p->tot_len += tail->tot_len;
+	p->next = tail;
+}
+
+void pbuf_chain(struct pbuf *head, struct pbuf *tail)
+{
+	pbuf_cat(head, tail);
+	pbuf_ref(tail);
+}
+
+uint16_t pbuf_copy_partial(const struct pbuf *p, void *data, uint16_t len, uint16_t offset)
+{
+	uint16_t copied = 0;
+	for (; p && len; p = p->next) {
+		if (offset >= p->len) {
+			offset -= p->len;
+			continue;
+		}
+		uint16_t n = p->len - offset;
+		if (n > len) n = len;
+		memcpy((char *)data + copied, (char *)p->payload + offset, n);
+		copied += n;
+		len -= n;
+		offset = 0;
+	}
+	return copied;
+}
+
+struct pbuf *pbuf_skip(struct pbuf *p, uint16_t offset, uint16_t *remaining)
+{
+	while (p && offset >= p->len) {
+		offset -= p->len;
+		p = p->next;
+	}
+	if (remaining) *remaining = offset;
+	return p;
+}
+
+uint8_t pbuf_get_at(const struct pbuf *p, uint16_t offset)
+{
+	for (; p; p = p->next) {
+		if (offset < p->len) return ((uint8_t *)p->payload)[offset];
+		offset -= p->len;
+	}
+	return 0;
+}
+
+//
+// AsyncTCPSim
+//
+
+AsyncTCPSimPcb &AsyncTCPSim::callbacks(tcp_pcb *pcb)
+{
+	return pcbs[pcb].callbacks;
+}
+
+tcp_pcb *AsyncTCPSim::listener(void)
+{
+	return listening;
+}
+
+tcp_pcb *AsyncTCPSim::newPcb(uint16_t sndbuf)
+{
+	tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_V4);
+	pcb->state = ESTABLISHED;
+	pcb->snd_buf = sndbuf;
+	return pcb;
+}
+
+err_t AsyncTCPSim::accept(tcp_pcb *pcb)
+{
+	Lock lwip;
+	AsyncTCPSimPcb &server = pcbs[listening].callbacks;
+	return server.accept(server.arg, pcb, ERR_OK);
+}
+
+err_t AsyncTCPSim::ack(tcp_pcb *pcb, uint16_t len)
+{
+	Lock lwip;
+	uint16_t left = len;
+	while (pcb->unacked && pcb->unacked->len <= left) {
+		tcp_seg *seg = pcb->unacked;
+		left -= seg->len;
+		pcb->snd_buf += seg->len;
+		pcb->unacked = seg->next;
+		delete seg;
+	}
+	if (pcb->unacked) {
+		pcb->unacked->len -= left;
+		pcb->snd_buf += left;
+	}
+	// the FIN goes with the last data
+	while (!pcb->unacked && pcb->unsent && !pcb->unsent->len) {
+		tcp_seg *seg = pcb->unsent;
+		pcb->unsent = seg->next;
+		delete seg;
+	}
+	AsyncTCPSimPcb &cb = pcbs[pcb].callbacks;
+	return cb.sent ? cb.sent(cb.arg, pcb, len) : ERR_OK;
+}
+
+err_t AsyncTCPSim::receive(tcp_pcb *pcb, uint16_t len)
+{
+	Lock lwip;
+	pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+	AsyncTCPSimPcb &cb = pcbs[pcb].callbacks;
+	err_t err = cb.recv ? cb.recv(cb.arg, pcb, p, ERR_OK) : ERR_CONN;
+	if (err != ERR_OK) pbuf_free(p);
+	return err;
+}
+
+const std::vector<char> &AsyncTCPSim::written(tcp_pcb *pcb) { Lock lwip; return pcbs[pcb].written; }
+uint32_t AsyncTCPSim::outputs(tcp_pcb *pcb) { Lock lwip; return pcbs[pcb].outputs; }
+uint32_t AsyncTCPSim::recved(tcp_pcb *pcb) { Lock lwip; return pcbs[pcb].recved; }
+uint32_t AsyncTCPSim::closes(tcp_pcb *pcb) { Lock lwip; return pcbs[pcb].closes; }
+uint32_t AsyncTCPSim::aborts(tcp_pcb *pcb) { Lock lwip; return pcbs[pcb].aborts; }
+uint32_t AsyncTCPSim::resets(tcp_pcb *pcb) { Lock lwip; return pcbs[pcb].resets; }
+
+uint32_t AsyncTCPSim::apiCalls(void) { Lock lwip; return apiCallCount; }
+int32_t AsyncTCPSim::livePbufs(void) { return __atomic_load_n(&pbufCount, __ATOMIC_RELAXED); }
+uint32_t AsyncTCPSim::wdtAdds(void) { return __atomic_load_n(&wdtAddCount, __ATOMIC_RELAXED); }
+uint32_t AsyncTCPSim::wdtDeletes(void) { return __atomic_load_n(&wdtDeleteCount, __ATOMIC_RELAXED); }
+uint32_t AsyncTCPSim::wdtResets(void) { return __atomic_load_n(&wdtResetCount, __ATOMIC_RELAXED); }
+
+void AsyncTCPSim::settle(uint32_t ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+#endif // ASYNC_TCP_SIM_NATIVE
@@ -0,0 +1,89 @@
+#ifndef AsyncTCPSim_h
+#define AsyncTCPSim_h
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+extern "C" {
+#include "lwip/tcp.h"
+}
+
+// Host-side stand-ins for the FreeRTOS, ESP-IDF and lwIP calls AsyncTCP
+// makes, so lib/AsyncTCP can run off-target:
+//
+//  - tasks are std::threads, queues and semaphores wait on std::mutex,
+//    and every critical section takes one recursive mutex
+//  - there is no TCP stack: the test plays the lwIP thread.  It calls
+//    the callbacks AsyncTCP registered on a pcb while holding
+//    AsyncTCPSim::Lock, which tcpip_api_call() takes too, and checks
+//    what AsyncTCP asked of the pcb
+//
+//    AsyncServer server(80);
+//    server.begin();
+//    tcp_pcb *pcb = AsyncTCPSim::newPcb();
+//    AsyncTCPSim::accept(pcb);
+//    ...
+//    AsyncTCPSim::callbacks(pcb).sent(...);
+//
+// Native builds add the shims to the include path:
+//
+//    build_flags = -DARDUINO=100 -Ilib/AsyncTCPSim/native -pthread
+
+// Callbacks AsyncTCP registered on a pcb
+struct AsyncTCPSimPcb
+{
+    void *arg = NULL;
+    tcp_recv_fn recv = NULL;
+    tcp_sent_fn sent = NULL;
+    tcp_err_fn err = NULL;
+    tcp_poll_fn poll = NULL;
+    tcp_accept_fn accept = NULL;
+};
+
+class AsyncTCPSim
+{
+  public:
+    // Being the lwIP thread
+    class Lock
+    {
+      public:
+        Lock();
+        ~Lock();
+    };
+
+    static AsyncTCPSimPcb &callbacks(tcp_pcb *pcb);
+
+    // The pcb of the server that listened last
+    static tcp_pcb *listener(void);
+
+    // A connected pcb, offered to the listener by accept()
+    static tcp_pcb *newPcb(uint16_t sndbuf = TCP_WND);
+    static err_t accept(tcp_pcb *pcb);
+
+    // The peer acks 'len' data bytes: the acked segments are dropped and
+    // their bytes return to the send buffer, then the sent callback runs
+    static err_t ack(tcp_pcb *pcb, uint16_t len);
+
+    // A pbuf of 'len' bytes handed to the recv callback, freed here if
+    // the callback refuses it
+    static err_t receive(tcp_pcb *pcb, uint16_t len);
+
+    // What AsyncTCP asked of a pcb
+    static const std::vector<char> &written(tcp_pcb *pcb);
+    static uint32_t outputs(tcp_pcb *pcb);
+    static uint32_t recved(tcp_pcb *pcb);
+    static uint32_t closes(tcp_pcb *pcb);
+    static uint32_t aborts(tcp_pcb *pcb);
+    static uint32_t resets(tcp_pcb *pcb);   // closes that reset, see tcp_close()
+
+    static uint32_t apiCalls(void);         // tcpip_api_call()s so far
+    static int32_t livePbufs(void);
+    static uint32_t wdtAdds(void);
+    static uint32_t wdtDeletes(void);
+    static uint32_t wdtResets(void);
+
+    // Gives the async task time to drain its queue
+    static void settle(uint32_t ms = 50);
+};
+
+#endif // AsyncTCPSim_h
@@ -0,0 +1,40 @@
+#ifndef AsyncTCPSim_Arduino_h
+#define AsyncTCPSim_Arduino_h
+
+// Minimal Arduino-ESP32 API for native builds of AsyncTCP.  Time is the
+// host's steady clock; logging is dropped, the ESP32 log macros cast
+// pointers to 32 bits.  Implemented in AsyncTCPSim.cpp.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_task_wdt.h"
+#include "IPAddress.h"
+
+#define ASYNC_TCP_SIM_NATIVE 1
+
+#define log_e(...) ((void)0)
+#define log_w(...) ((void)0)
+#define log_i(...) ((void)0)
+#define log_d(...) ((void)0)
+#define log_v(...) ((void)0)
+
+unsigned long millis(void);
+unsigned long micros(void);
+void ets_printf(const char *format, ...);
+
+class EspClass
+{
+  public:
+    uint32_t getCycleCount(void);
+    uint32_t getFreeHeap(void);
+};
+extern EspClass ESP;
+
+#endif // AsyncTCPSim_Arduino_h
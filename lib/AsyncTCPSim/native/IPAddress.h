@@ -0,0 +1,16 @@
+#ifndef AsyncTCPSim_IPAddress_h
+#define AsyncTCPSim_IPAddress_h
+
+#include <stdint.h>
+
+class IPAddress
+{
+  public:
+    IPAddress(uint32_t address = 0) : _address(address) { }
+    operator uint32_t() const { return _address; }
+
+  private:
+    uint32_t _address;
+};
+
+#endif // AsyncTCPSim_IPAddress_h
@@ -0,0 +1,17 @@
+#ifndef AsyncTCPSim_esp_task_wdt_h
+#define AsyncTCPSim_esp_task_wdt_h
+
+#include "freertos/task.h"
+
+typedef int esp_err_t;
+#define ESP_OK   0
+#define ESP_FAIL -1
+
+#define CONFIG_ESP_TASK_WDT_TIMEOUT_S 5
+
+// Counted, see AsyncTCPSim::wdtAdds() and friends
+esp_err_t esp_task_wdt_add(TaskHandle_t task);
+esp_err_t esp_task_wdt_delete(TaskHandle_t task);
+esp_err_t esp_task_wdt_reset(void);
+
+#endif // AsyncTCPSim_esp_task_wdt_h
@@ -0,0 +1,35 @@
+#ifndef AsyncTCPSim_FreeRTOS_h
+#define AsyncTCPSim_FreeRTOS_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdPASS  1
+#define pdFAIL  0
+#define pdTRUE  1
+#define pdFALSE 0
+
+#define portMAX_DELAY      0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define portNUM_PROCESSORS 2
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms)  (ms)
+
+// All critical sections share one recursive host mutex
+typedef struct {
+    volatile uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux);
+void portENTER_CRITICAL(portMUX_TYPE *mux);
+void portEXIT_CRITICAL(portMUX_TYPE *mux);
+void portENTER_CRITICAL_ISR(portMUX_TYPE *mux);
+void portEXIT_CRITICAL_ISR(portMUX_TYPE *mux);
+
+#endif // AsyncTCPSim_FreeRTOS_h
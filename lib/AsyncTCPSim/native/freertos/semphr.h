@@ -0,0 +1,13 @@
+#ifndef AsyncTCPSim_semphr_h
+#define AsyncTCPSim_semphr_h
+
+#include "queue.h"
+
+typedef void *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+
+#endif // AsyncTCPSim_semphr_h
@@ -0,0 +1,22 @@
+#ifndef AsyncTCPSim_task_h
+#define AsyncTCPSim_task_h
+
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define tskNO_AFFINITY 0x7fffffff
+
+// Tasks run on detached std::threads; a task that deletes itself parks
+BaseType_t xTaskCreateUniversal(TaskFunction_t fn, const char *name, uint32_t stack, void *param,
+                                UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+BaseType_t xPortGetCoreID(void);
+
+#endif // AsyncTCPSim_task_h
@@ -0,0 +1,12 @@
+#ifndef AsyncTCPSim_lwip_dns_h
+#define AsyncTCPSim_lwip_dns_h
+
+#include "ip_addr.h"
+#include "err.h"
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *addr, void *arg);
+
+// Always fails: the simulated stack has no resolver
+err_t dns_gethostbyname(const char *name, ip_addr_t *addr, dns_found_callback found, void *arg);
+
+#endif // AsyncTCPSim_lwip_dns_h
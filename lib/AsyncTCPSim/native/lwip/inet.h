@@ -0,0 +1,4 @@
+#ifndef AsyncTCPSim_lwip_inet_h
+#define AsyncTCPSim_lwip_inet_h
+
+#endif // AsyncTCPSim_lwip_inet_h
@@ -0,0 +1,22 @@
+#ifndef AsyncTCPSim_lwip_ip_addr_h
+#define AsyncTCPSim_lwip_ip_addr_h
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t addr;
+} ip4_addr_t;
+
+typedef struct ip_addr {
+    union {
+        ip4_addr_t ip4;
+    } u_addr;
+    uint8_t type;
+} ip_addr_t;
+
+#define IPADDR_TYPE_V4 0
+#define IPADDR_ANY     0
+
+const char *ipaddr_ntoa(const ip_addr_t *addr);
+
+#endif // AsyncTCPSim_lwip_ip_addr_h
@@ -0,0 +1,8 @@
+#ifndef AsyncTCPSim_lwip_opt_h
+#define AsyncTCPSim_lwip_opt_h
+
+#include "err.h"
+
+#define TCP_WND 5744
+
+#endif // AsyncTCPSim_lwip_opt_h
@@ -0,0 +1,31 @@
+#ifndef AsyncTCPSim_lwip_pbuf_h
+#define AsyncTCPSim_lwip_pbuf_h
+
+#include <stdint.h>
+#include "err.h"
+
+typedef enum { PBUF_TRANSPORT, PBUF_RAW } pbuf_layer;
+typedef enum { PBUF_RAM, PBUF_ROM, PBUF_REF, PBUF_POOL } pbuf_type;
+
+// Heap allocated and reference counted like lwIP's, see
+// AsyncTCPSim::livePbufs()
+struct pbuf {
+    struct pbuf *next;
+    void *payload;
+    uint16_t tot_len;
+    uint16_t len;
+    uint8_t type_internal;
+    uint8_t flags;
+    uint16_t ref;
+};
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, uint16_t length, pbuf_type type);
+uint8_t pbuf_free(struct pbuf *p);
+void pbuf_ref(struct pbuf *p);
+void pbuf_cat(struct pbuf *head, struct pbuf *tail);
+void pbuf_chain(struct pbuf *head, struct pbuf *tail);
+uint16_t pbuf_copy_partial(const struct pbuf *p, void *data, uint16_t len, uint16_t offset);
+struct pbuf *pbuf_skip(struct pbuf *p, uint16_t offset, uint16_t *remaining);
+uint8_t pbuf_get_at(const struct pbuf *p, uint16_t offset);
+
+#endif // AsyncTCPSim_lwip_pbuf_h
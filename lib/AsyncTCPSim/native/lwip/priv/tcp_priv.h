@@ -0,0 +1,11 @@
+#ifndef AsyncTCPSim_lwip_tcp_priv_h
+#define AsyncTCPSim_lwip_tcp_priv_h
+
+#include "../tcp.h"
+
+struct tcp_seg {
+    struct tcp_seg *next;
+    uint16_t len;    // data bytes, a FIN is not counted
+};
+
+#endif // AsyncTCPSim_lwip_tcp_priv_h
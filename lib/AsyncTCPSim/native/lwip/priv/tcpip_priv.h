@@ -0,0 +1,16 @@
+#ifndef AsyncTCPSim_lwip_tcpip_priv_h
+#define AsyncTCPSim_lwip_tcpip_priv_h
+
+#include "../err.h"
+
+struct tcpip_api_call_data {
+    err_t err;
+    void *sem;
+};
+
+typedef err_t (*tcpip_api_call_fn)(struct tcpip_api_call_data *call);
+
+// Runs 'fn' at once under AsyncTCPSim::Lock, standing in for the lwIP thread
+err_t tcpip_api_call(tcpip_api_call_fn fn, struct tcpip_api_call_data *call);
+
+#endif // AsyncTCPSim_lwip_tcpip_priv_h
@@ -0,0 +1,68 @@
+#ifndef AsyncTCPSim_lwip_tcp_h
+#define AsyncTCPSim_lwip_tcp_h
+
+#include "opt.h"
+#include "err.h"
+#include "pbuf.h"
+#include "ip_addr.h"
+
+enum tcp_state {
+    CLOSED, LISTEN, SYN_SENT, SYN_RCVD, ESTABLISHED, FIN_WAIT_1,
+    FIN_WAIT_2, CLOSE_WAIT, CLOSING, LAST_ACK, TIME_WAIT
+};
+
+struct tcp_seg;
+
+// The fields AsyncTCP reads.  unsent and unacked hold one segment per
+// tcp_write() and a data-less one for a queued FIN
+struct tcp_pcb {
+    enum tcp_state state;
+    struct tcp_seg *unsent;
+    struct tcp_seg *unacked;
+    struct pbuf *refused_data;
+    uint16_t rcv_wnd;
+    ip_addr_t remote_ip;
+    ip_addr_t local_ip;
+    uint16_t remote_port;
+    uint16_t local_port;
+    uint16_t snd_buf;
+    uint16_t mss;
+    uint8_t flags;
+};
+
+typedef err_t (*tcp_recv_fn)(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
+typedef err_t (*tcp_sent_fn)(void *arg, struct tcp_pcb *pcb, uint16_t len);
+typedef err_t (*tcp_poll_fn)(void *arg, struct tcp_pcb *pcb);
+typedef void (*tcp_err_fn)(void *arg, err_t err);
+typedef err_t (*tcp_accept_fn)(void *arg, struct tcp_pcb *pcb, err_t err);
+typedef err_t (*tcp_connected_fn)(void *arg, struct tcp_pcb *pcb, err_t err);
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg);
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv);
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent);
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err);
+void tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, uint8_t interval);
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept);
+
+err_t tcp_write(struct tcp_pcb *pcb, const void *data, uint16_t len, uint8_t apiflags);
+err_t tcp_output(struct tcp_pcb *pcb);
+void tcp_recved(struct tcp_pcb *pcb, uint16_t len);
+err_t tcp_close(struct tcp_pcb *pcb);
+void tcp_abort(struct tcp_pcb *pcb);
+err_t tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *addr, uint16_t port, tcp_connected_fn connected);
+err_t tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *addr, uint16_t port);
+struct tcp_pcb *tcp_listen_with_backlog(struct tcp_pcb *pcb, uint8_t backlog);
+struct tcp_pcb *tcp_new_ip_type(uint8_t type);
+
+#define tcp_sndbuf(pcb)         ((pcb)->snd_buf)
+#define tcp_mss(pcb)            ((pcb)->mss)
+#define tcp_nagle_disable(pcb)  ((pcb)->flags |= 1)
+#define tcp_nagle_enable(pcb)   ((pcb)->flags &= ~1)
+#define tcp_nagle_disabled(pcb) (((pcb)->flags & 1) != 0)
+
+#define TCP_WND_MAX(pcb) ((uint16_t)TCP_WND)
+
+#define TCP_WRITE_FLAG_COPY 0x01
+#define TCP_WRITE_FLAG_MORE 0x02
+
+#endif // AsyncTCPSim_lwip_tcp_h
@@ -0,0 +1,9 @@
+#ifndef AsyncTCPSim_sdkconfig_h
+#define AsyncTCPSim_sdkconfig_h
+
+#ifndef CONFIG_LWIP_MAX_ACTIVE_TCP
+#define CONFIG_LWIP_MAX_ACTIVE_TCP 16
+#endif
+#define CONFIG_FREERTOS_NUMBER_OF_CORES 2
+
+#endif // AsyncTCPSim_sdkconfig_h
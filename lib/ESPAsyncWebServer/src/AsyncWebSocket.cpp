@@ -40,20 +40,17 @@ size_t webSocketSendFrameWindow(AsyncClient *client){
   return space - 8;
 }
 
-size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool mask, uint8_t *data, size_t len){
+//builds the header of a frame that fits the client's send buffer, cutting
+//len to the payload that fits. returns the header length, 0 if none fits
+static uint8_t webSocketFrameHeader(AsyncClient *client, uint8_t *buf, bool final, uint8_t opcode, bool mask, size_t &len){
   if(!client->canSend())
     return 0;
   size_t space = client->space();
   if(space < 2)
     return 0;
-  uint8_t mbuf[4] = {0,0,0,0};
   uint8_t headLen = 2;
   if(len && mask){
     headLen += 4;
-    mbuf[0] = rand() % 0xFF;
-    mbuf[1] = rand() % 0xFF;
-    mbuf[2] = rand() % 0xFF;
-    mbuf[3] = rand() % 0xFF;
   }
   if(len > 125)
     headLen += 2;
@@ -61,12 +58,10 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
     return 0;
   space -= headLen;
 
-  if(len > space) len = space;
-
-  uint8_t *buf = (uint8_t*)malloc(headLen);
-  if(buf == NULL){
-    //os_printf("could not malloc %u bytes for frame header\n", headLen);
-    return 0;
+  if(len > space){
+    len = space;
+    if(len < 126 && headLen > 2 + (mask ? 4 : 0))
+      headLen -= 2;
   }
 
   buf[0] = opcode & 0x0F;
@@ -81,21 +76,43 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
   }
   if(len && mask){
     buf[1] |= 0x80;
-    memcpy(buf + (headLen - 4), mbuf, 4);
+    uint8_t *mbuf = buf + (headLen - 4);
+    mbuf[0] = rand() % 0xFF;
+    mbuf[1] = rand() % 0xFF;
+    mbuf[2] = rand() % 0xFF;
+    mbuf[3] = rand() % 0xFF;
   }
+  return headLen;
+}
+
+size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool mask, uint8_t *data, size_t len){
+  uint8_t buf[8];
+  uint8_t headLen = webSocketFrameHeader(client, buf, final, opcode, mask, len);
+  if(!headLen)
+    return 0;
+
+  if(len && mask){
+    size_t i;
+    for(i=0;i<len;i++)
+      data[i] = data[i] ^ buf[headLen - 4 + i%4];
+  }
+#ifdef ESP32
+  //header and payload go to lwIP in one call
+  async_write_t parts[2] = {
+    { (const char *)buf, headLen, ASYNC_WRITE_FLAG_COPY, NULL },
+    { (const char *)data, len, ASYNC_WRITE_FLAG_COPY, NULL }
+  };
+  if(client->write(parts, 2) != headLen + len){
+    //os_printf("error sending frame: %lu\n", headLen+len);
+    return 0;
+  }
+#else
   if(client->add((const char *)buf, headLen) != headLen){
     //os_printf("error adding %lu header bytes\n", headLen);
-    free(buf);
     return 0;
   }
-  free(buf);
 
   if(len){
-    if(len && mask){
-      size_t i;
-      for(i=0;i<len;i++)
-        data[i] = data[i] ^ mbuf[i%4];
-    }
     if(client->add((const char *)data, len) != len){
       //os_printf("error adding %lu data bytes\n", len);
       return 0;
@@ -105,9 +122,30 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
     //os_printf("error sending frame: %lu\n", headLen+len);
     return 0;
   }
+#endif
   return len;
 }
 
+#ifdef ESP32
+//sends an unmasked frame with its payload taken from the buffer without
+//copying; the client holds the buffer until the payload is acked
+size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, AsyncTxBuffer *buffer, size_t offset, size_t len){
+  uint8_t buf[8];
+  uint8_t headLen = webSocketFrameHeader(client, buf, final, opcode, false, len);
+  if(!headLen)
+    return 0;
+
+  async_write_t parts[2] = {
+    { (const char *)buf, headLen, ASYNC_WRITE_FLAG_COPY, NULL },
+    { buffer->data() + offset, len, 0, buffer }
+  };
+  if(client->write(parts, 2) != headLen + len){
+    return 0;
+  }
+  return len;
+}
+#endif
+
 
 /*
  *    AsyncWebSocketMessageBuffer
@@ -380,6 +418,9 @@ AsyncWebSocketMultiMessage::AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuff
   ,_ack(0)
   ,_acked(0)
   ,_WSbuffer(nullptr)
+#ifdef ESP32
+  ,_txBuffer(nullptr)
+#endif
 {
 
   _opcode = opcode & 0x07;
@@ -390,6 +431,11 @@ AsyncWebSocketMultiMessage::AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuff
     (*_WSbuffer)++; 
     _data = buffer->get(); 
     _len = buffer->length(); 
+#ifdef ESP32
+    //the payload goes to lwIP without copying, so the buffer is held until
+    //the client has it acked, which may be after this message is gone
+    _txBuffer = new AsyncTxBuffer((const char *)_data, _len, [](void *b, const char *data){ (void)data; (*(AsyncWebSocketMessageBuffer *)b)--; }, _WSbuffer);
+#endif
     _status = WS_MSG_SENDING;
     //ets_printf("M: %u\n", _len);
   } else {
@@ -400,9 +446,15 @@ AsyncWebSocketMultiMessage::AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuff
 
 
 AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
+#ifdef ESP32
+  if (_txBuffer) {
+    _txBuffer->unref(); // decreases the counter once the client acked the payload
+  }
+#else
   if (_WSbuffer) {
     (*_WSbuffer)--; // decreases the counter. 
   }
+#endif
 }
 
  void AsyncWebSocketMultiMessage::ack(size_t len, uint32_t time)  {
@@ -445,7 +497,11 @@ AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
   uint8_t* dPtr = (uint8_t*)(_data + (_sent - toSend));
   uint8_t opCode = (toSend && _sent == toSend)?_opcode:(uint8_t)WS_CONTINUATION;
 
+#ifdef ESP32
+  size_t sent = _mask ? webSocketSendFrame(client, final, opCode, _mask, dPtr, toSend) : webSocketSendFrame(client, final, opCode, _txBuffer, _sent - toSend, toSend);
+#else
   size_t sent = webSocketSendFrame(client, final, opCode, _mask, dPtr, toSend);
+#endif
   _status = WS_MSG_SENDING;
   if(toSend && sent != toSend){
       //ets_printf("E: %u != %u\n", toSend, sent);
@@ -473,6 +529,7 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
   _clientId = _server->_getNextId();
   _status = WS_CONNECTED;
   _pstate = 0;
+  _phlen = 0;
   _lastMessageTime = millis();
   _keepAlivePeriod = 0;
   _client->setRxTimeout(0);
@@ -480,7 +537,12 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
   _client->onAck([](void *r, AsyncClient* c, size_t len, uint32_t time){ (void)c; ((AsyncWebSocketClient*)(r))->_onAck(len, time); }, this);
   _client->onDisconnect([](void *r, AsyncClient* c){ ((AsyncWebSocketClient*)(r))->_onDisconnect(); delete c; }, this);
   _client->onTimeout([](void *r, AsyncClient* c, uint32_t time){ (void)c; ((AsyncWebSocketClient*)(r))->_onTimeout(time); }, this);
+#ifdef ESP32
+  //frames are parsed in the received segment, which is acked after that
+  _client->onPacket([](void *r, AsyncClient* c, struct pbuf *pb){ if(((AsyncWebSocketClient*)(r))->_onData(pb->payload, pb->len)) c->ackPacket(pb); else pbuf_free(pb); }, this);
+#else
   _client->onData([](void *r, AsyncClient* c, void *buf, size_t len){ (void)c; ((AsyncWebSocketClient*)(r))->_onData(buf, len); }, this);
+#endif
   _client->onPoll([](void *r, AsyncClient* c){ (void)c; ((AsyncWebSocketClient*)(r))->_onPoll(); }, this);
   _server->_addClient(this);
   _server->_handleEvent(this, WS_EVT_CONNECT, request, NULL, 0);
@@ -607,33 +669,56 @@ void AsyncWebSocketClient::_onDisconnect(){
   _server->_handleDisconnect(this);
 }
 
-void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
+//length of a frame header, from its first two bytes
+static size_t webSocketHeaderLength(const uint8_t *fdata){
+  uint8_t len = fdata[1] & 0x7F;
+  return 2 + (len == 126 ? 2 : len == 127 ? 8 : 0) + ((fdata[1] & 0x80) ? 4 : 0);
+}
+
+bool AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
   _lastMessageTime = millis();
   uint8_t *data = (uint8_t*)pbuf;
   while(plen > 0){
     if(!_pstate){
+      //the header is read where it was received, one split over
+      //segments is collected in _phdr first
       const uint8_t *fdata = data;
+      if(_phlen || plen < 2 || plen < webSocketHeaderLength(data)){
+        while(plen > 0 && (_phlen < 2 || _phlen < webSocketHeaderLength(_phdr))){
+          _phdr[_phlen++] = *data++;
+          plen--;
+        }
+        if(_phlen < 2 || _phlen < webSocketHeaderLength(_phdr))
+          return true;
+        fdata = _phdr;
+        _phlen = 0;
+      } else {
+        const size_t hlen = webSocketHeaderLength(data);
+        data += hlen;
+        plen -= hlen;
+      }
       _pinfo.index = 0;
       _pinfo.final = (fdata[0] & 0x80) != 0;
       _pinfo.opcode = fdata[0] & 0x0F;
       _pinfo.masked = (fdata[1] & 0x80) != 0;
       _pinfo.len = fdata[1] & 0x7F;
-      data += 2;
-      plen -= 2;
+      fdata += 2;
       if(_pinfo.len == 126){
-        _pinfo.len = fdata[3] | (uint16_t)(fdata[2]) << 8;
-        data += 2;
-        plen -= 2;
+        _pinfo.len = fdata[1] | (uint16_t)(fdata[0]) << 8;
+        fdata += 2;
       } else if(_pinfo.len == 127){
-        _pinfo.len = fdata[9] | (uint16_t)(fdata[8]) << 8 | (uint32_t)(fdata[7]) << 16 | (uint32_t)(fdata[6]) << 24 | (uint64_t)(fdata[5]) << 32 | (uint64_t)(fdata[4]) << 40 | (uint64_t)(fdata[3]) << 48 | (uint64_t)(fdata[2]) << 56;
-        data += 8;
-        plen -= 8;
+        _pinfo.len = fdata[7] | (uint16_t)(fdata[6]) << 8 | (uint32_t)(fdata[5]) << 16 | (uint32_t)(fdata[4]) << 24 | (uint64_t)(fdata[3]) << 32 | (uint64_t)(fdata[2]) << 40 | (uint64_t)(fdata[1]) << 48 | (uint64_t)(fdata[0]) << 56;
+        fdata += 8;
       }
 
       if(_pinfo.masked){
-        memcpy(_pinfo.mask, data, 4);
-        data += 4;
-        plen -= 4;
+        memcpy(_pinfo.mask, fdata, 4);
+      }
+
+      //the payload starts in the next segment
+      if(!plen && _pinfo.len){
+        _pstate = 1;
+        return true;
       }
     }
 
@@ -669,10 +754,15 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
         }
         if(_status == WS_DISCONNECTING){
           _status = WS_DISCONNECTED;
+          //closing deletes the client and this with it
           _client->close(true);
+          return false;
         } else {
           _status = WS_DISCONNECTING;
+#ifndef ESP32
+          //onPacket acks every segment on ESP32
           _client->ackLater();
+#endif
           _queueControl(new AsyncWebSocketControl(WS_DISCONNECT, data, datalen));
         }
       } else if(_pinfo.opcode == WS_PING){
@@ -696,6 +786,7 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
     data += datalen;
     plen -= datalen;
   }
+  return true;
 }
 
 size_t AsyncWebSocketClient::printf(const char *format, ...) {
@@ -94,15 +94,17 @@ class AsyncWebSocketMessageBuffer {
     AsyncWebSocketMessageBuffer(const AsyncWebSocketMessageBuffer &); 
     AsyncWebSocketMessageBuffer(AsyncWebSocketMessageBuffer &&); 
     ~AsyncWebSocketMessageBuffer(); 
-    void operator ++(int i) { (void)i; _count++; }
-    void operator --(int i) { (void)i; if (_count > 0) { _count--; } ;  }
+    //messages count their buffer on the loop task, the free handler of the
+    //AsyncTxBuffer sending it uncounts it on the lwIP thread or an async task
+    void operator ++(int i) { (void)i; __atomic_fetch_add(&_count, 1, __ATOMIC_RELAXED); }
+    void operator --(int i) { (void)i; uint32_t c = __atomic_load_n(&_count, __ATOMIC_RELAXED); while (c > 0 && !__atomic_compare_exchange_n(&_count, &c, c - 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)); }
     bool reserve(size_t size);
     void lock() { _lock = true; }
     void unlock() { _lock = false; }
     uint8_t * get() { return _data; }
     size_t length() { return _len; }
-    uint32_t count() { return _count; }
-    bool canDelete() { return (!_count && !_lock); } 
+    uint32_t count() { return __atomic_load_n(&_count, __ATOMIC_ACQUIRE); }
+    bool canDelete() { return (!count() && !_lock); } 
 
     friend AsyncWebSocket; 
 
@@ -146,6 +148,9 @@ class AsyncWebSocketMultiMessage: public AsyncWebSocketMessage {
     size_t _ack;
     size_t _acked;
     AsyncWebSocketMessageBuffer * _WSbuffer; 
+#ifdef ESP32
+    AsyncTxBuffer * _txBuffer; 
+#endif
 public:
     AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuffer * buffer, uint8_t opcode=WS_TEXT, bool mask=false); 
     virtual ~AsyncWebSocketMultiMessage() override;
@@ -166,6 +171,8 @@ class AsyncWebSocketClient {
 
     uint8_t _pstate;
     AwsFrameInfo _pinfo;
+    uint8_t _phdr[14]; //frame header split over received segments
+    uint8_t _phlen;
 
     uint32_t _lastMessageTime;
     uint32_t _keepAlivePeriod;
@@ -234,7 +241,7 @@ class AsyncWebSocketClient {
     void _onPoll();
     void _onTimeout(uint32_t time);
     void _onDisconnect();
-    void _onData(void *pbuf, size_t plen);
+    bool _onData(void *pbuf, size_t plen); //false if the client was closed and deleted
 };
 
 typedef std::function<void(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len)> AwsEventHandler;
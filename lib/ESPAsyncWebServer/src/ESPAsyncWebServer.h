@@ -178,20 +178,23 @@ class AsyncWebServerRequest {
     uint8_t *_itemBuffer;
     size_t _itemBufferIndex;
     bool _itemIsFile;
+    bool *_deleted;         //set while _onData() runs, the destructor sets it
+    bool *_clientClosed;    //set while _onData() runs, _onDisconnect() sets it
 
     void _onPoll();
     void _onAck(size_t len, uint32_t time);
     void _onError(int8_t error);
     void _onTimeout(uint32_t time);
     void _onDisconnect();
-    void _onData(void *buf, size_t len);
+    bool _onData(void *buf, size_t len); //false if the client was closed and deleted
 
     void _addParam(AsyncWebParameter*);
     void _addPathParam(const char *param);
 
-    bool _parseReqHead();
-    bool _parseReqHeader();
-    void _parseLine();
+    //a line of the head, NUL terminated and trimmed, which these split in place
+    bool _parseReqHead(char *line);
+    bool _parseReqHeader(char *line);
+    void _parseLine(char *line, size_t len);
     void _parsePlainPostChar(uint8_t data);
     void _parseMultipartPostByte(uint8_t data, bool last);
     void _addGetParams(const String& params);
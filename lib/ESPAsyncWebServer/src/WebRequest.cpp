@@ -67,17 +67,28 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   , _itemBuffer(0)
   , _itemBufferIndex(0)
   , _itemIsFile(false)
+  , _deleted(NULL)
+  , _clientClosed(NULL)
   , _tempObject(NULL)
 {
   c->onError([](void *r, AsyncClient* c, int8_t error){ (void)c; AsyncWebServerRequest *req = (AsyncWebServerRequest*)r; req->_onError(error); }, this);
   c->onAck([](void *r, AsyncClient* c, size_t len, uint32_t time){ (void)c; AsyncWebServerRequest *req = (AsyncWebServerRequest*)r; req->_onAck(len, time); }, this);
   c->onDisconnect([](void *r, AsyncClient* c){ AsyncWebServerRequest *req = (AsyncWebServerRequest*)r; req->_onDisconnect(); delete c; }, this);
   c->onTimeout([](void *r, AsyncClient* c, uint32_t time){ (void)c; AsyncWebServerRequest *req = (AsyncWebServerRequest*)r; req->_onTimeout(time); }, this);
+#ifdef ESP32
+  //the request is parsed in the received segment, which is acked after that.
+  //the request may be gone by then, upgraded to a WebSocket, or the client
+  //closed and deleted, then the segment is only freed
+  c->onPacket([](void *r, AsyncClient* c, struct pbuf *pb){ AsyncWebServerRequest *req = (AsyncWebServerRequest*)r; if(req->_onData(pb->payload, pb->len)) c->ackPacket(pb); else pbuf_free(pb); }, this);
+#else
   c->onData([](void *r, AsyncClient* c, void *buf, size_t len){ (void)c; AsyncWebServerRequest *req = (AsyncWebServerRequest*)r; req->_onData(buf, len); }, this);
+#endif
   c->onPoll([](void *r, AsyncClient* c){ (void)c; AsyncWebServerRequest *req = ( AsyncWebServerRequest*)r; req->_onPoll(); }, this);
 }
 
 AsyncWebServerRequest::~AsyncWebServerRequest(){
+  if(_deleted) *_deleted = true;
+
   _headers.free();
 
   _params.free();
@@ -98,29 +109,47 @@ AsyncWebServerRequest::~AsyncWebServerRequest(){
   }
 }
 
-void AsyncWebServerRequest::_onData(void *buf, size_t len){
+//takes the whitespace off both ends of a NUL terminated line, in place
+static char *trimLine(char *line, size_t &len){
+  while(len && isspace((unsigned char)line[len-1])) line[--len] = 0;
+  while(len && isspace((unsigned char)*line)){ line++; len--; }
+  return line;
+}
+
+bool AsyncWebServerRequest::_onData(void *buf, size_t len){
+  //a handler may close the connection, which deletes this request and the
+  //client, or upgrade it to a WebSocket, which deletes only this request.
+  //either way nothing of this may be touched after it returns
+  bool deleted = false;
+  bool closed = false;
+  _deleted = &deleted;
+  _clientClosed = &closed;
   size_t i = 0;
   while (true) {
 
   if(_parseState < PARSE_REQ_BODY){
     // Find new line in buf
     char *str = (char*)buf;
-    for (i = 0; i < len; i++) {
-      if (str[i] == '\n') {
-        break;
-      }
-    }
-    if (i == len) { // No new line, just add the buffer in _temp
+    char *eol = (char*)memchr(str, '\n', len);
+    if (!eol) { // No new line, keep the start of the line in _temp
       char ch = str[len-1];
       str[len-1] = 0;
-      _temp.reserve(_temp.length()+len);
       _temp.concat(str);
       _temp.concat(ch);
-    } else { // Found new line - extract it and parse
+    } else { // Found new line - parse it where it was received
+      i = eol - str;
       str[i] = 0; // Terminate the string at the end of the line.
-      _temp.concat(str);
-      _temp.trim();
-      _parseLine();
+      char *line = str;
+      size_t lineLen = i;
+      if (_temp.length()) { // The line started in an earlier segment
+        _temp.concat(str);
+        line = _temp.begin();
+        lineLen = _temp.length();
+      }
+      line = trimLine(line, lineLen);
+      _parseLine(line, lineLen);
+      if(deleted) return !closed;
+      _temp = String();
       if (++i < len) {
         // Still have more buffer to process
         buf = str+i;
@@ -137,6 +166,7 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
         size_t i;
         for(i=0; i<len; i++){
           _parseMultipartPostByte(((uint8_t*)buf)[i], i == len - 1);
+          if(deleted) return !closed;
           _parsedLength++;
         }
       } else
@@ -156,6 +186,7 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
       if(!_isPlainPost) {
         //check if authenticated before calling the body
         if(_handler) _handler->handleBody(this, (uint8_t*)buf, len, _parsedLength, _contentLength);
+        if(deleted) return !closed;
         _parsedLength += len;
       } else if(needParse) {
         size_t i;
@@ -172,10 +203,14 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
       //check if authenticated before calling handleRequest and request auth instead
       if(_handler) _handler->handleRequest(this);
       else send(501);
+      if(deleted) return !closed;
     }
   }
   break;
   }
+  _deleted = NULL;
+  _clientClosed = NULL;
+  return true;
 }
 
 void AsyncWebServerRequest::_removeNotInterestingHeaders(){
@@ -223,6 +258,7 @@ void AsyncWebServerRequest::onDisconnect (ArDisconnectHandler fn){
 
 void AsyncWebServerRequest::_onDisconnect(){
   //os_printf("d\n");
+  if(_clientClosed) *_clientClosed = true;
   if(_onDisconnectfn) {
       _onDisconnectfn();
     }
@@ -251,43 +287,44 @@ void AsyncWebServerRequest::_addGetParams(const String& params){
   }
 }
 
-bool AsyncWebServerRequest::_parseReqHead(){
-  // Split the head into method, url and version
-  int index = _temp.indexOf(' ');
-  String m = _temp.substring(0, index);
-  index = _temp.indexOf(' ', index+1);
-  String u = _temp.substring(m.length()+1, index);
-  _temp = _temp.substring(index+1);
+bool AsyncWebServerRequest::_parseReqHead(char *line){
+  // Split the head into method, url and version, in place
+  const char *m = line;
+  char *u = strchr(line, ' ');
+  if(u) *u++ = 0;
+  else u = line + strlen(line);
+  char *version = strchr(u, ' ');
+  if(version) *version++ = 0;
+  else version = u + strlen(u);
 
-  if(m == "GET"){
+  if(!strcmp(m, "GET")){
     _method = HTTP_GET;
-  } else if(m == "POST"){
+  } else if(!strcmp(m, "POST")){
     _method = HTTP_POST;
-  } else if(m == "DELETE"){
+  } else if(!strcmp(m, "DELETE")){
     _method = HTTP_DELETE;
-  } else if(m == "PUT"){
+  } else if(!strcmp(m, "PUT")){
     _method = HTTP_PUT;
-  } else if(m == "PATCH"){
+  } else if(!strcmp(m, "PATCH")){
     _method = HTTP_PATCH;
-  } else if(m == "HEAD"){
+  } else if(!strcmp(m, "HEAD")){
     _method = HTTP_HEAD;
-  } else if(m == "OPTIONS"){
+  } else if(!strcmp(m, "OPTIONS")){
     _method = HTTP_OPTIONS;
   }
 
   String g = String();
-  index = u.indexOf('?');
-  if(index > 0){
-    g = u.substring(index +1);
-    u = u.substring(0, index);
+  char *query = strchr(u, '?');
+  if(query && query != u){
+    *query = 0;
+    g = query + 1;
   }
   _url = urlDecode(u);
   _addGetParams(g);
 
-  if(!_temp.startsWith("HTTP/1.0"))
+  if(strncmp(version, "HTTP/1.0", 8))
     _version = 1;
 
-  _temp = String();
   return true;
 }
 
@@ -309,11 +346,16 @@ bool strContains(String src, String find, bool mindcase = true) {
   return false;
 }
 
-bool AsyncWebServerRequest::_parseReqHeader(){
-  int index = _temp.indexOf(':');
-  if(index){
-    String name = _temp.substring(0, index);
-    String value = _temp.substring(index + 2);
+bool AsyncWebServerRequest::_parseReqHeader(char *line){
+  char *colon = strchr(line, ':');
+  if(colon != line){
+    const char *v = "";
+    if(colon){
+      *colon = 0;
+      if(colon[1]) v = colon + 2;
+    }
+    String name = line;
+    String value = v;
     if(name.equalsIgnoreCase("Host")){
       _host = value;
     } else if(name.equalsIgnoreCase("Content-Type")){
@@ -347,7 +389,6 @@ bool AsyncWebServerRequest::_parseReqHeader(){
     }
     _headers.add(new AsyncWebHeader(name, value));
   }
-  _temp = String();
   return true;
 }
 
@@ -551,20 +592,20 @@ void AsyncWebServerRequest::_parseMultipartPostByte(uint8_t data, bool last){
   }
 }
 
-void AsyncWebServerRequest::_parseLine(){
+void AsyncWebServerRequest::_parseLine(char *line, size_t len){
   if(_parseState == PARSE_REQ_START){
-    if(!_temp.length()){
+    if(!len){
       _parseState = PARSE_REQ_FAIL;
       _client->close();
     } else {
-      _parseReqHead();
+      _parseReqHead(line);
       _parseState = PARSE_REQ_HEADERS;
     }
     return;
   }
 
   if(_parseState == PARSE_REQ_HEADERS){
-    if(!_temp.length()){
+    if(!len){
       //end of headers
       _server->_rewriteRequest(this);
       _server->_attachHandler(this);
@@ -581,7 +622,7 @@ void AsyncWebServerRequest::_parseLine(){
         if(_handler) _handler->handleRequest(this);
         else send(501);
       }
-    } else _parseReqHeader();
+    } else _parseReqHeader(line);
   }
 }
 
@@ -141,11 +141,13 @@ sample code bearing this copyright.
 
 #include <Arduino.h>
 #include "OneWire.h"
+#include "OneWireCRC.h"
 #include "util/OneWire_direct_gpio.h"
 
 
 void OneWire::begin(uint8_t pin)
 {
+	transport = nullptr;
 	pinMode(pin, INPUT);
 	bitmask = PIN_TO_BITMASK(pin);
 	baseReg = PIN_TO_BASEREG(pin);
@@ -154,6 +156,14 @@ void OneWire::begin(uint8_t pin)
 #endif
 }
 
+void OneWire::begin(OneWireTransport *t)
+{
+	transport = t;
+#if ONEWIRE_SEARCH
+	reset_search();
+#endif
+}
+
 
 // Perform the onewire reset function.  We will wait up to 250uS for
 // the bus to come high, if it doesn't then it is broken or shorted
@@ -168,6 +178,8 @@ uint8_t OneWire::reset(void)
 	uint8_t r;
 	uint8_t retries = 125;
 
+	if (transport) return transport->reset();
+
 	noInterrupts();
 	DIRECT_MODE_INPUT(reg, mask);
 	interrupts();
@@ -192,14 +204,12 @@ uint8_t OneWire::reset(void)
 }
 
 //
-// Write a bit. Port and bit is used to cut lookup time and provide
-// more certain timing.
+// Single time slots on an already resolved port and bit.  Shared by the
+// bit functions and transaction() so the slot timing lives in one place.
 //
-void OneWire::write_bit(uint8_t v)
+static inline __attribute__((always_inline))
+void write_slot(__attribute__((unused)) volatile IO_REG_TYPE *reg, IO_REG_TYPE mask, uint8_t v)
 {
-	IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
-	__attribute__((unused)) volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
-
 	if (v & 1) {
 		noInterrupts();
 		DIRECT_WRITE_LOW(reg, mask);
@@ -219,14 +229,9 @@ void OneWire::write_bit(uint8_t v)
 	}
 }
 
-//
-// Read a bit. Port and bit is used to cut lookup time and provide
-// more certain timing.
-//
-uint8_t OneWire::read_bit(void)
+static inline __attribute__((always_inline))
+uint8_t read_slot(__attribute__((unused)) volatile IO_REG_TYPE *reg, IO_REG_TYPE mask)
 {
-	IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
-	__attribute__((unused)) volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
 	uint8_t r;
 
 	noInterrupts();
@@ -241,6 +246,35 @@ uint8_t OneWire::read_bit(void)
 	return r;
 }
 
+//
+// Write a bit. Port and bit is used to cut lookup time and provide
+// more certain timing.
+//
+void OneWire::write_bit(uint8_t v)
+{
+	IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
+	__attribute__((unused)) volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
+
+	if (transport) {
+		transport->write_bit(v);
+		return;
+	}
+	write_slot(reg, mask, v);
+}
+
+//
+// Read a bit. Port and bit is used to cut lookup time and provide
+// more certain timing.
+//
+uint8_t OneWire::read_bit(void)
+{
+	IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
+	__attribute__((unused)) volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
+
+	if (transport) return transport->read_bit();
+	return read_slot(reg, mask);
+}
+
 //
 // Write a byte. The writing code uses the active drivers to raise the
 // pin high, if you need power after the write (e.g. DS18S20 in
@@ -251,6 +285,11 @@ uint8_t OneWire::read_bit(void)
 void OneWire::write(uint8_t v, uint8_t power /* = 0 */) {
     uint8_t bitMask;
 
+    if (transport) {
+	transport->write(v, power);
+	return;
+    }
+
     for (bitMask = 0x01; bitMask; bitMask <<= 1) {
 	OneWire::write_bit( (bitMask & v)?1:0);
     }
@@ -265,7 +304,9 @@ void OneWire::write(uint8_t v, uint8_t power /* = 0 */) {
 void OneWire::write_bytes(const uint8_t *buf, uint16_t count, bool power /* = 0 */) {
   for (uint16_t i = 0 ; i < count ; i++)
     write(buf[i]);
-  if (!power) {
+  if (transport) {
+    if (!power) transport->depower();
+  } else if (!power) {
     noInterrupts();
     DIRECT_MODE_INPUT(baseReg, bitmask);
     DIRECT_WRITE_LOW(baseReg, bitmask);
@@ -280,6 +321,8 @@ uint8_t OneWire::read() {
     uint8_t bitMask;
     uint8_t r = 0;
 
+    if (transport) return transport->read();
+
     for (bitMask = 0x01; bitMask; bitMask <<= 1) {
 	if ( OneWire::read_bit()) r |= bitMask;
     }
@@ -313,11 +356,127 @@ void OneWire::skip()
 
 void OneWire::depower()
 {
+	if (transport) {
+		transport->depower();
+		return;
+	}
 	noInterrupts();
 	DIRECT_MODE_INPUT(baseReg, bitmask);
 	interrupts();
 }
 
+//
+// Run a planned transaction.  The ROM and command phases are assembled
+// into one buffer first, then clocked out and read back with the port
+// and bit resolved once for the whole exchange.
+//
+uint8_t OneWire::transaction(const OneWireTransaction &txn)
+{
+	IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
+	__attribute__((unused)) volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
+	uint8_t plan[9 + ONEWIRE_TXN_MAX_COMMAND];
+	uint8_t len = 0;
+	uint8_t i, bitMask;
+
+	if (transport) return transport->transaction(txn);
+
+	if (txn.commandLen > ONEWIRE_TXN_MAX_COMMAND) return ONEWIRE_TXN_INVALID;
+	if (txn.readLen && !txn.readBuf) return ONEWIRE_TXN_INVALID;
+
+	if (txn.rom) {
+		plan[len++] = 0x55;	// Choose ROM
+		for (i = 0; i < 8; i++) plan[len++] = txn.rom[i];
+	} else {
+		plan[len++] = 0xCC;	// Skip ROM
+	}
+	for (i = 0; i < txn.commandLen; i++) plan[len++] = txn.command[i];
+
+	if ((txn.flags & ONEWIRE_TXN_RESET) && !reset()) return ONEWIRE_TXN_NO_PRESENCE;
+
+	for (i = 0; i < len; i++) {
+		for (bitMask = 0x01; bitMask; bitMask <<= 1) {
+			write_slot(reg, mask, (plan[i] & bitMask) ? 1 : 0);
+		}
+	}
+	if (!txn.readLen && !(txn.flags & ONEWIRE_TXN_POWER)) {
+		noInterrupts();
+		DIRECT_MODE_INPUT(reg, mask);
+		DIRECT_WRITE_LOW(reg, mask);
+		interrupts();
+	}
+
+	for (i = 0; i < txn.readLen; i++) {
+		uint8_t r = 0;
+		for (bitMask = 0x01; bitMask; bitMask <<= 1) {
+			if (read_slot(reg, mask)) r |= bitMask;
+		}
+		txn.readBuf[i] = r;
+	}
+
+	if ((txn.flags & ONEWIRE_TXN_RESET_AFTER) && !reset()) return ONEWIRE_TXN_NO_PRESENCE;
+
+#if ONEWIRE_CRC
+	if ((txn.flags & ONEWIRE_TXN_CHECK_CRC8) && txn.readLen &&
+	    crc8(txn.readBuf, txn.readLen - 1) != txn.readBuf[txn.readLen - 1]) {
+		return ONEWIRE_TXN_CRC_ERROR;
+	}
+#endif
+	return ONEWIRE_TXN_OK;
+}
+
+//
+// Transport defaults: bytes and transactions built from the bit slots,
+// with the same bit order and depower rules as the GPIO code above.
+//
+void OneWireTransport::write(uint8_t v, uint8_t power)
+{
+	for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
+		write_bit((bitMask & v) ? 1 : 0);
+	}
+	if (!power) depower();
+}
+
+uint8_t OneWireTransport::read(void)
+{
+	uint8_t r = 0;
+
+	for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
+		if (read_bit()) r |= bitMask;
+	}
+	return r;
+}
+
+uint8_t OneWireTransport::transaction(const OneWireTransaction &txn)
+{
+	uint8_t i;
+
+	if (txn.commandLen > ONEWIRE_TXN_MAX_COMMAND) return ONEWIRE_TXN_INVALID;
+	if (txn.readLen && !txn.readBuf) return ONEWIRE_TXN_INVALID;
+
+	if ((txn.flags & ONEWIRE_TXN_RESET) && !reset()) return ONEWIRE_TXN_NO_PRESENCE;
+
+	if (txn.rom) {
+		write(0x55, 1);	// Choose ROM
+		for (i = 0; i < 8; i++) write(txn.rom[i], 1);
+	} else {
+		write(0xCC, 1);	// Skip ROM
+	}
+	for (i = 0; i < txn.commandLen; i++) write(txn.command[i], 1);
+	if (!txn.readLen && !(txn.flags & ONEWIRE_TXN_POWER)) depower();
+
+	for (i = 0; i < txn.readLen; i++) txn.readBuf[i] = read();
+
+	if ((txn.flags & ONEWIRE_TXN_RESET_AFTER) && !reset()) return ONEWIRE_TXN_NO_PRESENCE;
+
+#if ONEWIRE_CRC
+	if ((txn.flags & ONEWIRE_TXN_CHECK_CRC8) && txn.readLen &&
+	    OneWire::crc8(txn.readBuf, txn.readLen - 1) != txn.readBuf[txn.readLen - 1]) {
+		return ONEWIRE_TXN_CRC_ERROR;
+	}
+#endif
+	return ONEWIRE_TXN_OK;
+}
+
 #if ONEWIRE_SEARCH
 
 //
@@ -482,63 +641,52 @@ bool OneWire::search(uint8_t *newAddr, bool search_mode /* = true */)
    return search_result;
   }
 
-#endif
 
-#if ONEWIRE_CRC
-// The 1-Wire CRC scheme is described in Maxim Application Note 27:
-// "Understanding and Using Cyclic Redundancy Checks with Maxim iButton Products"
 //
-
-#if ONEWIRE_CRC8_TABLE
-// Dow-CRC using polynomial X^8 + X^5 + X^4 + X^0
-// Tiny 2x16 entry CRC table created by Arjen Lentz
-// See http://lentz.com.au/blog/calculating-crc-with-a-tiny-32-entry-lookup-table
-static const uint8_t PROGMEM dscrc2x16_table[] = {
-	0x00, 0x5E, 0xBC, 0xE2, 0x61, 0x3F, 0xDD, 0x83,
-	0xC2, 0x9C, 0x7E, 0x20, 0xA3, 0xFD, 0x1F, 0x41,
-	0x00, 0x9D, 0x23, 0xBE, 0x46, 0xDB, 0x65, 0xF8,
-	0x8C, 0x11, 0xAF, 0x32, 0xCA, 0x57, 0xE9, 0x74
-};
-
-// Compute a Dallas Semiconductor 8 bit CRC. These show up in the ROM
-// and the registers.  (Use tiny 2x16 entry CRC table)
-uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+// Verify that a device is present.  Following the 1-Wire search
+// algorithm's verify operation: seed the search state with the ROM and
+// LastDiscrepancy = 64 so every discrepancy follows the ROM's bits, then
+// compare what the search returns.  The caller's search state is
+// restored afterwards.
+//
+bool OneWire::verify(const uint8_t rom[8])
 {
-	uint8_t crc = 0;
+   unsigned char saved_rom[8];
+   uint8_t saved_last_discrepancy = LastDiscrepancy;
+   uint8_t saved_last_family_discrepancy = LastFamilyDiscrepancy;
+   bool saved_last_device_flag = LastDeviceFlag;
+   uint8_t found[8];
+   bool result;
+
+   for (uint8_t i = 0; i < 8; i++) {
+      saved_rom[i] = ROM_NO[i];
+      ROM_NO[i] = rom[i];
+   }
+   LastDiscrepancy = 64;
+   LastFamilyDiscrepancy = 0;
+   LastDeviceFlag = false;
 
-	while (len--) {
-		crc = *addr++ ^ crc;  // just re-using crc as intermediate
-		crc = pgm_read_byte(dscrc2x16_table + (crc & 0x0f)) ^
-		pgm_read_byte(dscrc2x16_table + 16 + ((crc >> 4) & 0x0f));
-	}
+   result = search(found) && memcmp(found, rom, 8) == 0;
 
-	return crc;
+   for (uint8_t i = 0; i < 8; i++) ROM_NO[i] = saved_rom[i];
+   LastDiscrepancy = saved_last_discrepancy;
+   LastFamilyDiscrepancy = saved_last_family_discrepancy;
+   LastDeviceFlag = saved_last_device_flag;
+   return result;
 }
-#else
-//
-// Compute a Dallas Semiconductor 8 bit CRC directly.
-// this is much slower, but a little smaller, than the lookup table.
-//
+
+#endif
+
+#if ONEWIRE_CRC
+// The kernels live in OneWireCRC.cpp; ONEWIRE_CRC8_KERNEL and
+// ONEWIRE_CRC16_KERNEL pick the ones used here.
+
+// Compute a Dallas Semiconductor 8 bit CRC. These show up in the ROM
+// and the registers.
 uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
 {
-	uint8_t crc = 0;
-
-	while (len--) {
-#if defined(__AVR__)
-		crc = _crc_ibutton_update(crc, *addr++);
-#else
-		uint8_t inbyte = *addr++;
-		for (uint8_t i = 8; i; i--) {
-			uint8_t mix = (crc ^ inbyte) & 0x01;
-			crc >>= 1;
-			if (mix) crc ^= 0x8C;
-			inbyte >>= 1;
-		}
-#endif
-	}
-	return crc;
+	return OneWireCRC::crc8(addr, len);
 }
-#endif
 
 #if ONEWIRE_CRC16
 bool OneWire::check_crc16(const uint8_t* input, uint16_t len, const uint8_t* inverted_crc, uint16_t crc)
@@ -549,31 +697,7 @@ bool OneWire::check_crc16(const uint8_t* input, uint16_t len, const uint8_t* inv
 
 uint16_t OneWire::crc16(const uint8_t* input, uint16_t len, uint16_t crc)
 {
-#if defined(__AVR__)
-    for (uint16_t i = 0 ; i < len ; i++) {
-        crc = _crc16_update(crc, input[i]);
-    }
-#else
-    static const uint8_t oddparity[16] =
-        { 0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0 };
-
-    for (uint16_t i = 0 ; i < len ; i++) {
-      // Even though we're just copying a byte from the input,
-      // we'll be doing 16-bit computation with it.
-      uint16_t cdata = input[i];
-      cdata = (cdata ^ crc) & 0xff;
-      crc >>= 8;
-
-      if (oddparity[cdata & 0x0F] ^ oddparity[cdata >> 4])
-          crc ^= 0xC001;
-
-      cdata <<= 6;
-      crc ^= cdata;
-      cdata <<= 1;
-      crc ^= cdata;
-    }
-#endif
-    return crc;
+    return OneWireCRC::crc16(input, len, crc);
 }
 #endif
 
@@ -51,14 +51,88 @@
 #define ONEWIRE_CRC16 1
 #endif
 
+// CRC kernels, see OneWireCRC.h
+#define ONEWIRE_CRC_BITWISE 0  // no table, a shift loop per bit
+#define ONEWIRE_CRC_NIBBLE  1  // two 16 entry tables
+#define ONEWIRE_CRC_TABLE   2  // one 256 entry table
+#define ONEWIRE_CRC_SLICE4  3  // four 256 entry tables, 4 bytes per step
+
+// Kernel behind crc8().  By default ONEWIRE_CRC8_TABLE picks the nibble
+// table (1) or the bitwise loop (0), as it always did.
+#ifndef ONEWIRE_CRC8_KERNEL
+#if ONEWIRE_CRC8_TABLE
+#define ONEWIRE_CRC8_KERNEL ONEWIRE_CRC_NIBBLE
+#else
+#define ONEWIRE_CRC8_KERNEL ONEWIRE_CRC_BITWISE
+#endif
+#endif
+
+// Kernel behind crc16()
+#ifndef ONEWIRE_CRC16_KERNEL
+#define ONEWIRE_CRC16_KERNEL ONEWIRE_CRC_BITWISE
+#endif
+
+// Longest command phase accepted by OneWire::transaction().  The whole
+// write phase (ROM select plus command) is planned into a stack buffer
+// of 9 + ONEWIRE_TXN_MAX_COMMAND bytes.
+#ifndef ONEWIRE_TXN_MAX_COMMAND
+#define ONEWIRE_TXN_MAX_COMMAND 8
+#endif
+
+// Flags for OneWireTransaction::flags
+#define ONEWIRE_TXN_RESET       0x01  // reset and require presence first
+#define ONEWIRE_TXN_RESET_AFTER 0x02  // reset once the read phase is done
+#define ONEWIRE_TXN_CHECK_CRC8  0x04  // last byte read is the CRC8 of the others
+#define ONEWIRE_TXN_POWER       0x08  // leave the bus powered after writing
+
+// Result codes returned by OneWire::transaction()
+#define ONEWIRE_TXN_OK          0
+#define ONEWIRE_TXN_NO_PRESENCE 1
+#define ONEWIRE_TXN_CRC_ERROR   2
+#define ONEWIRE_TXN_INVALID     3
+
 // Board-specific macros for direct GPIO
 #include "util/OneWire_direct_regtype.h"
 
+// Describes one complete bus exchange: an optional reset, a ROM select
+// (or skip ROM when rom is null), the command bytes and a read phase.
+// See OneWire::transaction().
+struct OneWireTransaction
+{
+    const uint8_t *rom;       // device to select, or nullptr for skip ROM
+    const uint8_t *command;   // command bytes written after the ROM phase
+    uint8_t commandLen;       // at most ONEWIRE_TXN_MAX_COMMAND
+    uint8_t *readBuf;         // receives readLen bytes
+    uint8_t readLen;
+    uint8_t flags;            // ONEWIRE_TXN_* flags
+};
+
+// A bus implementation that OneWire can run on instead of bit-banging a
+// pin: a hardware peripheral (UART, RMT) or a host-side bus model.  Only
+// the reset and bit slots are required; the byte and transaction
+// defaults are built from them, and a transport that can move whole
+// bytes overrides those.
+class OneWireTransport
+{
+  public:
+    virtual ~OneWireTransport() { }
+
+    virtual uint8_t reset(void) = 0;
+    virtual void write_bit(uint8_t v) = 0;
+    virtual uint8_t read_bit(void) = 0;
+
+    virtual void write(uint8_t v, uint8_t power);
+    virtual uint8_t read(void);
+    virtual void depower(void) { }
+    virtual uint8_t transaction(const OneWireTransaction &txn);
+};
+
 class OneWire
 {
   private:
     IO_REG_TYPE bitmask;
     volatile IO_REG_TYPE *baseReg;
+    OneWireTransport *transport;
 
 #if ONEWIRE_SEARCH
     // global search state
@@ -69,10 +143,14 @@ class OneWire
 #endif
 
   public:
-    OneWire() { }
+    OneWire() : transport(nullptr) { }
     OneWire(uint8_t pin) { begin(pin); }
+    OneWire(OneWireTransport *t) { begin(t); }
     void begin(uint8_t pin);
 
+    // Run the bus on a transport instead of a GPIO pin
+    void begin(OneWireTransport *t);
+
     // Perform a 1-Wire reset cycle. Returns 1 if a device responds
     // with a presence pulse.  Returns 0 if there is no device or the
     // bus is shorted or otherwise held low for more than 250uS
@@ -111,6 +189,13 @@ class OneWire
     // someone shorts your bus.
     void depower(void);
 
+    // Run a whole reset/select/command/read exchange as one planned
+    // sequence instead of a string of reset(), select(), write() and
+    // read() calls.  The read phase is checked against its trailing CRC8
+    // when ONEWIRE_TXN_CHECK_CRC8 is set.  Returns ONEWIRE_TXN_OK or one
+    // of the ONEWIRE_TXN_* error codes.
+    uint8_t transaction(const OneWireTransaction &txn);
+
 #if ONEWIRE_SEARCH
     // Clear the search state so that if will start from the beginning again.
     void reset_search();
@@ -126,6 +211,11 @@ class OneWire
     // get garbage.  The order is deterministic. You will always get
     // the same devices in the same order.
     bool search(uint8_t *newAddr, bool search_mode = true);
+
+    // Check whether the device with ROM 'rom' is on the bus, using a
+    // single search pass steered along its ROM.  The state of a search
+    // in progress is kept, so this can be mixed with search() calls.
+    bool verify(const uint8_t rom[8]);
 #endif
 
 #if ONEWIRE_CRC
@@ -0,0 +1,67 @@
+#ifndef OneWireCRC_h
+#define OneWireCRC_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWire.h"
+
+// CRC kernels for the 1-Wire CRC8 (X^8 + X^5 + X^4 + 1, used by ROMs and
+// scratchpads) and CRC16 (X^16 + X^15 + X^2 + 1, used by memory devices),
+// in the LSB first bit order of the bus.  The kernels of one width give
+// identical results and only trade flash for speed:
+//
+//    kernel    CRC8 tables   CRC16 tables   bytes per step
+//    Bitwise   none          16 bytes       1 (8 shifts)
+//    Nibble    32 bytes      64 bytes       1 (2 lookups)
+//    Table     256 bytes     512 bytes      1 (1 lookup)
+//    Slice4    1 KB          2 KB           4 (4 lookups)
+//
+// OneWire::crc8() and OneWire::crc16() run the kernels picked by
+// ONEWIRE_CRC8_KERNEL and ONEWIRE_CRC16_KERNEL.  The others can still be
+// called directly, e.g. by examples/CRCBenchmark; the linker drops the
+// tables of kernels that are never called.
+//
+// 'crc' is the value to continue from, so a buffer can be checked in
+// pieces.
+class OneWireCRC
+{
+  public:
+    static uint8_t crc8Bitwise(const uint8_t *data, uint16_t len, uint8_t crc = 0);
+    static uint8_t crc8Nibble(const uint8_t *data, uint16_t len, uint8_t crc = 0);
+    static uint8_t crc8Table(const uint8_t *data, uint16_t len, uint8_t crc = 0);
+    static uint8_t crc8Slice4(const uint8_t *data, uint16_t len, uint8_t crc = 0);
+
+    static uint16_t crc16Bitwise(const uint8_t *data, uint16_t len, uint16_t crc = 0);
+    static uint16_t crc16Nibble(const uint8_t *data, uint16_t len, uint16_t crc = 0);
+    static uint16_t crc16Table(const uint8_t *data, uint16_t len, uint16_t crc = 0);
+    static uint16_t crc16Slice4(const uint8_t *data, uint16_t len, uint16_t crc = 0);
+
+    // The kernels selected at compile time
+    static inline uint8_t crc8(const uint8_t *data, uint16_t len, uint8_t crc = 0) {
+#if ONEWIRE_CRC8_KERNEL == ONEWIRE_CRC_SLICE4
+        return crc8Slice4(data, len, crc);
+#elif ONEWIRE_CRC8_KERNEL == ONEWIRE_CRC_TABLE
+        return crc8Table(data, len, crc);
+#elif ONEWIRE_CRC8_KERNEL == ONEWIRE_CRC_NIBBLE
+        return crc8Nibble(data, len, crc);
+#else
+        return crc8Bitwise(data, len, crc);
+#endif
+    }
+
+    static inline uint16_t crc16(const uint8_t *data, uint16_t len, uint16_t crc = 0) {
+#if ONEWIRE_CRC16_KERNEL == ONEWIRE_CRC_SLICE4
+        return crc16Slice4(data, len, crc);
+#elif ONEWIRE_CRC16_KERNEL == ONEWIRE_CRC_TABLE
+        return crc16Table(data, len, crc);
+#elif ONEWIRE_CRC16_KERNEL == ONEWIRE_CRC_NIBBLE
+        return crc16Nibble(data, len, crc);
+#else
+        return crc16Bitwise(data, len, crc);
+#endif
+    }
+};
+
+#endif // __cplusplus
+#endif // OneWireCRC_h
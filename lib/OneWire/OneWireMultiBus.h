@@ -0,0 +1,290 @@
+#ifndef OneWireMultiBus_h
+#define OneWireMultiBus_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWire.h"
+
+// Bit-parallel driver for several 1-Wire buses whose pins share one GPIO
+// bank.  Every slot is driven on all buses at once through the bank's
+// set/clear/enable registers and sampled with a single input register
+// read, so N buses are clocked in the time of one.
+//
+// The register access is supplied by a Port class so the same driver
+// runs on hardware (OneWireMultiBusEsp32Port below) or against a host
+// bus model.  A Port provides:
+//
+//    void begin(uint32_t mask);        // configure the pins as inputs
+//    void writeLow(uint32_t mask);
+//    void writeHigh(uint32_t mask);
+//    void modeInput(uint32_t mask);
+//    void modeOutput(uint32_t mask);
+//    uint32_t read(void);               // raw input register
+//    void delayMicros(uint16_t us);
+//    void lock(void);                   // enter the timing critical section
+//    void unlock(void);
+//
+// Masks are in the Port's register bit space; the driver maps bus
+// indexes to register bits once in begin().
+
+// Buses that can be driven by one OneWireMultiBus (one register bank)
+#define ONEWIRE_MB_MAX_BUSES 32
+
+// Per-bus result codes
+#define ONEWIRE_MB_OK          0
+#define ONEWIRE_MB_NO_PRESENCE 1
+#define ONEWIRE_MB_CRC_ERROR   2
+#define ONEWIRE_MB_SHORTED     3
+
+template <class Port>
+class OneWireMultiBus
+{
+  private:
+    Port &port;
+    uint8_t count;
+    uint32_t busBit[ONEWIRE_MB_MAX_BUSES];
+    uint32_t allBits;
+
+    // Register bits of the buses whose byte has bit 'bit' set
+    uint32_t gather(const uint8_t *bytes, uint8_t bit) const {
+        uint32_t m = 0;
+        for (uint8_t b = 0; b < count; b++) {
+            if (bytes[b] & (1 << bit)) m |= busBit[b];
+        }
+        return m;
+    }
+
+    void writeSlot(uint32_t ones) {
+        port.lock();
+        port.writeLow(allBits);
+        port.modeOutput(allBits);       // drive all buses low
+        port.delayMicros(10);
+        port.writeHigh(ones);           // end the '1' slots
+        port.delayMicros(55);
+        port.writeHigh(allBits);        // end the '0' slots
+        port.unlock();
+        port.delayMicros(5);
+    }
+
+    uint32_t readSlot(void) {
+        uint32_t r;
+
+        port.lock();
+        port.modeOutput(allBits);
+        port.writeLow(allBits);
+        port.delayMicros(3);
+        port.modeInput(allBits);        // let the pull-ups raise the lines
+        port.delayMicros(10);
+        r = port.read();
+        port.unlock();
+        port.delayMicros(53);
+        return r;
+    }
+
+  public:
+    OneWireMultiBus(Port &p) : port(p), count(0), allBits(0) { }
+
+    // Attach the buses.  'bits' holds the register bit of each bus
+    // (the pin number within its bank on ESP32).
+    void begin(const uint8_t *bits, uint8_t n) {
+        if (n > ONEWIRE_MB_MAX_BUSES) n = ONEWIRE_MB_MAX_BUSES;
+        count = n;
+        allBits = 0;
+        for (uint8_t b = 0; b < n; b++) {
+            busBit[b] = (uint32_t)1 << (bits[b] & 31);
+            allBits |= busBit[b];
+        }
+        port.begin(allBits);
+    }
+
+    uint8_t busCount(void) const { return count; }
+
+    // Reset every bus.  status[] receives ONEWIRE_MB_OK for buses that
+    // answered with a presence pulse, otherwise an error code.  Returns
+    // the number of buses with a device present.
+    uint8_t reset(uint8_t *status) {
+        uint32_t high = 0;
+        uint32_t present;
+        uint8_t retries = 125;
+        uint8_t found = 0;
+
+        port.lock();
+        port.modeInput(allBits);
+        port.unlock();
+        // wait until the wires are high... just in case
+        do {
+            high = port.read() & allBits;
+            if (high == allBits) break;
+            port.delayMicros(2);
+        } while (--retries);
+
+        port.lock();
+        port.writeLow(high);
+        port.modeOutput(high);
+        port.unlock();
+        port.delayMicros(480);
+        port.lock();
+        port.modeInput(high);
+        port.delayMicros(70);
+        present = ~port.read() & high;
+        port.unlock();
+        port.delayMicros(410);
+
+        for (uint8_t b = 0; b < count; b++) {
+            if (!(high & busBit[b])) {
+                status[b] = ONEWIRE_MB_SHORTED;
+            } else if (present & busBit[b]) {
+                status[b] = ONEWIRE_MB_OK;
+                found++;
+            } else {
+                status[b] = ONEWIRE_MB_NO_PRESENCE;
+            }
+        }
+        return found;
+    }
+
+    // Write the same byte to every bus
+    void write(uint8_t v, bool power = false) {
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            writeSlot((v & (1 << bit)) ? allBits : 0);
+        }
+        if (!power) depower();
+    }
+
+    // Write bytes[b] to bus b; all buses are clocked together
+    void write(const uint8_t *bytes, bool power = false) {
+        uint32_t ones[8];
+
+        for (uint8_t bit = 0; bit < 8; bit++) ones[bit] = gather(bytes, bit);
+        for (uint8_t bit = 0; bit < 8; bit++) writeSlot(ones[bit]);
+        if (!power) depower();
+    }
+
+    // Read one byte from every bus into bytes[b]
+    void read(uint8_t *bytes) {
+        uint32_t samples[8];
+
+        for (uint8_t bit = 0; bit < 8; bit++) samples[bit] = readSlot();
+        for (uint8_t b = 0; b < count; b++) {
+            uint8_t r = 0;
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                if (samples[bit] & busBit[b]) r |= 1 << bit;
+            }
+            bytes[b] = r;
+        }
+    }
+
+    // Select roms[b] on bus b, or skip ROM on every bus when roms is null
+    void select(const uint8_t (*roms)[8]) {
+        uint8_t column[ONEWIRE_MB_MAX_BUSES];
+
+        if (!roms) {
+            write(0xCC);
+            return;
+        }
+        write(0x55);
+        for (uint8_t i = 0; i < 8; i++) {
+            for (uint8_t b = 0; b < count; b++) column[b] = roms[b][i];
+            write(column);
+        }
+    }
+
+    void depower(void) {
+        port.lock();
+        port.modeInput(allBits);
+        port.writeLow(allBits);
+        port.unlock();
+    }
+
+    // Reset, select (or skip), send 'command' and read 'len' bytes from
+    // every bus.  data[b * len ...] receives bus b's bytes.  With
+    // checkCrc the last byte of each bus is checked as CRC8 of the
+    // others.  status[] gets a per-bus result code; returns the number
+    // of buses that completed without error.
+    uint8_t transaction(const uint8_t (*roms)[8], uint8_t command,
+                        uint8_t *data, uint8_t len, bool checkCrc, uint8_t *status) {
+        uint8_t column[ONEWIRE_MB_MAX_BUSES];
+        uint8_t ok = 0;
+
+        if (!reset(status)) return 0;
+        select(roms);
+        write(command);
+        for (uint8_t i = 0; i < len; i++) {
+            read(column);
+            for (uint8_t b = 0; b < count; b++) data[b * len + i] = column[b];
+        }
+        uint8_t after[ONEWIRE_MB_MAX_BUSES];
+        reset(after);
+
+        for (uint8_t b = 0; b < count; b++) {
+            if (status[b] != ONEWIRE_MB_OK) continue;
+#if ONEWIRE_CRC
+            if (checkCrc && len &&
+                OneWire::crc8(data + b * len, len - 1) != data[b * len + len - 1]) {
+                status[b] = ONEWIRE_MB_CRC_ERROR;
+                continue;
+            }
+#endif
+            ok++;
+        }
+        return ok;
+    }
+};
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <Arduino.h>
+
+// Register access for one ESP32 GPIO bank (bank 0: GPIO0-31, bank 1:
+// GPIO32-39).  Buses are given to OneWireMultiBus::begin() as the pin
+// number within the bank.
+class OneWireMultiBusEsp32Port
+{
+  private:
+    uint8_t bank;
+    portMUX_TYPE mux;
+
+  public:
+    OneWireMultiBusEsp32Port(uint8_t gpioBank = 0) : bank(gpioBank) {
+        mux = portMUX_INITIALIZER_UNLOCKED;
+    }
+
+    void begin(uint32_t mask) {
+        for (uint8_t i = 0; i < 32; i++) {
+            if (mask & ((uint32_t)1 << i)) pinMode(bank * 32 + i, INPUT);
+        }
+    }
+
+#if CONFIG_IDF_TARGET_ESP32C3
+    inline void writeLow(uint32_t mask) { GPIO.out_w1tc.val = mask; }
+    inline void writeHigh(uint32_t mask) { GPIO.out_w1ts.val = mask; }
+    inline void modeInput(uint32_t mask) { GPIO.enable_w1tc.val = mask; }
+    inline void modeOutput(uint32_t mask) { GPIO.enable_w1ts.val = mask; }
+    inline uint32_t read(void) { return GPIO.in.val; }
+#else
+    inline void writeLow(uint32_t mask) {
+        if (bank) GPIO.out1_w1tc.val = mask; else GPIO.out_w1tc = mask;
+    }
+    inline void writeHigh(uint32_t mask) {
+        if (bank) GPIO.out1_w1ts.val = mask; else GPIO.out_w1ts = mask;
+    }
+    inline void modeInput(uint32_t mask) {
+        if (bank) GPIO.enable1_w1tc.val = mask; else GPIO.enable_w1tc = mask;
+    }
+    inline void modeOutput(uint32_t mask) {
+        // GPIO34-39 are input only
+        if (bank) GPIO.enable1_w1ts.val = mask & 0x3; else GPIO.enable_w1ts = mask;
+    }
+    inline uint32_t read(void) {
+        return bank ? GPIO.in1.val : GPIO.in;
+    }
+#endif
+
+    inline void delayMicros(uint16_t us) { delayMicroseconds(us); }
+    inline void lock(void) { portENTER_CRITICAL(&mux); }
+    inline void unlock(void) { portEXIT_CRITICAL(&mux); }
+};
+#endif
+
+#endif // __cplusplus
+#endif // OneWireMultiBus_h
@@ -0,0 +1,268 @@
+#ifndef OneWireUART_h
+#define OneWireUART_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWire.h"
+
+// 1-Wire transport on a UART.  The bus is wired to the UART's TX pin,
+// driven open drain, and its RX pin listens to the same wire, so every
+// frame the UART sends comes back as an echo that shows what the devices
+// did to the line.  The UART hardware times the slots, so the bus runs
+// without CPU timing loops or interrupts disabled:
+//
+//  - a reset is the byte 0xF0 at 9600 baud: the start bit and four zero
+//    data bits hold the line low for 520us.  A presence pulse pulls some
+//    of the high bits low, so any echo other than 0xF0 means presence.
+//  - at 115200 baud one byte is one slot.  0x00 is a write-0 (78us low),
+//    0xFF a write-1 or read slot (8.7us low).  A device answering 0
+//    stretches the low time, so a read gives 1 only if 0xFF comes back.
+//
+// Bytes are moved as streams of up to ONEWIRE_UART_BATCH * 8 symbols, so
+// a transaction's select and command go out in one UART write.
+//
+// The UART access is supplied by a Port class so the same transport runs
+// on hardware (OneWireUARTEsp32Port below) or against a host bus model
+// (OneWireSimUARTPort).  A Port provides:
+//
+//    void begin(void);
+//    void setBaud(uint32_t baud);
+//    uint8_t exchange(const uint8_t *tx, uint8_t *rx, uint8_t n);
+//                                        // send n frames, receive their
+//                                        // echoes, returns the echoes
+//                                        // received; tx and rx may alias
+//    void power(bool on);                // strong pull-up on or off
+//
+// Use it like any other transport:
+//
+//    OneWireUARTEsp32Port port(1, 4);
+//    OneWireUART<OneWireUARTEsp32Port> uart(port);
+//    uart.begin();
+//    OneWire oneWire(&uart);
+
+#ifndef ONEWIRE_UART_RESET_BAUD
+#define ONEWIRE_UART_RESET_BAUD 9600
+#endif
+
+#ifndef ONEWIRE_UART_SLOT_BAUD
+#define ONEWIRE_UART_SLOT_BAUD 115200
+#endif
+
+// Bytes per UART exchange.  Each byte takes 8 frames of stack and FIFO
+// space; 16 fills the 128 byte FIFO of the ESP32 UARTs.
+#ifndef ONEWIRE_UART_BATCH
+#define ONEWIRE_UART_BATCH 16
+#endif
+
+template <class Port>
+class OneWireUART : public OneWireTransport
+{
+  private:
+    Port &port;
+    bool powered;
+
+    void unpower(void) {
+        if (!powered) return;
+        port.power(false);
+        powered = false;
+    }
+
+    // Run the slots for n bytes.  tx holds the bytes to write, or null
+    // to read; rx receives what the echoes read back.  tx and rx may
+    // alias.
+    void slots(const uint8_t *tx, uint8_t *rx, uint8_t n) {
+        uint8_t symbols[ONEWIRE_UART_BATCH * 8];
+
+        unpower();
+        while (n) {
+            uint8_t k = n < ONEWIRE_UART_BATCH ? n : ONEWIRE_UART_BATCH;
+            uint8_t i, bit;
+
+            for (i = 0; i < k; i++) {
+                for (bit = 0; bit < 8; bit++) {
+                    uint8_t one = tx ? tx[i] & (1 << bit) : 1;
+                    symbols[i * 8 + bit] = one ? 0xFF : 0x00;
+                }
+            }
+            // missing echoes read as 0, like a line held low
+            uint8_t got = port.exchange(symbols, symbols, k * 8);
+            for (i = 0; i < k; i++) {
+                uint8_t r = 0;
+                for (bit = 0; bit < 8; bit++) {
+                    uint8_t s = i * 8 + bit;
+                    if (s < got && symbols[s] == 0xFF) r |= 1 << bit;
+                }
+                rx[i] = r;
+            }
+            if (tx) tx += k;
+            rx += k;
+            n -= k;
+        }
+    }
+
+  public:
+    OneWireUART(Port &p) : port(p), powered(false) { }
+
+    void begin(void) {
+        port.begin();
+        port.setBaud(ONEWIRE_UART_SLOT_BAUD);
+    }
+
+    virtual uint8_t reset(void) {
+        uint8_t symbol = 0xF0;
+
+        unpower();
+        port.setBaud(ONEWIRE_UART_RESET_BAUD);
+        uint8_t got = port.exchange(&symbol, &symbol, 1);
+        port.setBaud(ONEWIRE_UART_SLOT_BAUD);
+        // no high bit left means the line was held low throughout
+        return got && symbol != 0xF0 && (symbol & 0xF0) ? 1 : 0;
+    }
+
+    virtual void write_bit(uint8_t v) {
+        uint8_t symbol = v ? 0xFF : 0x00;
+
+        unpower();
+        port.exchange(&symbol, &symbol, 1);
+    }
+
+    virtual uint8_t read_bit(void) {
+        uint8_t symbol = 0xFF;
+
+        unpower();
+        return port.exchange(&symbol, &symbol, 1) && symbol == 0xFF;
+    }
+
+    virtual void write(uint8_t v, uint8_t power) {
+        uint8_t echo;
+
+        slots(&v, &echo, 1);
+        if (power) {
+            port.power(true);
+            powered = true;
+        }
+    }
+
+    virtual uint8_t read(void) {
+        uint8_t r;
+
+        slots(nullptr, &r, 1);
+        return r;
+    }
+
+    virtual void depower(void) {
+        unpower();
+    }
+
+    virtual uint8_t transaction(const OneWireTransaction &txn) {
+        uint8_t plan[9 + ONEWIRE_TXN_MAX_COMMAND];
+        uint8_t len = 0;
+        uint8_t i;
+
+        if (txn.commandLen > ONEWIRE_TXN_MAX_COMMAND) return ONEWIRE_TXN_INVALID;
+        if (txn.readLen && !txn.readBuf) return ONEWIRE_TXN_INVALID;
+
+        if (txn.rom) {
+            plan[len++] = 0x55;     // Choose ROM
+            for (i = 0; i < 8; i++) plan[len++] = txn.rom[i];
+        } else {
+            plan[len++] = 0xCC;     // Skip ROM
+        }
+        for (i = 0; i < txn.commandLen; i++) plan[len++] = txn.command[i];
+
+        if ((txn.flags & ONEWIRE_TXN_RESET) && !reset()) return ONEWIRE_TXN_NO_PRESENCE;
+
+        slots(plan, plan, len);
+        if (!txn.readLen && (txn.flags & ONEWIRE_TXN_POWER)) {
+            port.power(true);
+            powered = true;
+        }
+        if (txn.readLen) slots(nullptr, txn.readBuf, txn.readLen);
+
+        if ((txn.flags & ONEWIRE_TXN_RESET_AFTER) && !reset()) return ONEWIRE_TXN_NO_PRESENCE;
+
+#if ONEWIRE_CRC
+        if ((txn.flags & ONEWIRE_TXN_CHECK_CRC8) && txn.readLen &&
+            OneWire::crc8(txn.readBuf, txn.readLen - 1) != txn.readBuf[txn.readLen - 1]) {
+            return ONEWIRE_TXN_CRC_ERROR;
+        }
+#endif
+        return ONEWIRE_TXN_OK;
+    }
+};
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <Arduino.h>
+#include <driver/uart.h>
+#include <driver/gpio.h>
+
+// Echo wait per exchange; the longest (a full batch) takes about 11ms
+#ifndef ONEWIRE_UART_TIMEOUT_MS
+#define ONEWIRE_UART_TIMEOUT_MS 20
+#endif
+
+// ESP32 UART port.  TX and RX are both routed to the bus pin and the pin
+// is switched to open drain, so only a pull-up resistor is needed.  The
+// strong pull-up for parasite powered devices is either an external
+// P-channel MOSFET on 'pullupPin' (driven low to switch it on, like
+// DallasTemperature's external pull-up) or, without one, the bus pin
+// switched to push-pull while the UART idles high.
+class OneWireUARTEsp32Port
+{
+  private:
+    uart_port_t uart;
+    gpio_num_t pin;
+    int8_t pullupPin;
+
+  public:
+    OneWireUARTEsp32Port(uint8_t uartNum, uint8_t busPin, int8_t strongPullupPin = -1)
+        : uart((uart_port_t)uartNum), pin((gpio_num_t)busPin), pullupPin(strongPullupPin) { }
+
+    void begin(void) {
+        uart_config_t config = {};
+
+        config.baud_rate = ONEWIRE_UART_SLOT_BAUD;
+        config.data_bits = UART_DATA_8_BITS;
+        config.parity = UART_PARITY_DISABLE;
+        config.stop_bits = UART_STOP_BITS_1;
+        config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+        config.source_clk = UART_SCLK_APB;
+        // the RX ring buffer has to be larger than the FIFO, TX writes
+        // straight into the FIFO
+        uart_driver_install(uart, 256, 0, 0, NULL, 0);
+        uart_param_config(uart, &config);
+        uart_set_pin(uart, pin, pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+        // uart_set_pin() leaves the shared pin an input; enable the TX
+        // output again as open drain
+        gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+        if (pullupPin >= 0) {
+            pinMode(pullupPin, OUTPUT);
+            digitalWrite(pullupPin, HIGH);
+        }
+    }
+
+    void setBaud(uint32_t baud) {
+        uart_wait_tx_done(uart, portMAX_DELAY);
+        uart_set_baudrate(uart, baud);
+    }
+
+    uint8_t exchange(const uint8_t *tx, uint8_t *rx, uint8_t n) {
+        uart_flush_input(uart);
+        uart_write_bytes(uart, (const char *)tx, n);
+        int got = uart_read_bytes(uart, rx, n, pdMS_TO_TICKS(ONEWIRE_UART_TIMEOUT_MS));
+        return got > 0 ? got : 0;
+    }
+
+    void power(bool on) {
+        if (pullupPin >= 0) {
+            digitalWrite(pullupPin, on ? LOW : HIGH);
+        } else {
+            gpio_set_direction(pin, on ? GPIO_MODE_INPUT_OUTPUT : GPIO_MODE_INPUT_OUTPUT_OD);
+        }
+    }
+};
+#endif
+
+#endif // __cplusplus
+#endif // OneWireUART_h
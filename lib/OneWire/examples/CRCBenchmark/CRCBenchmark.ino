@@ -0,0 +1,84 @@
+#include <OneWire.h>
+#include <OneWireCRC.h>
+
+// OneWire CRC kernel benchmark
+//
+// Runs every CRC8 and CRC16 kernel of OneWireCRC over a 9 byte buffer
+// (one scratchpad) and a 256 byte block, checks that they all agree and
+// prints the cost per byte.  On ESP32 the CPU cycle counter is used, so
+// the numbers are cycles per byte; other boards report microseconds per
+// kilobyte.  Use the results to choose ONEWIRE_CRC8_KERNEL and
+// ONEWIRE_CRC16_KERNEL for a board.
+
+#define RUNS 200
+
+uint8_t block[256];
+
+typedef uint8_t (*Crc8Kernel)(const uint8_t *, uint16_t, uint8_t);
+typedef uint16_t (*Crc16Kernel)(const uint8_t *, uint16_t, uint16_t);
+
+const char *names[] = { "Bitwise", "Nibble", "Table", "Slice4" };
+Crc8Kernel crc8Kernels[] = {
+  OneWireCRC::crc8Bitwise, OneWireCRC::crc8Nibble,
+  OneWireCRC::crc8Table, OneWireCRC::crc8Slice4
+};
+Crc16Kernel crc16Kernels[] = {
+  OneWireCRC::crc16Bitwise, OneWireCRC::crc16Nibble,
+  OneWireCRC::crc16Table, OneWireCRC::crc16Slice4
+};
+
+uint32_t ticks() {
+#if defined(ARDUINO_ARCH_ESP32)
+  return ESP.getCycleCount();
+#else
+  return micros();
+#endif
+}
+
+void report(const char *crc, const char *kernel, uint16_t len, uint32_t elapsed, bool agrees) {
+  Serial.print(crc);
+  Serial.print(" ");
+  Serial.print(kernel);
+  Serial.print("\t");
+  Serial.print(len);
+  Serial.print(" bytes\t");
+#if defined(ARDUINO_ARCH_ESP32)
+  Serial.print((float)elapsed / ((uint32_t)RUNS * len));
+  Serial.print(" cycles/byte");
+#else
+  Serial.print((float)elapsed * 1024 / ((uint32_t)RUNS * len));
+  Serial.print(" us/KB");
+#endif
+  Serial.println(agrees ? "" : "\tMISMATCH");
+}
+
+void run(uint16_t len) {
+  uint8_t crc8Expected = OneWireCRC::crc8Bitwise(block, len);
+  uint16_t crc16Expected = OneWireCRC::crc16Bitwise(block, len);
+
+  for (uint8_t k = 0; k < 4; k++) {
+    uint8_t crc = 0;
+    uint32_t start = ticks();
+    for (uint16_t i = 0; i < RUNS; i++) crc = crc8Kernels[k](block, len, 0);
+    report("crc8", names[k], len, ticks() - start, crc == crc8Expected);
+  }
+  for (uint8_t k = 0; k < 4; k++) {
+    uint16_t crc = 0;
+    uint32_t start = ticks();
+    for (uint16_t i = 0; i < RUNS; i++) crc = crc16Kernels[k](block, len, 0);
+    report("crc16", names[k], len, ticks() - start, crc == crc16Expected);
+  }
+}
+
+void setup(void) {
+  Serial.begin(115200);
+  randomSeed(1);
+  for (uint16_t i = 0; i < sizeof(block); i++) block[i] = random(256);
+}
+
+void loop(void) {
+  run(9);
+  run(sizeof(block));
+  Serial.println();
+  delay(5000);
+}
@@ -0,0 +1,750 @@
+#include <string.h>
+#include <math.h>
+#include "OneWireSim.h"
+
+// ROM commands
+#define READ_ROM     0x33
+#define MATCH_ROM    0x55
+#define SKIP_ROM     0xCC
+#define SEARCH_ROM   0xF0
+#define ALARM_SEARCH 0xEC
+
+// DS18x20 function commands
+#define STARTCONVO      0x44
+#define COPYSCRATCH     0x48
+#define READSCRATCH     0xBE
+#define WRITESCRATCH    0x4E
+#define RECALLSCRATCH   0xB8
+#define READPOWERSUPPLY 0xB4
+
+// Scratchpad locations
+#define TEMP_LSB        0
+#define TEMP_MSB        1
+#define HIGH_ALARM_TEMP 2
+#define LOW_ALARM_TEMP  3
+#define CONFIGURATION   4
+#define COUNT_REMAIN    6
+#define COUNT_PER_C     7
+#define SCRATCHPAD_CRC  8
+
+static uint64_t simMicros = 0;
+
+uint64_t OneWireSimClock::now(void)
+{
+	return simMicros;
+}
+
+void OneWireSimClock::advance(uint32_t us)
+{
+	simMicros += us;
+}
+
+void OneWireSimClock::set(uint64_t us)
+{
+	simMicros = us;
+}
+
+#ifdef ONEWIRE_SIM_NATIVE
+// Arduino API for native builds, see native/Arduino.h
+unsigned long millis(void) { return (unsigned long)(simMicros / 1000); }
+unsigned long micros(void) { return (unsigned long)simMicros; }
+void delay(unsigned long ms) { simMicros += (uint64_t)ms * 1000; }
+void delayMicroseconds(unsigned int us) { simMicros += us; }
+void yield(void) { simMicros += 1; }
+void pinMode(uint8_t, uint8_t) { }
+void digitalWrite(uint8_t, uint8_t) { }
+int digitalRead(uint8_t) { return HIGH; }
+#endif
+
+//
+// OneWireSimDevice: the ROM layer
+//
+
+OneWireSimDevice::OneWireSimDevice(const uint8_t r[8])
+{
+	memcpy(rom, r, 8);
+	state = IDLE;
+	outLen = 0;
+	outBit = 0;
+}
+
+void OneWireSimDevice::busReset(void)
+{
+	state = ROM_COMMAND;
+	bitIndex = 0;
+	shift = 0;
+	outLen = 0;
+	outBit = 0;
+	haveCommand = false;
+}
+
+void OneWireSimDevice::send(const uint8_t *bytes, uint8_t n)
+{
+	if (n > sizeof(out)) n = sizeof(out);
+	memcpy(out, bytes, n);
+	outLen = n;
+	outBit = 0;
+}
+
+void OneWireSimDevice::romCommand(uint8_t cmd)
+{
+	bitIndex = 0;
+	switch (cmd) {
+	case READ_ROM:
+		state = FUNCTION;
+		send(rom, 8);
+		break;
+	case MATCH_ROM:
+		state = MATCHING;
+		break;
+	case SKIP_ROM:
+		state = FUNCTION;
+		break;
+	case SEARCH_ROM:
+		state = SEARCHING;
+		searchPhase = 0;
+		break;
+	case ALARM_SEARCH:
+		state = alarm() ? SEARCHING : IDLE;
+		searchPhase = 0;
+		break;
+	default:
+		state = IDLE;
+		break;
+	}
+}
+
+// A complete byte written in the function layer
+void OneWireSimDevice::receive(uint8_t v)
+{
+	if (!haveCommand) {
+		haveCommand = true;
+		outLen = 0;
+		outBit = 0;
+		command(v);
+	} else {
+		data(v);
+	}
+}
+
+void OneWireSimDevice::busWrite(uint8_t v)
+{
+	v = v ? 1 : 0;
+	switch (state) {
+	case IDLE:
+		break;
+	case ROM_COMMAND:
+		shift |= v << bitIndex;
+		if (++bitIndex == 8) {
+			uint8_t cmd = shift;
+			shift = 0;
+			romCommand(cmd);
+		}
+		break;
+	case MATCHING:
+		if (v != romBit(bitIndex)) {
+			state = IDLE;
+		} else if (++bitIndex == 64) {
+			state = FUNCTION;
+			bitIndex = 0;
+		}
+		break;
+	case SEARCHING:
+		// writes during the read phases look like read slots; only the
+		// master's direction bit counts
+		if (searchPhase < 2) break;
+		if (v != romBit(bitIndex)) {
+			state = IDLE;
+		} else if (++bitIndex == 64) {
+			state = FUNCTION;
+			bitIndex = 0;
+		}
+		searchPhase = 0;
+		break;
+	case FUNCTION:
+		shift |= v << bitIndex;
+		if (++bitIndex == 8) {
+			uint8_t b = shift;
+			shift = 0;
+			bitIndex = 0;
+			receive(b);
+		}
+		break;
+	}
+}
+
+uint8_t OneWireSimDevice::busRead(void)
+{
+	switch (state) {
+	case IDLE:
+		return 1;
+	case SEARCHING:
+		if (searchPhase == 0) {
+			searchPhase = 1;
+			return romBit(bitIndex);
+		}
+		if (searchPhase == 1) {
+			searchPhase = 2;
+			return !romBit(bitIndex);
+		}
+		// the direction slot: a read slot is the master writing 1
+		busWrite(1);
+		return 1;
+	case FUNCTION:
+		// with nothing to send a read slot is a write-1 to a device
+		// still receiving, unless it reports status
+		if (outBit < outLen * 8) {
+			uint8_t r = (out[outBit >> 3] >> (outBit & 7)) & 1;
+			outBit++;
+			return r;
+		}
+		if (!haveCommand || bitIndex || receiving()) {
+			busWrite(1);
+			return 1;
+		}
+		return statusBit();
+	default:
+		// ROM command and match phases: the read slot is a write-1
+		busWrite(1);
+		return 1;
+	}
+}
+
+//
+// OneWireSimDS18x20
+//
+
+static const uint8_t blankRom[8] = { 0 };
+
+OneWireSimDS18x20::OneWireSimDS18x20(uint8_t family, uint32_t serial)
+	: OneWireSimDevice(blankRom)
+{
+	rom[0] = family;
+	for (uint8_t i = 0; i < 6; i++) {
+		rom[1 + i] = i < 4 ? (uint8_t)(serial >> (8 * i)) : 0;
+	}
+	rom[7] = OneWire::crc8(rom, 7);
+
+	// factory defaults: TH 75, TL 70, 12 bit
+	eeprom[0] = 75;
+	eeprom[1] = 70;
+	eeprom[2] = 0x7F;
+
+	temp16 = 25 * 16;
+	parasitePower = false;
+	crcErrors = 0;
+	lastCommand = 0;
+	dataIndex = 0;
+	powerBit = 1;
+	converting = false;
+	conversionEnd = 0;
+	conversionCount = 0;
+	failedCount = 0;
+
+	memset(scratchPad, 0, sizeof(scratchPad));
+	scratchPad[HIGH_ALARM_TEMP] = eeprom[0];
+	scratchPad[LOW_ALARM_TEMP] = eeprom[1];
+	scratchPad[5] = 0xFF;
+	if (isB20()) {
+		scratchPad[CONFIGURATION] = eeprom[2];
+		scratchPad[6] = 0x0C;
+	} else {
+		scratchPad[CONFIGURATION] = 0xFF;
+	}
+	scratchPad[COUNT_PER_C] = 0x10;
+	latch(85 * 16);	// power-on reset value
+}
+
+void OneWireSimDS18x20::setTemperature(float celsius)
+{
+	temp16 = (int16_t)lroundf(celsius * 16.0f);
+}
+
+uint8_t OneWireSimDS18x20::resolution(void) const
+{
+	if (!isB20()) return 9;
+	return 9 + ((scratchPad[CONFIGURATION] >> 5) & 0x03);
+}
+
+uint16_t OneWireSimDS18x20::conversionMillis(void) const
+{
+	if (!isB20()) return 750;
+	switch (resolution()) {
+	case 9: return 94;
+	case 10: return 188;
+	case 11: return 375;
+	default: return 750;
+	}
+}
+
+void OneWireSimDS18x20::storeCrc(void)
+{
+	scratchPad[SCRATCHPAD_CRC] = OneWire::crc8(scratchPad, 8);
+}
+
+// Load a temperature into the scratchpad the way the part reports it
+void OneWireSimDS18x20::latch(int16_t t16)
+{
+	if (isB20()) {
+		// undefined low bits read as zero at lower resolutions
+		int16_t raw = t16 & ~((1 << (12 - resolution())) - 1);
+		scratchPad[TEMP_LSB] = (uint8_t)raw;
+		scratchPad[TEMP_MSB] = (uint8_t)(raw >> 8);
+	} else {
+		// 9 bit register plus COUNT_REMAIN for the extended resolution:
+		// T = TEMP_READ - 0.25 + (16 - COUNT_REMAIN) / 16
+		int16_t raw = (t16 + 4) >> 3;	// nearest 0.5 degC
+		int16_t remain = 12 - (t16 - (raw >> 1) * 16);
+		scratchPad[TEMP_LSB] = (uint8_t)raw;
+		scratchPad[TEMP_MSB] = raw < 0 ? 0xFF : 0x00;
+		scratchPad[COUNT_REMAIN] = (uint8_t)remain;
+	}
+	storeCrc();
+}
+
+// Complete a conversion whose time is up
+void OneWireSimDS18x20::update(void)
+{
+	if (converting && OneWireSimClock::now() >= conversionEnd) {
+		converting = false;
+		latch(temp16);
+	}
+}
+
+void OneWireSimDS18x20::powerDropped(void)
+{
+	if (!converting || !parasitePower) return;
+	if (OneWireSimClock::now() >= conversionEnd) {
+		update();
+		return;
+	}
+	// a parasite device runs the conversion off the strong pull-up;
+	// losing it early leaves the power-on value in the register
+	converting = false;
+	failedCount++;
+	latch(85 * 16);
+}
+
+void OneWireSimDS18x20::command(uint8_t cmd)
+{
+	update();
+	lastCommand = cmd;
+	dataIndex = 0;
+	powerBit = 1;
+
+	switch (cmd) {
+	case STARTCONVO:
+		converting = true;
+		conversionEnd = OneWireSimClock::now() + (uint64_t)conversionMillis() * 1000;
+		conversionCount++;
+		break;
+	case READSCRATCH:
+		{
+			uint8_t pad[9];
+			memcpy(pad, scratchPad, sizeof(pad));
+			if (crcErrors) {
+				crcErrors--;
+				pad[SCRATCHPAD_CRC] ^= 0xFF;
+			}
+			send(pad, sizeof(pad));
+		}
+		break;
+	case COPYSCRATCH:
+		eeprom[0] = scratchPad[HIGH_ALARM_TEMP];
+		eeprom[1] = scratchPad[LOW_ALARM_TEMP];
+		if (isB20()) eeprom[2] = scratchPad[CONFIGURATION];
+		break;
+	case RECALLSCRATCH:
+		scratchPad[HIGH_ALARM_TEMP] = eeprom[0];
+		scratchPad[LOW_ALARM_TEMP] = eeprom[1];
+		if (isB20()) scratchPad[CONFIGURATION] = eeprom[2];
+		storeCrc();
+		break;
+	case READPOWERSUPPLY:
+		powerBit = parasitePower ? 0 : 1;
+		break;
+	default:
+		break;
+	}
+}
+
+void OneWireSimDS18x20::data(uint8_t v)
+{
+	if (lastCommand != WRITESCRATCH) return;
+
+	switch (dataIndex++) {
+	case 0:
+		scratchPad[HIGH_ALARM_TEMP] = v;
+		break;
+	case 1:
+		scratchPad[LOW_ALARM_TEMP] = v;
+		break;
+	case 2:
+		// the DS18S20 takes TH and TL only
+		if (isB20()) scratchPad[CONFIGURATION] = (v & 0x60) | 0x1F;
+		break;
+	default:
+		return;
+	}
+	storeCrc();
+}
+
+bool OneWireSimDS18x20::receiving(void)
+{
+	// TH, TL and (DS18B20 only) the configuration register
+	return lastCommand == WRITESCRATCH && dataIndex < (isB20() ? 3 : 2);
+}
+
+uint8_t OneWireSimDS18x20::statusBit(void)
+{
+	uint8_t r;
+
+	update();
+	switch (lastCommand) {
+	case STARTCONVO:
+		return converting ? 0 : 1;
+	case READPOWERSUPPLY:
+		r = powerBit;
+		powerBit = 1;
+		return r;
+	default:
+		return 1;
+	}
+}
+
+bool OneWireSimDS18x20::alarm(void)
+{
+	int16_t t;
+
+	update();
+	if (isB20()) {
+		t = (int16_t)(scratchPad[TEMP_LSB] | (scratchPad[TEMP_MSB] << 8)) >> 4;
+	} else {
+		t = (int16_t)(scratchPad[TEMP_LSB] | (scratchPad[TEMP_MSB] << 8)) >> 1;
+	}
+	return t >= (int8_t)scratchPad[HIGH_ALARM_TEMP] ||
+	       t <= (int8_t)scratchPad[LOW_ALARM_TEMP];
+}
+
+//
+// OneWireSimBus
+//
+
+OneWireSimBus::OneWireSimBus(Mode m)
+{
+	mode = m;
+	count = 0;
+	missingPresence = 0;
+	powered = false;
+	clearStats();
+}
+
+bool OneWireSimBus::attach(OneWireSimDevice *d)
+{
+	if (count >= ONEWIRE_SIM_MAX_DEVICES) return false;
+	for (uint8_t i = 0; i < count; i++) {
+		if (devices[i] == d) return true;
+	}
+	devices[count++] = d;
+	return true;
+}
+
+void OneWireSimBus::detach(OneWireSimDevice *d)
+{
+	for (uint8_t i = 0; i < count; i++) {
+		if (devices[i] == d) {
+			devices[i] = devices[--count];
+			return;
+		}
+	}
+}
+
+void OneWireSimBus::clearStats(void)
+{
+	resetCount = 0;
+	slotCount = 0;
+	busTime = 0;
+}
+
+// Any bus activity ends a strong pull-up left by a previous write
+void OneWireSimBus::activity(void)
+{
+	if (!powered) return;
+	powered = false;
+	for (uint8_t i = 0; i < count; i++) devices[i]->powerDropped();
+}
+
+void OneWireSimBus::spend(uint32_t us)
+{
+	OneWireSimClock::advance(us);
+	busTime += us;
+}
+
+uint8_t OneWireSimBus::pulseReset(void)
+{
+	activity();
+	for (uint8_t i = 0; i < count; i++) devices[i]->busReset();
+	if (missingPresence) {
+		missingPresence--;
+		return 0;
+	}
+	return count ? 1 : 0;
+}
+
+void OneWireSimBus::pulseWrite(uint8_t v)
+{
+	activity();
+	for (uint8_t i = 0; i < count; i++) devices[i]->busWrite(v);
+}
+
+uint8_t OneWireSimBus::pulseRead(void)
+{
+	uint8_t r = 1;
+
+	activity();
+	// wired-AND: any device pulling low wins
+	for (uint8_t i = 0; i < count; i++) r &= devices[i]->busRead();
+	return r;
+}
+
+uint8_t OneWireSimBus::reset(void)
+{
+	resetCount++;
+	spend(ONEWIRE_SIM_RESET_US);
+	return pulseReset();
+}
+
+void OneWireSimBus::write_bit(uint8_t v)
+{
+	slotCount++;
+	spend(v ? ONEWIRE_SIM_WRITE1_US : ONEWIRE_SIM_WRITE0_US);
+	pulseWrite(v);
+	// OneWire leaves the line driven high after a write slot
+	powered = true;
+}
+
+uint8_t OneWireSimBus::read_bit(void)
+{
+	slotCount++;
+	spend(ONEWIRE_SIM_READ_US);
+	return pulseRead();
+}
+
+void OneWireSimBus::write(uint8_t v, uint8_t power)
+{
+	if (mode == SLOT_ACCURATE) {
+		OneWireTransport::write(v, power);
+		return;
+	}
+
+	uint32_t us = 0;
+	for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
+		us += (v & bitMask) ? ONEWIRE_SIM_WRITE1_US : ONEWIRE_SIM_WRITE0_US;
+	}
+	slotCount += 8;
+	spend(us);
+	activity();
+	for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
+		for (uint8_t i = 0; i < count; i++) devices[i]->busWrite(v & bitMask);
+	}
+	powered = true;
+	if (!power) depower();
+}
+
+uint8_t OneWireSimBus::read(void)
+{
+	if (mode == SLOT_ACCURATE) return OneWireTransport::read();
+
+	uint8_t r = 0;
+	slotCount += 8;
+	spend(8 * ONEWIRE_SIM_READ_US);
+	activity();
+	for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
+		uint8_t b = 1;
+		for (uint8_t i = 0; i < count; i++) b &= devices[i]->busRead();
+		if (b) r |= bitMask;
+	}
+	return r;
+}
+
+void OneWireSimBus::depower(void)
+{
+	activity();
+}
+
+// Unlike depower(), also reaches devices while no strong pull-up was on
+void OneWireSimBus::pulseRelease(void)
+{
+	powered = false;
+	for (uint8_t i = 0; i < count; i++) devices[i]->powerDropped();
+}
+
+//
+// OneWireSimMultiBusPort
+//
+
+OneWireSimMultiBusPort::OneWireSimMultiBusPort()
+{
+	memset(buses, 0, sizeof(buses));
+	outHigh = 0;
+	outEnable = 0;
+	driven = 0;
+	shortSlot = 0;
+	sampled = 0;
+	sampleLow = 0;
+	presence = 0;
+	memset(fall, 0, sizeof(fall));
+	memset(rise, 0, sizeof(rise));
+}
+
+void OneWireSimMultiBusPort::connect(uint8_t bit, OneWireSimBus *bus)
+{
+	buses[bit & 31] = bus;
+}
+
+void OneWireSimMultiBusPort::begin(uint32_t mask)
+{
+	outEnable &= ~mask;
+	update();
+}
+
+// Decode edges on the lines the master drives
+void OneWireSimMultiBusPort::update(void)
+{
+	uint32_t now = outEnable & ~outHigh;
+	uint32_t fell = now & ~driven;
+	uint32_t rose = driven & ~now;
+	uint64_t t = OneWireSimClock::now();
+
+	driven = now;
+	for (uint8_t b = 0; b < 32; b++) {
+		uint32_t m = (uint32_t)1 << b;
+		OneWireSimBus *bus = buses[b];
+
+		if (!bus || !((fell | rose) & m)) continue;
+		if (fell & m) {
+			// an undecoded short slot before this one was a write-1
+			if (shortSlot & m) bus->pulseWrite(1);
+			shortSlot &= ~m;
+			sampled &= ~m;
+			fall[b] = t;
+			continue;
+		}
+		rise[b] = t;
+		uint64_t width = t - fall[b];
+		presence &= ~m;
+		if (width >= 240) {
+			if (bus->pulseReset()) presence |= m;
+		} else if (width >= 15) {
+			bus->pulseWrite(0);
+		} else {
+			shortSlot |= m;
+		}
+	}
+}
+
+uint32_t OneWireSimMultiBusPort::read(void)
+{
+	uint64_t t = OneWireSimClock::now();
+	uint32_t low = driven;
+
+	for (uint8_t b = 0; b < 32; b++) {
+		uint32_t m = (uint32_t)1 << b;
+		OneWireSimBus *bus = buses[b];
+
+		if (!bus || (driven & m)) continue;
+		if (shortSlot & m) {
+			if (t - fall[b] <= 15 && !(sampled & m)) {
+				// sampled inside the slot: a read slot
+				sampled |= m;
+				if (!bus->pulseRead()) sampleLow |= m;
+				else sampleLow &= ~m;
+			}
+			if ((sampled & m) && (sampleLow & m) && t - fall[b] < 60) low |= m;
+		}
+		if ((presence & m) && t - rise[b] >= 15 && t - rise[b] < 240) low |= m;
+	}
+	// sampled slots are fully decoded
+	shortSlot &= ~sampled;
+	return ~low;
+}
+
+//
+// OneWireSimUARTPort
+//
+
+OneWireSimUARTPort::OneWireSimUARTPort(OneWireSimBus *b)
+{
+	bus = b;
+	baud = 115200;
+	released = false;
+	releasedAt = 0;
+	clearStats();
+}
+
+// The line went back to the weak pull-up when the last exchange ended;
+// devices see it at that time, not now
+void OneWireSimUARTPort::release(void)
+{
+	if (!released) return;
+	released = false;
+
+	uint64_t now = OneWireSimClock::now();
+	OneWireSimClock::set(releasedAt);
+	bus->pulseRelease();
+	OneWireSimClock::set(now);
+}
+
+uint8_t OneWireSimUARTPort::exchange(const uint8_t *tx, uint8_t *rx, uint8_t n)
+{
+	uint32_t bitNs = 1000000000UL / baud;
+
+	release();
+	exchangeCount++;
+	for (uint8_t i = 0; i < n; i++) {
+		uint8_t v = tx[i];
+		uint8_t lowBits = 1;
+		uint32_t from = 0, to = 0;	// window a device holds low, in ns
+
+		while (lowBits < 9 && !(v & (1 << (lowBits - 1)))) lowBits++;
+		uint32_t lowNs = lowBits * bitNs;
+
+		if (lowNs >= 480000) {
+			// presence: low 30us after the release for 120us
+			if (bus->pulseReset()) {
+				from = lowNs + 30000;
+				to = from + 120000;
+			}
+		} else if (lowNs < 15000) {
+			// a device answering 0 holds the line to about 30us
+			if (!bus->pulseRead()) to = 30000;
+		} else {
+			bus->pulseWrite(0);
+		}
+
+		// data bit k is sampled in the middle of its bit time
+		uint8_t echo = v;
+		for (uint8_t k = 0; k < 8; k++) {
+			uint32_t sample = (2 * k + 3) * bitNs / 2;
+			if (sample >= from && sample < to) echo &= ~(1 << k);
+		}
+		rx[i] = echo;
+		frameCount++;
+		OneWireSimClock::advance(10 * bitNs / 1000);
+	}
+	released = true;
+	releasedAt = OneWireSimClock::now();
+	return n;
+}
+
+void OneWireSimUARTPort::power(bool on)
+{
+	if (on) {
+		// in time for a conversion the last exchange started
+		released = false;
+		bus->pulsePower();
+	} else {
+		release();
+		bus->depower();
+	}
+}
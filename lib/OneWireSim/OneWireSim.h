@@ -0,0 +1,298 @@
+#ifndef OneWireSim_h
+#define OneWireSim_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include <OneWire.h>
+
+// Host-side model of a 1-Wire bus and DS18x20 sensors, used in place of
+// a GPIO pin so OneWire, DallasTemperature and the code above them can
+// run off-target:
+//
+//    OneWireSimBus bus;
+//    OneWireSimDS18x20 probe(DS18B20_FAMILY, 0x1234);
+//    bus.attach(&probe);
+//    OneWire oneWire(&bus);
+//    DallasTemperature sensors(&oneWire);
+//
+// Time is simulated: every reset and slot advances OneWireSimClock by
+// its nominal duration, and the native Arduino shim (native/Arduino.h)
+// runs millis(), micros() and delay() on the same clock, so conversion
+// waits and benchmarks are deterministic and instant.
+//
+// Native builds add the shim to the include path:
+//
+//    build_flags = -DARDUINO=100 -Ilib/OneWireSim/native
+
+// Devices that can be attached to one simulated bus
+#ifndef ONEWIRE_SIM_MAX_DEVICES
+#define ONEWIRE_SIM_MAX_DEVICES 16
+#endif
+
+// Nominal slot durations in microseconds, as driven by OneWire
+#define ONEWIRE_SIM_RESET_US   960
+#define ONEWIRE_SIM_WRITE1_US  65
+#define ONEWIRE_SIM_WRITE0_US  70
+#define ONEWIRE_SIM_READ_US    66
+
+#define DS18S20_FAMILY 0x10
+#define DS18B20_FAMILY 0x28
+
+class OneWireSimClock
+{
+  public:
+    static uint64_t now(void);
+    static void advance(uint32_t us);
+    static void set(uint64_t us);
+};
+
+// One device on a simulated bus.  The base class follows the ROM layer
+// bit by bit (read, match, skip and normal/alarm search) and hands the
+// function layer to the subclass a byte at a time.
+class OneWireSimDevice
+{
+  public:
+    OneWireSimDevice(const uint8_t rom[8]);
+    virtual ~OneWireSimDevice() { }
+
+    const uint8_t *address(void) const { return rom; }
+
+    // Bus events.  busRead() returns the level the device leaves on the
+    // line: 0 when it pulls low, 1 when it releases.
+    void busReset(void);
+    void busWrite(uint8_t v);
+    uint8_t busRead(void);
+
+    // The bus stopped supplying strong pull-up power
+    virtual void powerDropped(void) { }
+
+  protected:
+    uint8_t rom[8];
+
+    // A function command was received after the ROM layer
+    virtual void command(uint8_t cmd) = 0;
+
+    // Further bytes written after the function command
+    virtual void data(uint8_t v) { (void)v; }
+
+    // Whether the function command still takes data bytes, so a read
+    // slot is a write-1 to it rather than a status poll
+    virtual bool receiving(void) { return false; }
+
+    // Level driven in a read slot with nothing queued (status polls)
+    virtual uint8_t statusBit(void) { return 1; }
+
+    // Whether the device answers an alarm search
+    virtual bool alarm(void) { return false; }
+
+    // Queue bytes to be shifted out, LSB first, in the next read slots
+    void send(const uint8_t *bytes, uint8_t n);
+
+  private:
+    enum State { IDLE, ROM_COMMAND, MATCHING, SEARCHING, FUNCTION };
+
+    State state;
+    uint8_t bitIndex;         // bit position within the ROM or byte
+    uint8_t shift;            // byte being received
+    uint8_t searchPhase;      // 0: bit, 1: complement, 2: master's choice
+    bool haveCommand;
+
+    uint8_t out[10];
+    uint8_t outLen;
+    uint8_t outBit;           // next bit to send, counted over out[]
+
+    void romCommand(uint8_t cmd);
+    void receive(uint8_t v);
+    uint8_t romBit(uint8_t i) const { return (rom[i >> 3] >> (i & 7)) & 1; }
+};
+
+// DS18B20 (family 0x28) or DS18S20 (family 0x10) temperature sensor
+class OneWireSimDS18x20 : public OneWireSimDevice
+{
+  public:
+    OneWireSimDS18x20(uint8_t family, uint32_t serial);
+
+    // Temperature latched by the next conversion
+    void setTemperature(float celsius);
+
+    // Parasite powered devices report it to READ POWER SUPPLY and only
+    // complete a conversion if the bus stays strongly pulled up
+    void setParasite(bool parasite) { parasitePower = parasite; }
+
+    // Corrupt the CRC byte of the next n scratchpad reads
+    void injectCrcErrors(uint8_t n) { crcErrors = n; }
+
+    // Conversion time for the configured resolution, in milliseconds
+    uint16_t conversionMillis(void) const;
+
+    uint8_t resolution(void) const;
+    uint32_t conversions(void) const { return conversionCount; }
+    uint32_t failedConversions(void) const { return failedCount; }
+
+    virtual void powerDropped(void);
+
+  protected:
+    virtual void command(uint8_t cmd);
+    virtual void data(uint8_t v);
+    virtual bool receiving(void);
+    virtual uint8_t statusBit(void);
+    virtual bool alarm(void);
+
+  private:
+    uint8_t scratchPad[9];
+    uint8_t eeprom[3];        // TH, TL, configuration
+    int16_t temp16;           // 1/16 degC
+    bool parasitePower;
+    uint8_t crcErrors;
+
+    uint8_t lastCommand;
+    uint8_t dataIndex;
+    uint8_t powerBit;
+
+    bool converting;
+    uint64_t conversionEnd;
+    uint32_t conversionCount;
+    uint32_t failedCount;
+
+    bool isB20(void) const { return rom[0] != DS18S20_FAMILY; }
+    void update(void);
+    void latch(int16_t t16);
+    void storeCrc(void);
+};
+
+// A simulated bus.  SLOT_ACCURATE runs every byte as individual slots
+// through the devices' ROM state machines and advances the clock per
+// slot; BYTE_ACCURATE moves whole bytes and advances the clock once per
+// byte, which is much faster for long benchmarks and gives the same
+// results on the wire.
+class OneWireSimBus : public OneWireTransport
+{
+  public:
+    enum Mode { SLOT_ACCURATE, BYTE_ACCURATE };
+
+    OneWireSimBus(Mode m = SLOT_ACCURATE);
+
+    void setMode(Mode m) { mode = m; }
+
+    // Connect or disconnect a device; both are allowed at any time to
+    // model hot-plugging
+    bool attach(OneWireSimDevice *d);
+    void detach(OneWireSimDevice *d);
+    uint8_t deviceCount(void) const { return count; }
+
+    // The next n resets see no presence pulse
+    void failResets(uint8_t n) { missingPresence = n; }
+
+    // OneWireTransport
+    virtual uint8_t reset(void);
+    virtual void write_bit(uint8_t v);
+    virtual uint8_t read_bit(void);
+    virtual void write(uint8_t v, uint8_t power);
+    virtual uint8_t read(void);
+    virtual void depower(void);
+
+    // Bus events without clock or statistics, for port models that
+    // keep their own time (see OneWireSimMultiBusPort)
+    uint8_t pulseReset(void);
+    void pulseWrite(uint8_t v);
+    uint8_t pulseRead(void);
+    void pulsePower(void) { powered = true; }  // until the next pulse or depower()
+    void pulseRelease(void);                   // left on the weak pull-up
+
+    // Statistics since construction or clearStats()
+    uint32_t resets(void) const { return resetCount; }
+    uint32_t slots(void) const { return slotCount; }
+    uint64_t busMicros(void) const { return busTime; }
+    void clearStats(void);
+
+  private:
+    Mode mode;
+    OneWireSimDevice *devices[ONEWIRE_SIM_MAX_DEVICES];
+    uint8_t count;
+    uint8_t missingPresence;
+    bool powered;
+
+    uint32_t resetCount;
+    uint32_t slotCount;
+    uint64_t busTime;
+
+    void activity(void);
+    void spend(uint32_t us);
+};
+
+// Register port for OneWireMultiBus that drives simulated buses, one per
+// register bit.  Pulse widths are measured on the simulated clock and
+// decoded the way a device would: 240us or more is a reset, under 15us a
+// read or write-1 slot, anything in between a write-0 slot.  Strong
+// pull-up is not modelled on this path.
+class OneWireSimMultiBusPort
+{
+  public:
+    OneWireSimMultiBusPort();
+
+    // Put 'bus' on register bit 'bit'
+    void connect(uint8_t bit, OneWireSimBus *bus);
+
+    void begin(uint32_t mask);
+    void writeLow(uint32_t mask) { outHigh &= ~mask; update(); }
+    void writeHigh(uint32_t mask) { outHigh |= mask; update(); }
+    void modeInput(uint32_t mask) { outEnable &= ~mask; update(); }
+    void modeOutput(uint32_t mask) { outEnable |= mask; update(); }
+    uint32_t read(void);
+    void delayMicros(uint16_t us) { OneWireSimClock::advance(us); }
+    void lock(void) { }
+    void unlock(void) { }
+
+  private:
+    OneWireSimBus *buses[32];
+    uint32_t outHigh;
+    uint32_t outEnable;
+    uint32_t driven;          // lines the master currently holds low
+    uint32_t shortSlot;       // short slot in progress, not yet decoded
+    uint32_t sampled;         // short slot already decoded as a read
+    uint32_t sampleLow;       // devices holding the line low in that read
+    uint32_t presence;        // devices answered the last reset
+    uint64_t fall[32];
+    uint64_t rise[32];
+
+    void update(void);
+};
+
+// UART port for OneWireUART that drives a simulated bus.  Each frame is
+// decoded from the time the UART holds the line low at the current baud
+// rate: the start bit plus the zero data bits below the lowest one.  480us
+// or more is a reset, under 15us a read or write-1 slot, anything in
+// between a write-0 slot.  The echo is what the RX pin would receive, with
+// the bits clear that a device held low when they were sampled.  Frames
+// advance the simulated clock by their length.  The open drain line is
+// left on the weak pull-up after an exchange unless power() follows it,
+// so a parasite conversion started without power fails.
+class OneWireSimUARTPort
+{
+  public:
+    OneWireSimUARTPort(OneWireSimBus *bus);
+
+    void begin(void) { }
+    void setBaud(uint32_t b) { baud = b; }
+    uint8_t exchange(const uint8_t *tx, uint8_t *rx, uint8_t n);
+    void power(bool on);
+
+    // Statistics since construction or clearStats()
+    uint32_t frames(void) const { return frameCount; }
+    uint32_t exchanges(void) const { return exchangeCount; }
+    void clearStats(void) { frameCount = 0; exchangeCount = 0; }
+
+  private:
+    OneWireSimBus *bus;
+    uint32_t baud;
+    uint32_t frameCount;
+    uint32_t exchangeCount;
+    bool released;            // nothing powered the line since an exchange
+    uint64_t releasedAt;      // end of that exchange
+
+    void release(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireSim_h
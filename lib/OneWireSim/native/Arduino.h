@@ -0,0 +1,41 @@
+#ifndef OneWireSim_Arduino_h
+#define OneWireSim_Arduino_h
+
+// Minimal Arduino API for native builds against the OneWire simulator.
+// Time runs on OneWireSimClock; the pin functions are inert because the
+// bus traffic goes through OneWireSimBus instead of a pin.  Implemented
+// in OneWireSim.cpp.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define ONEWIRE_SIM_NATIVE 1
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+#define LOW    0x0
+#define HIGH   0x1
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+#define noInterrupts()
+#define interrupts()
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+#endif // OneWireSim_Arduino_h
@@ -6,6 +6,7 @@
 #include <Arduino.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
+#include <DallasHealth.h>
 #include <WiFi.h>
 #include <NTPClient.h>
 #include <WiFiUdp.h>
@@ -16,7 +17,7 @@
 #include <SPI.h>
 
 // Function Prototypes
-void getReadings();
+bool getReadings();
 void getTimeStamp();
 void logSDCard();
 void writeFile(fs::FS &fs, const char *path, const char *message);
@@ -35,10 +36,13 @@ uint64_t TIME_TO_SLEEP = 600;
 // Save reading number on RTC memory
 RTC_DATA_ATTR int readingID = 0;
 
-String dataMessage;
+char dataMessage[64];
 
 unsigned long lastExecutionTime = 0;
 
+// A conversion started by the scheduler is still running
+bool converting = false;
+
 unsigned long startMillis;
 const unsigned long sleepDuration = 100000; // 5 minutes in milliseconds
 
@@ -48,7 +52,27 @@ OneWire oneWire(oneWireBus);
 // Pass our oneWire reference to Dallas Temperature sensor
 DallasTemperature sensors(&oneWire);
 
-float currentTemperature = 0.0;
+// Retries, plausibility filters and quarantine for every reading, so
+// disconnected sensors and the 85C power-on value never get logged
+DallasHealth health(&sensors);
+
+// Copy of every sensor's health, taken by loop() after each read. /health
+// is served on the AsyncTCP task, which must not touch the bus or the
+// tables loop() is updating, so it only prints this copy under healthLock.
+struct SensorHealth
+{
+  DeviceAddress address;
+  DallasHealth::health_t health;
+};
+SensorHealth healthSnapshot[DALLAS_MAX_DEVICES];
+uint8_t healthSnapshotCount = 0;
+SemaphoreHandle_t healthLock;
+
+// Last healthy temperature in 1/128 degrees Celsius, the sensor's raw
+// format, DEVICE_DISCONNECTED_RAW until the first one. It stays an integer
+// all the way to the SD card and the clients; text is only produced where
+// it is needed, so logged values are exact.
+int32_t currentTemperature = DEVICE_DISCONNECTED_RAW;
 
 // Getting time
 WiFiUDP ntpUDP;
@@ -79,30 +103,107 @@ void configureButtonWakeup()
 }
 
 /**
- * @brief Read the temperature from the DS18B20 sensor and return it as a string.
- * @return String representation of the current temperature.
+ * @brief Format the last healthy DS18B20 temperature as text.
+ *
+ * The bus is only read by getReadings(), so every value served here went
+ * through the health checks.
+ * @param buf Buffer of at least 16 characters for the temperature in degrees Celsius.
+ * @return buf, or nullptr if there is no healthy reading yet.
  */
-String readBME280Temperature()
+const char *readBME280Temperature(char *buf)
 {
-  // Read temperature as Celsius (the default)
-  float t = sensors.getTempCByIndex(0);
-  if (isnan(t))
+  if (currentTemperature == DEVICE_DISCONNECTED_RAW)
   {
-    Serial.println("Failed to read from DS18B20 sensor!");
+    return nullptr;
   }
-  else
+  DallasTemperature::rawToDecimal(currentTemperature, buf);
+  return buf;
+}
+
+/**
+ * @brief Copy the health of every sensor for /health.
+ *
+ * Runs in loop() between conversions, while it owns the bus.
+ */
+void snapshotHealth()
+{
+  SensorHealth snapshot[DALLAS_MAX_DEVICES];
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < sensors.getDeviceCount() && count < DALLAS_MAX_DEVICES; i++)
   {
-    currentTemperature = t; // Update the current temperature
+    if (sensors.getAddress(snapshot[count].address, i) &&
+        health.getHealth(snapshot[count].address, snapshot[count].health))
+    {
+      count++;
+    }
   }
-  return String(currentTemperature);
+  xSemaphoreTake(healthLock, portMAX_DELAY);
+  memcpy(healthSnapshot, snapshot, count * sizeof(SensorHealth));
+  healthSnapshotCount = count;
+  xSemaphoreGive(healthLock);
+}
+
+/**
+ * @brief Serve the health of every sensor as JSON.
+ *
+ * Only the copy taken by snapshotHealth() is read, never the bus.
+ * @param request The /health request.
+ */
+void sendHealth(AsyncWebServerRequest *request)
+{
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  const char *separator = "";
+  response->print("[");
+  xSemaphoreTake(healthLock, portMAX_DELAY);
+  for (uint8_t i = 0; i < healthSnapshotCount; i++)
+  {
+    const uint8_t *address = healthSnapshot[i].address;
+    const DallasHealth::health_t &h = healthSnapshot[i].health;
+    char temperature[16];
+    DallasTemperature::rawToDecimal(h.lastGood, temperature);
+    response->printf("%s{\"address\":\"%02X%02X%02X%02X%02X%02X%02X%02X\",\"temperature\":%s,"
+                     "\"quarantined\":%s,\"score\":%u,\"cycles\":%u,\"crcErrors\":%u,"
+                     "\"disconnects\":%u,\"retries\":%u,\"sentinels\":%u,\"outliers\":%u,"
+                     "\"quarantines\":%u}",
+                     separator,
+                     address[0], address[1], address[2], address[3],
+                     address[4], address[5], address[6], address[7],
+                     h.lastGood == DEVICE_DISCONNECTED_RAW ? "null" : temperature,
+                     h.quarantined ? "true" : "false", h.score, (unsigned)h.cycles,
+                     (unsigned)h.crcErrors, (unsigned)h.disconnects, (unsigned)h.retries,
+                     (unsigned)h.sentinels, (unsigned)h.outliers, (unsigned)h.quarantines);
+    separator = ",";
+  }
+  xSemaphoreGive(healthLock);
+  response->print("]");
+  request->send(response);
+}
+
+/**
+ * @brief Serve the conversion windows of the last measurement cycle as JSON.
+ * @param request The /conversion request.
+ */
+void sendConversionStats(AsyncWebServerRequest *request)
+{
+  DallasTemperature::conversionStats_t stats;
+  sensors.getConversionStats(stats);
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->printf("{\"windows\":%u,\"expectedMillis\":%u,\"actualMillis\":%u,"
+                   "\"worstOverrun\":%u,\"totalMillis\":%u,\"notConverted\":%u}",
+                   stats.windows, (unsigned)stats.expectedMillis, (unsigned)stats.actualMillis,
+                   (unsigned)stats.worstOverrun, (unsigned)stats.totalMillis, stats.notConverted);
+  request->send(response);
 }
 
 /**
  * @brief Send the current temperature to WebSocket clients.
+ *
+ * Clients get the raw 1/128 degrees Celsius value and scale it themselves.
  */
 void sendTemperatureToClients()
 {
-  String temperatureData = String(currentTemperature);
+  char temperatureData[12];
+  ltoa(currentTemperature, temperatureData, 10);
   ws.textAll(temperatureData);
 }
 
@@ -193,6 +294,7 @@ void setup()
 
   // Start the DS18B20 sensor
   sensors.begin();
+  healthLock = xSemaphoreCreateMutex();
 
   // Initialize SPIFFS
   if (!SPIFFS.begin())
@@ -245,7 +347,19 @@ void setup()
   server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
             { request->send(SPIFFS, "/index.html"); });
   server.on("/temperature", HTTP_GET, [](AsyncWebServerRequest *request)
-            { request->send_P(200, "text/plain", readBME280Temperature().c_str()); });
+            {
+              char temperature[16];
+              if (readBME280Temperature(temperature))
+              {
+                request->send(200, "text/plain", temperature);
+              }
+              else
+              {
+                request->send(503, "text/plain", "No valid reading");
+              }
+            });
+  server.on("/health", HTTP_GET, sendHealth);
+  server.on("/conversion", HTTP_GET, sendConversionStats);
   server.on("/downloaddata", HTTP_GET, [](AsyncWebServerRequest *request)
             {
               // Open the "data.csv" file for reading from the SD card
@@ -325,28 +439,50 @@ void loop()
     esp_deep_sleep_start();
   }
   // Check if 10 seconds have passed since the last execution
-  if (millis() - lastExecutionTime >= 10000)
+  if (!converting && millis() - lastExecutionTime >= 10000)
   {
-    // 10 seconds have passed, so execute your code
-    getReadings();
-    getTimeStamp();
-    logSDCard();
-
+    // 10 seconds have passed, start a conversion without blocking the
+    // loop; the scheduler holds the parasite power pull-up meanwhile
+    converting = sensors.startConversion();
     // Update the last execution time
     lastExecutionTime = millis();
   }
+  if (converting && sensors.runConversion())
+  {
+    converting = false;
+    // Only healthy readings are stored
+    if (getReadings())
+    {
+      getTimeStamp();
+      logSDCard();
+    }
+  }
 }
 
 /**
- * @brief Get temperature readings from the DS18B20 sensor.
+ * @brief Get temperature readings from the DS18B20 sensor once a conversion is done.
+ * @return true if the sensor gave a healthy reading.
  */
-void getReadings()
+bool getReadings()
 {
-  sensors.requestTemperatures();
-  currentTemperature = sensors.getTempCByIndex(0); // Temperature in Celsius
+  // Every sensor is read each cycle, so what gets logged and sent is this
+  // cycle's value. Alarm driven reads (readByAlarm) only pay off on large
+  // buses and would repeat a stale value here with a fresh timestamp.
+  DallasTemperature::reading_t readings[DALLAS_MAX_DEVICES];
+  health.read(readings, DALLAS_MAX_DEVICES);
+  snapshotHealth();
+  if (sensors.getDeviceCount() == 0 || readings[0].status != DALLAS_READ_OK)
+  {
+    Serial.println("Failed to read from DS18B20 sensor!");
+    return false;
+  }
+  currentTemperature = readings[0].raw; // Temperature in 1/128 degrees Celsius
+  char temperature[16];
+  DallasTemperature::rawToDecimal(currentTemperature, temperature);
   Serial.print("Temperature: ");
-  Serial.println(currentTemperature);
+  Serial.println(temperature);
   sendTemperatureToClients(); // sends temperature to clients
+  return true;
 }
 
 /**
@@ -434,9 +570,12 @@ void logSDCard()
 {
   // Increment readingID on every new reading
   readingID++;
-  dataMessage = String(readingID) + "," + String(dayStamp) + "," + String(timeStamp) + "," +
-                String(currentTemperature) + "\r\n";
+  // Four decimals hold every sensor step (1/16 degree) exactly
+  char temperature[16];
+  DallasTemperature::rawToDecimal(currentTemperature, temperature, 4);
+  snprintf(dataMessage, sizeof(dataMessage), "%d,%s,%s,%s\r\n",
+           readingID, dayStamp.c_str(), timeStamp.c_str(), temperature);
   Serial.print("Save data: ");
   Serial.println(dataMessage);
-  appendFile(SD, "/data.txt", dataMessage.c_str());
+  appendFile(SD, "/data.txt", dataMessage);
 }
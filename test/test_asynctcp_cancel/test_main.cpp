@@ -0,0 +1,188 @@
+// Queued events of a closed client cancelled by its event token, and the
+// CLEAR scan of clients without one (pio test -e native_asynctcp)
+
+#include <unity.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <AsyncTCPSim.h>
+#include <AsyncTCP.h>
+
+static AsyncServer *server;
+static AsyncClient *accepted;
+static volatile bool gate;
+
+static AsyncClient *acceptClient(tcp_pcb *pcb)
+{
+	__atomic_store_n(&accepted, (AsyncClient *)NULL, __ATOMIC_RELEASE);
+	AsyncTCPSim::accept(pcb);
+	while (!__atomic_load_n(&accepted, __ATOMIC_ACQUIRE)) AsyncTCPSim::settle(1);
+	return accepted;
+}
+
+static void onClient(void *, AsyncClient *c)
+{
+	__atomic_store_n(&accepted, c, __ATOMIC_RELEASE);
+}
+
+// Holds the async task in a sent handler until 'gate' opens
+static void stallTask(AsyncClient *client, tcp_pcb *pcb)
+{
+	client->onAck([](void *, AsyncClient *, size_t, uint32_t) {
+		while (!gate) AsyncTCPSim::settle(1);
+	}, NULL);
+	gate = false;
+	AsyncTCPSim::ack(pcb, 1);
+	AsyncTCPSim::settle();
+}
+
+void setUp(void)
+{
+	gate = true;
+}
+
+void tearDown(void)
+{
+	gate = true;
+	AsyncTCPSim::settle();
+}
+
+void test_close_cancels_queued_events(void)
+{
+	tcp_pcb *pa = AsyncTCPSim::newPcb();
+	tcp_pcb *pb = AsyncTCPSim::newPcb();
+	AsyncClient *a = acceptClient(pa);
+	AsyncClient *b = acceptClient(pb);
+	uint32_t dataA = 0, dataB = 0, discarded = 0;
+	int32_t pbufs = AsyncTCPSim::livePbufs();
+	async_queue_stats_t before, after;
+	async_event_pool_stats_t pool;
+
+	TEST_ASSERT_NOT_EQUAL(-1, a->eventToken());
+	a->onData([&](void *, AsyncClient *, void *, size_t len) { dataA += len; }, NULL);
+	b->onData([&](void *, AsyncClient *, void *, size_t len) { dataB += len; }, NULL);
+	a->onDisconnect([&](void *, AsyncClient *c) {
+		discarded++;
+		delete c;
+	}, NULL);
+
+	stallTask(b, pb);
+	asyncTcpQueueStats(&before);
+	for (int i = 0; i < 3; i++) AsyncTCPSim::receive(pa, 100);
+	{
+		AsyncTCPSim::Lock lwip;
+		AsyncTCPSimPcb &cb = AsyncTCPSim::callbacks(pa);
+		cb.poll(cb.arg, pa);
+		cb.sent(cb.arg, pa, 5);
+	}
+	AsyncTCPSim::receive(pb, 50);
+
+	// closed from the loop task while a's events wait behind b's handler
+	a->close();
+	gate = true;
+	AsyncTCPSim::settle();
+	asyncTcpQueueStats(&after);
+	asyncTcpEventPoolStats(&pool);
+
+	TEST_ASSERT_EQUAL_UINT32(0, dataA);
+	TEST_ASSERT_EQUAL_UINT32(50, dataB);
+	TEST_ASSERT_EQUAL_UINT32(1, discarded);
+	TEST_ASSERT_EQUAL_UINT32(5, after.cancelled - before.cancelled);
+	TEST_ASSERT_EQUAL_INT32(pbufs, AsyncTCPSim::livePbufs());
+	TEST_ASSERT_EQUAL_UINT32(0, pool.in_use);
+}
+
+void test_churn_leaves_other_clients_alone(void)
+{
+	tcp_pcb *pb = AsyncTCPSim::newPcb();
+	AsyncClient *b = acceptClient(pb);
+	uint32_t dataB = 0;
+	int32_t pbufs = AsyncTCPSim::livePbufs();
+	async_event_pool_stats_t pool;
+
+	b->onData([&](void *, AsyncClient *, void *, size_t len) { dataB += len; }, NULL);
+	for (int i = 0; i < 200; i++) {
+		tcp_pcb *pcb = AsyncTCPSim::newPcb();
+		AsyncClient *c = acceptClient(pcb);
+		AsyncTCPSim::receive(pcb, 10);
+		AsyncTCPSim::receive(pb, 1);
+		c->onDisconnect([](void *, AsyncClient *c) { delete c; }, NULL);
+		c->close();
+	}
+	AsyncTCPSim::settle();
+	asyncTcpEventPoolStats(&pool);
+
+	TEST_ASSERT_EQUAL_UINT32(200, dataB);
+	TEST_ASSERT_EQUAL_INT32(pbufs, AsyncTCPSim::livePbufs());
+	TEST_ASSERT_EQUAL_UINT32(0, pool.in_use);
+}
+
+// A client that got no token is cleared by a CLEAR scan of the queue.
+// With the queue full the CLEAR and a new accept wait in the front list;
+// the events the scan keeps must still run after that accept
+void test_clear_scan_keeps_front_order(void)
+{
+	std::vector<AsyncClient *> holders;
+	static std::mutex logLock;
+	static std::string log;
+	tcp_pcb *pa = AsyncTCPSim::newPcb();
+	tcp_pcb *pb = AsyncTCPSim::newPcb();
+	tcp_pcb *px = AsyncTCPSim::newPcb();
+	AsyncClient *a, *b, *x;
+	std::string expected = "accept ";
+
+	do holders.push_back(acceptClient(AsyncTCPSim::newPcb()));
+	while (holders.back()->eventToken() != -1);
+	a = acceptClient(pa);
+	b = acceptClient(pb);
+	x = acceptClient(px);
+	TEST_ASSERT_EQUAL(-1, b->eventToken());
+	TEST_ASSERT_EQUAL(-1, x->eventToken());
+
+	log.clear();
+	server->onClient([](void *, AsyncClient *c) {
+		std::lock_guard<std::mutex> held(logLock);
+		log += "accept ";
+		onClient(NULL, c);
+	}, NULL);
+	b->onData([](void *, AsyncClient *, void *, size_t len) {
+		std::lock_guard<std::mutex> held(logLock);
+		log += "b" + std::to_string(len) + " ";
+	}, NULL);
+	x->onData([](void *, AsyncClient *, void *, size_t len) {
+		std::lock_guard<std::mutex> held(logLock);
+		log += "x" + std::to_string(len) + " ";
+	}, NULL);
+
+	stallTask(a, pa);
+	for (int i = 0; i < CONFIG_ASYNC_TCP_QUEUE_SIZE; i++) {
+		TEST_ASSERT_EQUAL(ERR_OK, AsyncTCPSim::receive(i % 2 ? px : pb, 10 + i));
+		if (i % 2 == 0) expected += "b" + std::to_string(10 + i) + " ";
+	}
+	x->close();
+	{
+		AsyncTCPSim::Lock lwip;
+		AsyncTCPSimPcb &cb = AsyncTCPSim::callbacks(AsyncTCPSim::listener());
+		cb.accept(cb.arg, AsyncTCPSim::newPcb(), ERR_OK);
+	}
+	gate = true;
+	AsyncTCPSim::settle();
+
+	std::lock_guard<std::mutex> held(logLock);
+	TEST_ASSERT_EQUAL_STRING(expected.c_str(), log.c_str());
+	server->onClient(onClient, NULL);
+}
+
+int main(int argc, char **argv)
+{
+	// lives as long as the process, like a sketch's
+	server = new AsyncServer(80);
+	server->onClient(onClient, NULL);
+	server->begin();
+
+	UNITY_BEGIN();
+	RUN_TEST(test_close_cancels_queued_events);
+	RUN_TEST(test_churn_leaves_other_clients_alone);
+	RUN_TEST(test_clear_scan_keeps_front_order);
+	return UNITY_END();
+}
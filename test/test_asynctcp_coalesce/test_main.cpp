@@ -0,0 +1,142 @@
+// Sent and poll events merged per client while the async task is busy
+// (pio test -e native_asynctcp)
+
+#include <unity.h>
+#include <AsyncTCPSim.h>
+#include <AsyncTCP.h>
+
+static AsyncClient *accepted;
+static volatile bool gate;
+
+static AsyncClient *acceptClient(tcp_pcb *pcb)
+{
+	__atomic_store_n(&accepted, (AsyncClient *)NULL, __ATOMIC_RELEASE);
+	AsyncTCPSim::accept(pcb);
+	while (!__atomic_load_n(&accepted, __ATOMIC_ACQUIRE)) AsyncTCPSim::settle(1);
+	return accepted;
+}
+
+void setUp(void)
+{
+	gate = true;
+}
+
+void tearDown(void)
+{
+	gate = true;
+	AsyncTCPSim::settle();
+}
+
+void test_sent_and_poll_merge(void)
+{
+	tcp_pcb *pcb = AsyncTCPSim::newPcb();
+	AsyncClient *client = acceptClient(pcb);
+	AsyncTCPSimPcb &cb = AsyncTCPSim::callbacks(pcb);
+	uint32_t acked = 0, ackCalls = 0, polls = 0;
+	async_queue_stats_t before, after;
+
+	client->onAck([&](void *, AsyncClient *, size_t len, uint32_t) {
+		while (!gate) AsyncTCPSim::settle(1);
+		acked += len;
+		ackCalls++;
+	}, NULL);
+	client->onPoll([&](void *, AsyncClient *) { polls++; }, NULL);
+
+	// the first sent holds the task in its handler
+	gate = false;
+	AsyncTCPSim::ack(pcb, 1);
+	AsyncTCPSim::settle();
+	asyncTcpQueueStats(&before);
+	{
+		AsyncTCPSim::Lock lwip;
+		for (int i = 0; i < 100; i++) cb.sent(cb.arg, pcb, 100);
+		for (int i = 0; i < 50; i++) cb.poll(cb.arg, pcb);
+		// each of these would overflow the 16 bit length of the last one
+		for (int i = 0; i < 10; i++) cb.sent(cb.arg, pcb, 60000);
+		// never merged, and ignored by the task
+		cb.sent(NULL, pcb, 5);
+		cb.poll(NULL, pcb);
+	}
+	gate = true;
+	AsyncTCPSim::settle();
+	asyncTcpQueueStats(&after);
+
+	TEST_ASSERT_EQUAL_UINT32(1 + 100 * 100 + 10 * 60000, acked);
+	TEST_ASSERT_EQUAL_UINT32(1 + 1 + 10, ackCalls);
+	TEST_ASSERT_EQUAL_UINT32(1, polls);
+	TEST_ASSERT_EQUAL_UINT32(99, after.sent_merged - before.sent_merged);
+	TEST_ASSERT_EQUAL_UINT32(49, after.poll_dropped - before.poll_dropped);
+	TEST_ASSERT_EQUAL_UINT32(11 + 1 + 2, after.handled - before.handled);
+
+	// with the event handled, the next poll is queued again
+	{
+		AsyncTCPSim::Lock lwip;
+		cb.poll(cb.arg, pcb);
+	}
+	AsyncTCPSim::settle();
+	TEST_ASSERT_EQUAL_UINT32(2, polls);
+}
+
+void test_closed_client_forgets_merged_events(void)
+{
+	tcp_pcb *stall = AsyncTCPSim::newPcb();
+	tcp_pcb *pcb = AsyncTCPSim::newPcb();
+	AsyncClient *staller = acceptClient(stall);
+	AsyncClient *client = acceptClient(pcb);
+	AsyncTCPSimPcb &cb = AsyncTCPSim::callbacks(pcb);
+	uint32_t lateAcks = 0;
+	bool discarded = false;
+	async_event_pool_stats_t pool;
+
+	staller->onAck([](void *, AsyncClient *, size_t, uint32_t) {
+		while (!gate) AsyncTCPSim::settle(1);
+	}, NULL);
+	client->onAck([&](void *, AsyncClient *, size_t, uint32_t) { lateAcks++; }, NULL);
+	client->onDisconnect([&](void *, AsyncClient *c) {
+		discarded = true;
+		delete c;
+	}, NULL);
+
+	gate = false;
+	AsyncTCPSim::ack(stall, 1);
+	AsyncTCPSim::settle();
+	{
+		AsyncTCPSim::Lock lwip;
+		cb.sent(cb.arg, pcb, 10);
+		cb.sent(cb.arg, pcb, 10);
+		cb.poll(cb.arg, pcb);
+	}
+	client->close();
+	gate = true;
+	AsyncTCPSim::settle();
+
+	TEST_ASSERT_TRUE(discarded);
+	TEST_ASSERT_EQUAL_UINT32(0, lateAcks);
+
+	// the sent of the next client is queued, not merged into a stale entry
+	tcp_pcb *next = AsyncTCPSim::newPcb();
+	AsyncClient *fresh = acceptClient(next);
+	uint32_t acked = 0;
+	fresh->onAck([&](void *, AsyncClient *, size_t len, uint32_t) { acked += len; }, NULL);
+	AsyncTCPSim::ack(next, 7);
+	AsyncTCPSim::settle();
+	TEST_ASSERT_EQUAL_UINT32(7, acked);
+
+	asyncTcpEventPoolStats(&pool);
+	TEST_ASSERT_EQUAL_UINT32(0, pool.in_use);
+}
+
+int main(int argc, char **argv)
+{
+	// lives as long as the process, like a sketch's
+	AsyncServer *server = new AsyncServer(80);
+	server->onClient([](void *, AsyncClient *c) {
+		__atomic_store_n(&accepted, c, __ATOMIC_RELEASE);
+	}, NULL);
+	server->begin();
+
+	UNITY_BEGIN();
+	RUN_TEST(test_sent_and_poll_merge);
+	RUN_TEST(test_closed_client_forgets_merged_events);
+	return UNITY_END();
+}
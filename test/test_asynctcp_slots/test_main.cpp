@@ -0,0 +1,122 @@
+// Closed slots claimed from a bitmap, with handles that a later holder of
+// the same slot does not share (pio test -e native_asynctcp)
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include <AsyncTCPSim.h>
+#include <AsyncTCP.h>
+
+// A client on a pcb of the stand-in, with its slot in reach
+class Peek : public AsyncClient
+{
+  public:
+	Peek(tcp_pcb *pcb) : AsyncClient(pcb), pcb(pcb) {}
+
+	tcp_pcb *pcb;
+	int32_t slot() { return _closed_slot; }
+	void setSlot(int32_t handle) { _closed_slot = handle; }
+	void freeSlot() { _free_closed_slot(); }
+	int8_t fin() { return _lwip_fin(pcb, ERR_OK); }
+};
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+	AsyncTCPSim::settle();
+}
+
+void test_stale_handle_is_rejected(void)
+{
+	Peek *a = new Peek(AsyncTCPSim::newPcb());
+	int32_t stale = a->slot();
+	TEST_ASSERT_NOT_EQUAL(-1, stale);
+
+	// the slot is freed and claimed by the next client, while a call of
+	// the first one could still be queued
+	a->freeSlot();
+	Peek *b = new Peek(AsyncTCPSim::newPcb());
+	TEST_ASSERT_EQUAL_INT32(stale & 0xFFFF, b->slot() & 0xFFFF);
+	TEST_ASSERT_NOT_EQUAL(stale, b->slot());
+
+	a->setSlot(stale);
+	TEST_ASSERT_EQUAL(0, a->write("stale"));
+	TEST_ASSERT_EQUAL(0, AsyncTCPSim::written(a->pcb).size());
+	TEST_ASSERT_EQUAL(4, b->write("live"));
+	TEST_ASSERT_EQUAL(4, AsyncTCPSim::written(b->pcb).size());
+
+	// freeing the stale handle leaves the slot to its holder
+	a->freeSlot();
+	TEST_ASSERT_EQUAL(4, b->write("live"));
+	TEST_ASSERT_EQUAL(8, AsyncTCPSim::written(b->pcb).size());
+	Peek *c = new Peek(AsyncTCPSim::newPcb());
+	TEST_ASSERT_NOT_EQUAL(b->slot() & 0xFFFF, c->slot() & 0xFFFF);
+
+	delete a;
+	delete b;
+	delete c;
+}
+
+// _lwip_fin() and the destructor both free the slot, the second one finds
+// it gone; then every slot has one holder and the client past them none
+void test_slots_run_out_once(void)
+{
+	std::vector<Peek *> clients;
+	int32_t without = 0;
+	std::vector<bool> taken(CONFIG_LWIP_MAX_ACTIVE_TCP, false);
+
+	Peek *closed = new Peek(AsyncTCPSim::newPcb());
+	{
+		AsyncTCPSim::Lock lwip;
+		TEST_ASSERT_EQUAL(ERR_OK, closed->fin());
+	}
+	TEST_ASSERT_EQUAL_INT32(-1, closed->slot());
+	delete closed;
+
+	for (int i = 0; i <= CONFIG_LWIP_MAX_ACTIVE_TCP; i++) clients.push_back(new Peek(AsyncTCPSim::newPcb()));
+	for (Peek *c : clients) {
+		if (c->slot() == -1) {
+			without++;
+			continue;
+		}
+		TEST_ASSERT_FALSE(taken[c->slot() & 0xFFFF]);
+		taken[c->slot() & 0xFFFF] = true;
+	}
+	TEST_ASSERT_EQUAL_INT32(1, without);
+	for (Peek *c : clients) delete c;
+}
+
+void test_construct_and_destroy_time(void)
+{
+	const int count = 10000;
+	std::vector<tcp_pcb *> pcbs;
+	char message[80];
+
+	for (int i = 0; i < count; i++) pcbs.push_back(AsyncTCPSim::newPcb());
+	auto start = std::chrono::steady_clock::now();
+	for (tcp_pcb *pcb : pcbs) delete new Peek(pcb);
+	auto took = std::chrono::steady_clock::now() - start;
+
+	// the close each destructor makes is part of it, so this is the host's
+	// cost of a client, not of its slot alone
+	snprintf(message, sizeof(message), "%d slots: %lld ns per client", CONFIG_LWIP_MAX_ACTIVE_TCP,
+			 (long long)(std::chrono::duration_cast<std::chrono::nanoseconds>(took).count() / count));
+	TEST_MESSAGE(message);
+
+	Peek *c = new Peek(AsyncTCPSim::newPcb());
+	TEST_ASSERT_NOT_EQUAL(-1, c->slot());
+	delete c;
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_stale_handle_is_rejected);
+	RUN_TEST(test_slots_run_out_once);
+	RUN_TEST(test_construct_and_destroy_time);
+	return UNITY_END();
+}
@@ -0,0 +1,157 @@
+// The async task feeding the task WDT once per batch of events instead of
+// subscribing around each one (pio test -e native_asynctcp)
+
+#include <unity.h>
+#include <stdio.h>
+#include <thread>
+#include <AsyncTCPSim.h>
+#include <AsyncTCP.h>
+
+static AsyncClient *accepted;
+static volatile bool gate;
+static volatile bool stalled;
+static uint32_t received;
+
+static AsyncClient *acceptClient(tcp_pcb *pcb)
+{
+	__atomic_store_n(&accepted, (AsyncClient *)NULL, __ATOMIC_RELEASE);
+	AsyncTCPSim::accept(pcb);
+	while (!__atomic_load_n(&accepted, __ATOMIC_ACQUIRE)) AsyncTCPSim::settle(1);
+	return accepted;
+}
+
+static void countData(void *, AsyncClient *, void *, size_t)
+{
+	__atomic_fetch_add(&received, 1, __ATOMIC_RELAXED);
+}
+
+// Holds the async task in a sent handler until 'gate' opens, well under
+// the handler budget so the batch goes on after it
+static void stallTask(AsyncClient *client, tcp_pcb *pcb)
+{
+	client->onAck([](void *, AsyncClient *, size_t, uint32_t) {
+		stalled = true;
+		while (!gate) AsyncTCPSim::settle(1);
+	}, NULL);
+	gate = false;
+	stalled = false;
+	AsyncTCPSim::ack(pcb, 1);
+	while (!stalled) AsyncTCPSim::settle(1);
+}
+
+static void waitReceived(uint32_t count)
+{
+	while (__atomic_load_n(&received, __ATOMIC_RELAXED) < count) AsyncTCPSim::settle(1);
+}
+
+void setUp(void)
+{
+	gate = true;
+	__atomic_store_n(&received, 0, __ATOMIC_RELAXED);
+}
+
+void tearDown(void)
+{
+	gate = true;
+	AsyncTCPSim::settle();
+}
+
+void test_events_are_fed_per_batch(void)
+{
+	tcp_pcb *pcb = AsyncTCPSim::newPcb();
+	AsyncClient *client = acceptClient(pcb);
+	uint32_t adds = AsyncTCPSim::wdtAdds();
+	uint32_t deletes = AsyncTCPSim::wdtDeletes();
+	uint32_t resets;
+	async_queue_stats_t before, after;
+
+	client->onData(countData, NULL);
+	stallTask(client, pcb);
+	resets = AsyncTCPSim::wdtResets();
+	asyncTcpQueueStats(&before);
+	for (int i = 0; i < 2 * CONFIG_ASYNC_TCP_EVENT_BATCH; i++) AsyncTCPSim::receive(pcb, 10);
+	gate = true;
+	waitReceived(2 * CONFIG_ASYNC_TCP_EVENT_BATCH);
+	AsyncTCPSim::settle();
+	asyncTcpQueueStats(&after);
+
+	// the stalled event, counted already, opens the first batch and the
+	// last receive is alone
+	TEST_ASSERT_EQUAL_UINT32(2 * CONFIG_ASYNC_TCP_EVENT_BATCH, after.handled - before.handled);
+	TEST_ASSERT_EQUAL_UINT32(3, after.batches - before.batches);
+	TEST_ASSERT_EQUAL_UINT32(3, AsyncTCPSim::wdtResets() - resets);
+	TEST_ASSERT_EQUAL_UINT32(0, AsyncTCPSim::wdtAdds() - adds);
+	TEST_ASSERT_EQUAL_UINT32(0, AsyncTCPSim::wdtDeletes() - deletes);
+}
+
+void test_slow_handler_ends_the_batch(void)
+{
+	tcp_pcb *pcb = AsyncTCPSim::newPcb();
+	tcp_pcb *slowPcb = AsyncTCPSim::newPcb();
+	AsyncClient *client = acceptClient(pcb);
+	AsyncClient *slow = acceptClient(slowPcb);
+	uint32_t resets;
+	async_queue_stats_t before, after;
+
+	client->onData(countData, NULL);
+	slow->onData([](void *, AsyncClient *, void *, size_t) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(CONFIG_ASYNC_TCP_EVENT_BUDGET_MS + 50));
+	}, NULL);
+	stallTask(client, pcb);
+	resets = AsyncTCPSim::wdtResets();
+	asyncTcpQueueStats(&before);
+	AsyncTCPSim::receive(slowPcb, 10);
+	AsyncTCPSim::receive(pcb, 10);
+	AsyncTCPSim::receive(pcb, 10);
+	gate = true;
+	waitReceived(2);
+	AsyncTCPSim::settle();
+	asyncTcpQueueStats(&after);
+
+	// the WDT is fed after the slow handler, before the events behind it
+	TEST_ASSERT_EQUAL_UINT32(3, after.handled - before.handled);
+	TEST_ASSERT_EQUAL_UINT32(1, after.slow_events - before.slow_events);
+	TEST_ASSERT_EQUAL_UINT32(2, after.batches - before.batches);
+	TEST_ASSERT_EQUAL_UINT32(2, AsyncTCPSim::wdtResets() - resets);
+	TEST_ASSERT_GREATER_OR_EQUAL(CONFIG_ASYNC_TCP_EVENT_BUDGET_MS * 1000, after.max_handler_us);
+}
+
+void test_burst_feeds(void)
+{
+	tcp_pcb *pcb = AsyncTCPSim::newPcb();
+	AsyncClient *client = acceptClient(pcb);
+	uint32_t adds = AsyncTCPSim::wdtAdds();
+	uint32_t deletes = AsyncTCPSim::wdtDeletes();
+	uint32_t resets = AsyncTCPSim::wdtResets();
+	const uint32_t events = 20000;
+	char message[80];
+
+	client->onData(countData, NULL);
+	for (uint32_t sent = 0; sent < events; sent += CONFIG_ASYNC_TCP_EVENT_BATCH) {
+		for (int i = 0; i < CONFIG_ASYNC_TCP_EVENT_BATCH; i++) AsyncTCPSim::receive(pcb, 1);
+		waitReceived(sent + CONFIG_ASYNC_TCP_EVENT_BATCH);
+	}
+
+	// how many bursts a wakeup catches whole depends on the host
+	snprintf(message, sizeof(message), "%u events in bursts of %d: %u feeds", (unsigned)events,
+			 CONFIG_ASYNC_TCP_EVENT_BATCH, (unsigned)(AsyncTCPSim::wdtResets() - resets));
+	TEST_MESSAGE(message);
+	TEST_ASSERT_EQUAL_UINT32(0, AsyncTCPSim::wdtAdds() - adds);
+	TEST_ASSERT_EQUAL_UINT32(0, AsyncTCPSim::wdtDeletes() - deletes);
+}
+
+int main(int argc, char **argv)
+{
+	// lives as long as the process, like a sketch's
+	AsyncServer *server = new AsyncServer(80);
+	server->onClient([](void *, AsyncClient *c) {
+		__atomic_store_n(&accepted, c, __ATOMIC_RELEASE);
+	}, NULL);
+	server->begin();
+
+	UNITY_BEGIN();
+	RUN_TEST(test_events_are_fed_per_batch);
+	RUN_TEST(test_slow_handler_ends_the_batch);
+	RUN_TEST(test_burst_feeds);
+	return UNITY_END();
+}
@@ -0,0 +1,158 @@
+// Batched writes: the parts of a frame written and output in one call into
+// the lwIP thread (pio test -e native_asynctcp)
+
+#include <unity.h>
+#include <string.h>
+#include <AsyncTCPSim.h>
+#include <AsyncTCP.h>
+
+static AsyncClient *accepted;
+static uint32_t freed;
+
+static AsyncClient *acceptClient(tcp_pcb *pcb)
+{
+	__atomic_store_n(&accepted, (AsyncClient *)NULL, __ATOMIC_RELEASE);
+	AsyncTCPSim::accept(pcb);
+	while (!__atomic_load_n(&accepted, __ATOMIC_ACQUIRE)) AsyncTCPSim::settle(1);
+	return accepted;
+}
+
+static AsyncTxBuffer *newBuffer(const char *data, size_t size)
+{
+	return new AsyncTxBuffer(data, size, [](void *, const char *) {
+		__atomic_fetch_add(&freed, 1, __ATOMIC_RELAXED);
+	});
+}
+
+static uint32_t freedBuffers(void)
+{
+	return __atomic_load_n(&freed, __ATOMIC_RELAXED);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+	AsyncTCPSim::settle();
+}
+
+void test_frame_is_one_api_call(void)
+{
+	tcp_pcb *pa = AsyncTCPSim::newPcb();
+	tcp_pcb *pb = AsyncTCPSim::newPcb();
+	AsyncClient *a = acceptClient(pa);
+	AsyncClient *b = acceptClient(pb);
+	const int frames = 10;
+	char header[2] = {(char)0x82, 100};
+	char payload[100];
+	uint32_t calls;
+
+	for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (char)i;
+
+	calls = AsyncTCPSim::apiCalls();
+	for (int i = 0; i < frames; i++) {
+		TEST_ASSERT_EQUAL(sizeof(header), a->add(header, sizeof(header)));
+		TEST_ASSERT_EQUAL(sizeof(payload), a->add(payload, sizeof(payload)));
+		TEST_ASSERT_TRUE(a->send());
+	}
+	uint32_t added = AsyncTCPSim::apiCalls() - calls;
+
+	calls = AsyncTCPSim::apiCalls();
+	for (int i = 0; i < frames; i++) {
+		async_write_t parts[] = {
+			{header, sizeof(header), ASYNC_WRITE_FLAG_COPY, NULL},
+			{payload, sizeof(payload), ASYNC_WRITE_FLAG_COPY, NULL},
+		};
+		TEST_ASSERT_EQUAL(sizeof(header) + sizeof(payload), b->write(parts, 2));
+	}
+	uint32_t batched = AsyncTCPSim::apiCalls() - calls;
+
+	TEST_ASSERT_EQUAL_UINT32(3 * frames, added);
+	TEST_ASSERT_EQUAL_UINT32(frames, batched);
+	TEST_ASSERT_EQUAL_UINT32(frames, AsyncTCPSim::outputs(pa));
+	TEST_ASSERT_EQUAL_UINT32(frames, AsyncTCPSim::outputs(pb));
+	TEST_ASSERT_TRUE(AsyncTCPSim::written(pa) == AsyncTCPSim::written(pb));
+	TEST_ASSERT_EQUAL(frames * (sizeof(header) + sizeof(payload)), AsyncTCPSim::written(pb).size());
+}
+
+void test_partial_write_holds_buffer_until_acked(void)
+{
+	tcp_pcb *pcb = AsyncTCPSim::newPcb(30);
+	AsyncClient *client = acceptClient(pcb);
+	static const char data[50] = "frame";
+	AsyncTxBuffer *buffer = newBuffer(data, sizeof(data));
+	async_write_t part = {buffer->data(), buffer->size(), 0, buffer};
+	uint32_t before = freedBuffers();
+
+	// the send buffer takes 30 bytes, the rest is the caller's to retry
+	TEST_ASSERT_EQUAL(30, client->write(&part, 1));
+	TEST_ASSERT_EQUAL(30, AsyncTCPSim::written(pcb).size());
+	TEST_ASSERT_EQUAL(0, client->write(&part, 1));
+	buffer->unref();
+
+	AsyncTCPSim::ack(pcb, 20);
+	AsyncTCPSim::settle();
+	TEST_ASSERT_EQUAL_UINT32(0, freedBuffers() - before);
+	AsyncTCPSim::ack(pcb, 10);
+	AsyncTCPSim::settle();
+	TEST_ASSERT_EQUAL_UINT32(1, freedBuffers() - before);
+}
+
+void test_batch_stops_at_the_buffer_ring(void)
+{
+	tcp_pcb *pcb = AsyncTCPSim::newPcb();
+	AsyncClient *client = acceptClient(pcb);
+	static const char data[10] = "part";
+	const int count = CONFIG_ASYNC_TCP_TX_BUFFERS + 1;
+	AsyncTxBuffer *buffers[count];
+	async_write_t parts[count];
+	uint32_t before = freedBuffers();
+
+	for (int i = 0; i < count; i++) {
+		buffers[i] = newBuffer(data, sizeof(data));
+		parts[i] = {buffers[i]->data(), buffers[i]->size(), 0, buffers[i]};
+	}
+
+	// one reference per buffer, the last part finds the ring full
+	TEST_ASSERT_EQUAL(CONFIG_ASYNC_TCP_TX_BUFFERS * sizeof(data), client->write(parts, count));
+	for (int i = 0; i < count; i++) buffers[i]->unref();
+	TEST_ASSERT_EQUAL_UINT32(1, freedBuffers() - before);
+
+	AsyncTCPSim::ack(pcb, CONFIG_ASYNC_TCP_TX_BUFFERS * sizeof(data));
+	AsyncTCPSim::settle();
+	TEST_ASSERT_EQUAL_UINT32(count, freedBuffers() - before);
+}
+
+void test_closed_client_writes_nothing(void)
+{
+	tcp_pcb *pcb = AsyncTCPSim::newPcb();
+	AsyncClient *client = acceptClient(pcb);
+	char data[4] = "abc";
+	async_write_t part = {data, sizeof(data), ASYNC_WRITE_FLAG_COPY, NULL};
+	uint32_t calls;
+
+	client->close();
+	calls = AsyncTCPSim::apiCalls();
+	TEST_ASSERT_EQUAL(0, client->write(&part, 1));
+	TEST_ASSERT_EQUAL_UINT32(0, AsyncTCPSim::apiCalls() - calls);
+	TEST_ASSERT_EQUAL(0, AsyncTCPSim::written(pcb).size());
+}
+
+int main(int argc, char **argv)
+{
+	// lives as long as the process, like a sketch's
+	AsyncServer *server = new AsyncServer(80);
+	server->onClient([](void *, AsyncClient *c) {
+		__atomic_store_n(&accepted, c, __ATOMIC_RELEASE);
+	}, NULL);
+	server->begin();
+
+	UNITY_BEGIN();
+	RUN_TEST(test_frame_is_one_api_call);
+	RUN_TEST(test_partial_write_holds_buffer_until_acked);
+	RUN_TEST(test_batch_stops_at_the_buffer_ring);
+	RUN_TEST(test_closed_client_writes_nothing);
+	return UNITY_END();
+}
@@ -0,0 +1,155 @@
+// OneWireCRC kernels: identical results at every length and alignment,
+// and their host speed (pio test -e native -v shows the timings)
+
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <OneWire.h>
+#include <OneWireCRC.h>
+
+#define MAX_LEN    300
+#define ALIGNMENTS 8
+#define RUNS       2000
+
+typedef uint8_t (*Crc8Kernel)(const uint8_t *, uint16_t, uint8_t);
+typedef uint16_t (*Crc16Kernel)(const uint8_t *, uint16_t, uint16_t);
+
+static const char *names[] = { "Bitwise", "Nibble", "Table", "Slice4" };
+static const Crc8Kernel crc8Kernels[] = {
+	OneWireCRC::crc8Bitwise, OneWireCRC::crc8Nibble,
+	OneWireCRC::crc8Table, OneWireCRC::crc8Slice4
+};
+static const Crc16Kernel crc16Kernels[] = {
+	OneWireCRC::crc16Bitwise, OneWireCRC::crc16Nibble,
+	OneWireCRC::crc16Table, OneWireCRC::crc16Slice4
+};
+#define KERNELS (sizeof(names) / sizeof(names[0]))
+
+static uint8_t block[MAX_LEN + ALIGNMENTS];
+static const uint8_t check[] = "123456789";
+
+void setUp(void)
+{
+	uint32_t x = 1;
+
+	// fixed pseudo-random contents (xorshift)
+	for (uint16_t i = 0; i < sizeof(block); i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		block[i] = (uint8_t)x;
+	}
+}
+
+void tearDown(void)
+{
+}
+
+// Catalogue check values: CRC-8/MAXIM and CRC-16/ARC of "123456789"
+void test_check_values(void)
+{
+	for (uint8_t k = 0; k < KERNELS; k++) {
+		TEST_ASSERT_EQUAL_HEX8(0xA1, crc8Kernels[k](check, 9, 0));
+		TEST_ASSERT_EQUAL_HEX16(0xBB3D, crc16Kernels[k](check, 9, 0));
+	}
+	TEST_ASSERT_EQUAL_HEX8(0xA1, OneWire::crc8(check, 9));
+	TEST_ASSERT_EQUAL_HEX16(0xBB3D, OneWireCRC::crc16(check, 9));
+}
+
+void test_crc8_kernels_agree(void)
+{
+	static const uint8_t seeds[] = { 0x00, 0x5A, 0xFF };
+	char where[48];
+
+	for (uint8_t s = 0; s < sizeof(seeds); s++) {
+		for (uint8_t a = 0; a < ALIGNMENTS; a++) {
+			for (uint16_t len = 0; len < MAX_LEN; len++) {
+				uint8_t expected = OneWireCRC::crc8Bitwise(block + a, len, seeds[s]);
+				for (uint8_t k = 1; k < KERNELS; k++) {
+					uint8_t crc = crc8Kernels[k](block + a, len, seeds[s]);
+					if (crc != expected) {
+						snprintf(where, sizeof(where), "crc8%s len %u align %u seed 0x%02X",
+						         names[k], len, a, seeds[s]);
+						TEST_ASSERT_EQUAL_HEX8_MESSAGE(expected, crc, where);
+					}
+				}
+			}
+		}
+	}
+}
+
+void test_crc16_kernels_agree(void)
+{
+	static const uint16_t seeds[] = { 0x0000, 0x1D0F, 0xFFFF };
+	char where[48];
+
+	for (uint8_t s = 0; s < sizeof(seeds) / sizeof(seeds[0]); s++) {
+		for (uint8_t a = 0; a < ALIGNMENTS; a++) {
+			for (uint16_t len = 0; len < MAX_LEN; len++) {
+				uint16_t expected = OneWireCRC::crc16Bitwise(block + a, len, seeds[s]);
+				for (uint8_t k = 1; k < KERNELS; k++) {
+					uint16_t crc = crc16Kernels[k](block + a, len, seeds[s]);
+					if (crc != expected) {
+						snprintf(where, sizeof(where), "crc16%s len %u align %u seed 0x%04X",
+						         names[k], len, a, seeds[s]);
+						TEST_ASSERT_EQUAL_HEX16_MESSAGE(expected, crc, where);
+					}
+				}
+			}
+		}
+	}
+}
+
+// Chaining: a CRC over two pieces equals the CRC over the whole
+void test_kernels_chain(void)
+{
+	for (uint8_t k = 0; k < KERNELS; k++) {
+		for (uint16_t split = 0; split <= 64; split++) {
+			TEST_ASSERT_EQUAL_HEX8(crc8Kernels[k](block, 64, 0),
+				crc8Kernels[k](block + split, 64 - split, crc8Kernels[k](block, split, 0)));
+			TEST_ASSERT_EQUAL_HEX16(crc16Kernels[k](block, 64, 0),
+				crc16Kernels[k](block + split, 64 - split, crc16Kernels[k](block, split, 0)));
+		}
+	}
+}
+
+static double nanosPerByte(std::chrono::steady_clock::duration elapsed, uint16_t len)
+{
+	return std::chrono::duration<double, std::nano>(elapsed).count() / ((double)RUNS * len);
+}
+
+// Not a pass/fail check: the host numbers only rank the kernels, use
+// examples/CRCBenchmark for a board
+void test_kernel_timing(void)
+{
+	static const uint16_t lens[] = { 9, 256 };
+	volatile uint16_t sink = 0;
+	char line[80];
+
+	for (uint8_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+		for (uint8_t k = 0; k < KERNELS; k++) {
+			auto start = std::chrono::steady_clock::now();
+			for (uint16_t i = 0; i < RUNS; i++) sink += crc8Kernels[k](block, lens[l], (uint8_t)i);
+			double crc8 = nanosPerByte(std::chrono::steady_clock::now() - start, lens[l]);
+
+			start = std::chrono::steady_clock::now();
+			for (uint16_t i = 0; i < RUNS; i++) sink += crc16Kernels[k](block, lens[l], i);
+			double crc16 = nanosPerByte(std::chrono::steady_clock::now() - start, lens[l]);
+
+			snprintf(line, sizeof(line), "%-7s %3u bytes: crc8 %6.2f ns/byte, crc16 %6.2f ns/byte",
+			         names[k], lens[l], crc8, crc16);
+			TEST_MESSAGE(line);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_check_values);
+	RUN_TEST(test_crc8_kernels_agree);
+	RUN_TEST(test_crc16_kernels_agree);
+	RUN_TEST(test_kernels_chain);
+	RUN_TEST(test_kernel_timing);
+	return UNITY_END();
+}
@@ -0,0 +1,172 @@
+// Hot-plug detection by DallasTemperature::pollDevices() on the simulated
+// bus (pio test -e native)
+
+#include <unity.h>
+#include <OneWireSim.h>
+#include <DallasTemperature.h>
+
+static uint8_t eventAddress[8];
+static bool eventAdded;
+static uint8_t events;
+
+static void onDeviceEvent(const uint8_t *deviceAddress, bool added)
+{
+	memcpy(eventAddress, deviceAddress, 8);
+	eventAdded = added;
+	events++;
+}
+
+// Polls until a device event or 'limit' calls; returns the number of
+// calls made, the last one being the one that raised the event, or
+// limit + 1 when nothing changed
+static uint16_t pollUntilEvent(DallasTemperature &sensors, uint16_t limit)
+{
+	for (uint16_t n = 1; n <= limit; n++) {
+		if (sensors.pollDevices()) return n;
+	}
+	return limit + 1;
+}
+
+void setUp(void)
+{
+	OneWireSimClock::set(0);
+	events = 0;
+}
+
+void tearDown(void)
+{
+}
+
+// A pass of pollDevices() is one call per table entry to verify it, then
+// for each family in the poll list one search step per device of that
+// family plus the step that ends its search, then one call that wraps.
+// Two DS18B20s make a pass of 2 + (1 + 3 + 1 + 1 + 1) + 1 = 10 calls.
+
+void test_stable_bus_raises_no_events(void)
+{
+	OneWireSimBus bus;
+	OneWireSimDS18x20 a(DS18B20_FAMILY, 0x01);
+	OneWireSimDS18x20 b(DS18B20_FAMILY, 0x02);
+	bus.attach(&a);
+	bus.attach(&b);
+	OneWire oneWire(&bus);
+	DallasTemperature sensors(&oneWire);
+
+	sensors.setDeviceEventHandler(onDeviceEvent);
+	sensors.begin();
+	TEST_ASSERT_EQUAL(2, sensors.getDeviceCount());
+	TEST_ASSERT_EQUAL(201, pollUntilEvent(sensors, 200));
+	TEST_ASSERT_EQUAL(0, events);
+	TEST_ASSERT_EQUAL(2, sensors.getDeviceCount());
+}
+
+void test_added_device(void)
+{
+	OneWireSimBus bus;
+	OneWireSimDS18x20 a(DS18B20_FAMILY, 0x01);
+	OneWireSimDS18x20 s(DS18S20_FAMILY, 0x05);
+	OneWireSimDS18x20 b(DS18B20_FAMILY, 0x02);
+	bus.attach(&a);
+	OneWire oneWire(&bus);
+	DallasTemperature sensors(&oneWire);
+	DeviceAddress addr;
+
+	sensors.setDeviceEventHandler(onDeviceEvent);
+	sensors.begin();
+	TEST_ASSERT_EQUAL(1, sensors.getDeviceCount());
+
+	// DS18S20 is the first family searched, right after verifying 'a'
+	bus.attach(&s);
+	TEST_ASSERT_EQUAL(2, pollUntilEvent(sensors, 100));
+	TEST_ASSERT_TRUE(eventAdded);
+	TEST_ASSERT_EQUAL_MEMORY(s.address(), eventAddress, 8);
+	TEST_ASSERT_EQUAL(2, sensors.getDeviceCount());
+	TEST_ASSERT_TRUE(sensors.getAddress(addr, 1));
+	TEST_ASSERT_EQUAL_MEMORY(s.address(), addr, 8);
+
+	// the new entry is verified next, the DS18S20 search ends, and 'b'
+	// sorts ahead of 'a' so it is the first step of the DS18B20 search
+	bus.attach(&b);
+	TEST_ASSERT_EQUAL(3, pollUntilEvent(sensors, 100));
+	TEST_ASSERT_TRUE(eventAdded);
+	TEST_ASSERT_EQUAL_MEMORY(b.address(), eventAddress, 8);
+	TEST_ASSERT_EQUAL(3, sensors.getDeviceCount());
+
+	// and nothing else turns up
+	TEST_ASSERT_EQUAL(101, pollUntilEvent(sensors, 100));
+	TEST_ASSERT_EQUAL(2, events);
+	TEST_ASSERT_EQUAL(3, sensors.getDeviceCount());
+}
+
+void test_removed_device(void)
+{
+	OneWireSimBus bus;
+	OneWireSimDS18x20 a(DS18B20_FAMILY, 0x01);
+	OneWireSimDS18x20 b(DS18B20_FAMILY, 0x02);
+	bus.attach(&a);
+	bus.attach(&b);
+	OneWire oneWire(&bus);
+	DallasTemperature sensors(&oneWire);
+	DeviceAddress addr;
+
+	sensors.setDeviceEventHandler(onDeviceEvent);
+	sensors.begin();
+	TEST_ASSERT_TRUE(sensors.getAddress(addr, 1));
+	TEST_ASSERT_EQUAL_MEMORY(a.address(), addr, 8);
+
+	// 'a' is verified on the second call of each pass; with one DS18B20
+	// left on the bus a pass is 2 + (1 + 2 + 1 + 1 + 1) + 1 = 9 calls
+	bus.detach(&a);
+	TEST_ASSERT_EQUAL(2 + (DALLAS_POLL_MISSES - 1) * 9, pollUntilEvent(sensors, 100));
+	TEST_ASSERT_FALSE(eventAdded);
+	TEST_ASSERT_EQUAL_MEMORY(a.address(), eventAddress, 8);
+	TEST_ASSERT_EQUAL(1, sensors.getDeviceCount());
+	TEST_ASSERT_TRUE(sensors.getAddress(addr, 0));
+	TEST_ASSERT_EQUAL_MEMORY(b.address(), addr, 8);
+
+	// once dropped it is found again like any new device
+	bus.attach(&a);
+	TEST_ASSERT_LESS_OR_EQUAL(9, pollUntilEvent(sensors, 100));
+	TEST_ASSERT_TRUE(eventAdded);
+	TEST_ASSERT_EQUAL_MEMORY(a.address(), eventAddress, 8);
+}
+
+void test_brief_dropout_is_kept(void)
+{
+	OneWireSimBus bus;
+	OneWireSimDS18x20 a(DS18B20_FAMILY, 0x01);
+	bus.attach(&a);
+	OneWire oneWire(&bus);
+	DallasTemperature sensors(&oneWire);
+
+	sensors.setDeviceEventHandler(onDeviceEvent);
+	sensors.begin();
+
+	// on an empty bus every family search ends at once, a pass is
+	// 1 + 5 + 1 = 7 calls: miss one verify less than the limit
+	bus.detach(&a);
+	TEST_ASSERT_EQUAL((DALLAS_POLL_MISSES - 1) * 7 + 1,
+	                  pollUntilEvent(sensors, (DALLAS_POLL_MISSES - 1) * 7));
+	TEST_ASSERT_EQUAL(1, sensors.getDeviceCount());
+
+	// a successful verify clears the misses: one pass with 'a' back
+	// (1 + (1 + 2 + 1 + 1 + 1) + 1 = 8 calls), then the full count of
+	// misses is needed again
+	bus.attach(&a);
+	TEST_ASSERT_EQUAL(9, pollUntilEvent(sensors, 8));
+	bus.detach(&a);
+	TEST_ASSERT_EQUAL(1 + (DALLAS_POLL_MISSES - 1) * 7, pollUntilEvent(sensors, 100));
+	TEST_ASSERT_EQUAL(1, events);
+	TEST_ASSERT_FALSE(eventAdded);
+	TEST_ASSERT_EQUAL(0, sensors.getDeviceCount());
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_stable_bus_raises_no_events);
+	RUN_TEST(test_added_device);
+	RUN_TEST(test_removed_device);
+	RUN_TEST(test_brief_dropout_is_kept);
+	return UNITY_END();
+}
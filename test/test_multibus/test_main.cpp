@@ -0,0 +1,122 @@
+// OneWireMultiBus clocking several simulated buses in parallel
+// (pio test -e native)
+
+#include <unity.h>
+#include <OneWireSim.h>
+#include <OneWireMultiBus.h>
+
+#define READSCRATCH 0xBE
+#define STARTCONVO  0x44
+
+#define BUSES 3
+
+// register bits deliberately sparse and out of order
+static const uint8_t bits[BUSES] = { 17, 4, 25 };
+
+void setUp(void)
+{
+	OneWireSimClock::set(0);
+}
+
+void tearDown(void)
+{
+}
+
+static int16_t scratchTemperature(const uint8_t *pad)
+{
+	return (int16_t)((pad[1] << 8) | pad[0]);
+}
+
+void test_per_bus_status(void)
+{
+	OneWireSimBus bus[BUSES];
+	OneWireSimDS18x20 a(DS18B20_FAMILY, 0x01);
+	OneWireSimDS18x20 c(DS18B20_FAMILY, 0x03);
+	OneWireSimMultiBusPort port;
+	OneWireMultiBus<OneWireSimMultiBusPort> multi(port);
+	uint8_t status[BUSES];
+	uint8_t pad[BUSES * 9];
+
+	// bus 1 stays empty
+	bus[0].attach(&a);
+	bus[2].attach(&c);
+	for (uint8_t b = 0; b < BUSES; b++) port.connect(bits[b], &bus[b]);
+	multi.begin(bits, BUSES);
+	TEST_ASSERT_EQUAL(BUSES, multi.busCount());
+
+	TEST_ASSERT_EQUAL(2, multi.reset(status));
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_OK, status[0]);
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_NO_PRESENCE, status[1]);
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_OK, status[2]);
+
+	// a corrupted scratchpad on one bus does not affect the others
+	c.injectCrcErrors(1);
+	TEST_ASSERT_EQUAL(1, multi.transaction(NULL, READSCRATCH, pad, 9, true, status));
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_OK, status[0]);
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_NO_PRESENCE, status[1]);
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_CRC_ERROR, status[2]);
+	TEST_ASSERT_EQUAL_HEX8(OneWire::crc8(pad, 8), pad[8]);
+
+	TEST_ASSERT_EQUAL(2, multi.transaction(NULL, READSCRATCH, pad, 9, true, status));
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_OK, status[2]);
+	TEST_ASSERT_EQUAL_HEX8(OneWire::crc8(pad + 18, 8), pad[26]);
+
+	// a reset that misses presence shows up on that bus only
+	bus[0].failResets(1);
+	TEST_ASSERT_EQUAL(1, multi.reset(status));
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_NO_PRESENCE, status[0]);
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_OK, status[2]);
+}
+
+void test_independent_results(void)
+{
+	OneWireSimBus bus[BUSES];
+	OneWireSimDS18x20 dev[BUSES] = {
+		OneWireSimDS18x20(DS18B20_FAMILY, 0x10),
+		OneWireSimDS18x20(DS18B20_FAMILY, 0x20),
+		OneWireSimDS18x20(DS18B20_FAMILY, 0x30)
+	};
+	const float temps[BUSES] = { 23.5f, -5.0625f, 99.75f };
+	OneWireSimMultiBusPort port;
+	OneWireMultiBus<OneWireSimMultiBusPort> multi(port);
+	uint8_t roms[BUSES][8];
+	uint8_t status[BUSES];
+	uint8_t pad[BUSES * 9];
+
+	for (uint8_t b = 0; b < BUSES; b++) {
+		dev[b].setTemperature(temps[b]);
+		bus[b].attach(&dev[b]);
+		port.connect(bits[b], &bus[b]);
+		memcpy(roms[b], dev[b].address(), 8);
+	}
+	multi.begin(bits, BUSES);
+
+	// one conversion command starts all buses
+	TEST_ASSERT_EQUAL(BUSES, multi.reset(status));
+	multi.select(roms);
+	multi.write(STARTCONVO);
+	delay(dev[0].conversionMillis());
+
+	TEST_ASSERT_EQUAL(BUSES, multi.transaction(roms, READSCRATCH, pad, 9, true, status));
+	for (uint8_t b = 0; b < BUSES; b++) {
+		TEST_ASSERT_EQUAL(ONEWIRE_MB_OK, status[b]);
+		TEST_ASSERT_EQUAL_UINT32(1, dev[b].conversions());
+		TEST_ASSERT_EQUAL_INT16((int16_t)(temps[b] * 16), scratchTemperature(pad + b * 9));
+	}
+
+	// a ROM that is not on a bus leaves that bus silent
+	roms[1][1] ^= 0xFF;
+	TEST_ASSERT_EQUAL(BUSES - 1, multi.transaction(roms, READSCRATCH, pad, 9, true, status));
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_OK, status[0]);
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_CRC_ERROR, status[1]);
+	TEST_ASSERT_EQUAL(ONEWIRE_MB_OK, status[2]);
+	TEST_ASSERT_EQUAL_INT16((int16_t)(temps[2] * 16), scratchTemperature(pad + 18));
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_per_bus_status);
+	RUN_TEST(test_independent_results);
+	return UNITY_END();
+}
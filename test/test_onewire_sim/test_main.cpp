@@ -0,0 +1,359 @@
+// Search, CRC and driver behaviour of OneWire and DallasTemperature on the
+// simulated bus (pio test -e native)
+
+#include <unity.h>
+#include <OneWireSim.h>
+#include <DallasTemperature.h>
+
+#define READSCRATCH 0xBE
+#define STARTCONVO  0x44
+
+void setUp(void)
+{
+	OneWireSimClock::set(0);
+}
+
+void tearDown(void)
+{
+}
+
+// Devices whose ROMs share long prefixes, so the search has to resolve
+// discrepancies deep in the ROM as well as at the family code
+static void searchAll(OneWireSimBus::Mode mode)
+{
+	OneWireSimBus bus(mode);
+	OneWireSimDS18x20 a(DS18B20_FAMILY, 0x000001);
+	OneWireSimDS18x20 b(DS18B20_FAMILY, 0x000002);
+	OneWireSimDS18x20 c(DS18B20_FAMILY, 0x800001);
+	OneWireSimDS18x20 d(DS18S20_FAMILY, 0x000001);
+	OneWireSimDS18x20 e(DS18S20_FAMILY, 0xFFFFFF);
+	OneWireSimDS18x20 *devices[] = { &a, &b, &c, &d, &e };
+	const uint8_t n = sizeof(devices) / sizeof(devices[0]);
+	bool found[n] = { false };
+	uint8_t addr[8];
+	uint8_t count = 0;
+
+	for (uint8_t i = 0; i < n; i++) bus.attach(devices[i]);
+	OneWire oneWire(&bus);
+
+	oneWire.reset_search();
+	while (oneWire.search(addr)) {
+		TEST_ASSERT_EQUAL_HEX8(OneWire::crc8(addr, 7), addr[7]);
+		for (uint8_t i = 0; i < n; i++) {
+			if (memcmp(addr, devices[i]->address(), 8) == 0) {
+				TEST_ASSERT_FALSE(found[i]);
+				found[i] = true;
+			}
+		}
+		count++;
+		TEST_ASSERT_LESS_OR_EQUAL(n, count);
+	}
+	TEST_ASSERT_EQUAL(n, count);
+	for (uint8_t i = 0; i < n; i++) TEST_ASSERT_TRUE(found[i]);
+
+	// a family search only returns devices of that family
+	oneWire.target_search(DS18S20_FAMILY);
+	count = 0;
+	while (oneWire.search(addr) && addr[0] == DS18S20_FAMILY) count++;
+	TEST_ASSERT_EQUAL(2, count);
+
+	// verify() is steered along one ROM
+	TEST_ASSERT_TRUE(oneWire.verify(c.address()));
+	bus.detach(&c);
+	TEST_ASSERT_FALSE(oneWire.verify(c.address()));
+}
+
+void test_search_slot_accurate(void)
+{
+	searchAll(OneWireSimBus::SLOT_ACCURATE);
+}
+
+void test_search_byte_accurate(void)
+{
+	searchAll(OneWireSimBus::BYTE_ACCURATE);
+}
+
+void test_search_empty_bus(void)
+{
+	OneWireSimBus bus;
+	OneWire oneWire(&bus);
+	uint8_t addr[8];
+
+	oneWire.reset_search();
+	TEST_ASSERT_FALSE(oneWire.search(addr));
+	TEST_ASSERT_EQUAL(0, oneWire.reset());
+}
+
+void test_crc_error_injection(void)
+{
+	OneWireSimBus bus;
+	OneWireSimDS18x20 probe(DS18B20_FAMILY, 0x1234);
+	bus.attach(&probe);
+	OneWire oneWire(&bus);
+	uint8_t pad[9];
+	const uint8_t command[] = { READSCRATCH };
+	OneWireTransaction txn = { probe.address(), command, 1, pad, 9,
+	                           ONEWIRE_TXN_RESET | ONEWIRE_TXN_CHECK_CRC8 };
+
+	probe.injectCrcErrors(2);
+	TEST_ASSERT_EQUAL(ONEWIRE_TXN_CRC_ERROR, oneWire.transaction(txn));
+	TEST_ASSERT_EQUAL(ONEWIRE_TXN_CRC_ERROR, oneWire.transaction(txn));
+	TEST_ASSERT_EQUAL(ONEWIRE_TXN_OK, oneWire.transaction(txn));
+	TEST_ASSERT_EQUAL_HEX8(OneWire::crc8(pad, 8), pad[8]);
+
+	// the driver reports the error and recovers on the next read
+	DallasTemperature sensors(&oneWire);
+	DallasTemperature::reading_t r;
+	sensors.begin();
+	probe.setTemperature(21.5f);
+	sensors.requestTemperatures();
+	probe.injectCrcErrors(1);
+	TEST_ASSERT_FALSE(sensors.readByIndex(0, r));
+	TEST_ASSERT_EQUAL(DALLAS_READ_CRC_ERROR, r.status);
+	TEST_ASSERT_TRUE(sensors.readByIndex(0, r));
+	TEST_ASSERT_EQUAL(DALLAS_READ_OK, r.status);
+	TEST_ASSERT_EQUAL_INT32(DallasTemperature::celsiusToRaw(21.5f), r.raw);
+}
+
+void test_missing_presence(void)
+{
+	OneWireSimBus bus;
+	OneWireSimDS18x20 probe(DS18B20_FAMILY, 0x1234);
+	bus.attach(&probe);
+	OneWire oneWire(&bus);
+	uint8_t pad[9];
+	const uint8_t command[] = { READSCRATCH };
+	OneWireTransaction txn = { probe.address(), command, 1, pad, 9,
+	                           ONEWIRE_TXN_RESET | ONEWIRE_TXN_CHECK_CRC8 };
+
+	bus.failResets(1);
+	TEST_ASSERT_EQUAL(0, oneWire.reset());
+	TEST_ASSERT_EQUAL(1, oneWire.reset());
+
+	bus.failResets(1);
+	TEST_ASSERT_EQUAL(ONEWIRE_TXN_NO_PRESENCE, oneWire.transaction(txn));
+	TEST_ASSERT_EQUAL(ONEWIRE_TXN_OK, oneWire.transaction(txn));
+
+	DallasTemperature sensors(&oneWire);
+	DallasTemperature::reading_t r;
+	sensors.begin();
+	TEST_ASSERT_EQUAL(1, sensors.getDeviceCount());
+	sensors.requestTemperatures();
+	bus.failResets(1);
+	TEST_ASSERT_FALSE(sensors.readByIndex(0, r));
+	TEST_ASSERT_EQUAL(DALLAS_READ_DISCONNECTED, r.status);
+	TEST_ASSERT_EQUAL_INT32(DEVICE_DISCONNECTED_RAW, r.raw);
+	TEST_ASSERT_TRUE(sensors.readByIndex(0, r));
+}
+
+void test_parasite_conversion_with_pullup(void)
+{
+	OneWireSimBus bus;
+	OneWireSimDS18x20 probe(DS18B20_FAMILY, 0x1234);
+	probe.setParasite(true);
+	bus.attach(&probe);
+	OneWire oneWire(&bus);
+	DallasTemperature sensors(&oneWire);
+	DallasTemperature::reading_t r;
+
+	sensors.begin();
+	TEST_ASSERT_TRUE(sensors.isParasitePowerMode());
+	TEST_ASSERT_TRUE(sensors.readPowerSupply(probe.address()));
+
+	// the driver holds the strong pull-up for the whole conversion
+	probe.setTemperature(-10.25f);
+	sensors.requestTemperatures();
+	TEST_ASSERT_TRUE(sensors.readByIndex(0, r));
+	TEST_ASSERT_EQUAL_INT32(DallasTemperature::celsiusToRaw(-10.25f), r.raw);
+	TEST_ASSERT_EQUAL_UINT32(1, probe.conversions());
+	TEST_ASSERT_EQUAL_UINT32(0, probe.failedConversions());
+}
+
+void test_parasite_conversion_without_pullup(void)
+{
+	OneWireSimBus bus;
+	OneWireSimDS18x20 probe(DS18B20_FAMILY, 0x1234);
+	probe.setParasite(true);
+	bus.attach(&probe);
+	OneWire oneWire(&bus);
+	DallasTemperature sensors(&oneWire);
+	DallasTemperature::reading_t r;
+
+	sensors.begin();
+	probe.setTemperature(30.0f);
+
+	// start the conversion without the strong pull-up: the next slot
+	// drops the power and the device is left with the power-on value
+	oneWire.reset();
+	oneWire.skip();
+	oneWire.write(STARTCONVO, 0);
+	delay(probe.conversionMillis());
+	TEST_ASSERT_TRUE(sensors.readByIndex(0, r));
+	TEST_ASSERT_EQUAL_UINT32(1, probe.failedConversions());
+	TEST_ASSERT_EQUAL_INT32(DallasTemperature::celsiusToRaw(85.0f), r.raw);
+
+	// the same sequence with the pull-up held completes
+	oneWire.reset();
+	oneWire.skip();
+	oneWire.write(STARTCONVO, 1);
+	delay(probe.conversionMillis());
+	oneWire.depower();
+	TEST_ASSERT_TRUE(sensors.readByIndex(0, r));
+	TEST_ASSERT_EQUAL_UINT32(1, probe.failedConversions());
+	TEST_ASSERT_EQUAL_INT32(DallasTemperature::celsiusToRaw(30.0f), r.raw);
+}
+
+// Runs the conversion scheduler to the end in 10ms steps
+static void runConversion(DallasTemperature &sensors)
+{
+	while (!sensors.runConversion()) delay(10);
+}
+
+// Over the pull-up budget parasite devices convert one at a time; one
+// that misses presence is reported, not read with its old value
+void test_parasite_conversion_missing_presence(void)
+{
+	const uint8_t n = DALLAS_PULLUP_BUDGET_UA / DALLAS_CONVERSION_UA + 1;
+	OneWireSimBus bus(OneWireSimBus::BYTE_ACCURATE);
+	OneWireSimDS18x20 *probes[n];
+	OneWire oneWire(&bus);
+	DallasTemperature sensors(&oneWire);
+	DallasTemperature::conversionStats_t stats;
+	DallasTemperature::reading_t readings[n];
+	uint8_t addr[8];
+
+	for (uint8_t i = 0; i < n; i++) {
+		probes[i] = new OneWireSimDS18x20(DS18B20_FAMILY, 0x100 + i);
+		probes[i]->setParasite(true);
+		probes[i]->setTemperature(20.0f);
+		bus.attach(probes[i]);
+	}
+	sensors.begin();
+	TEST_ASSERT_EQUAL(n, sensors.getDeviceCount());
+	TEST_ASSERT_TRUE(sensors.startConversion());
+	runConversion(sensors);
+	TEST_ASSERT_EQUAL(n, sensors.readAll(readings, n));
+
+	// the reset before the second device's window gets no presence
+	for (uint8_t i = 0; i < n; i++) probes[i]->setTemperature(30.0f);
+	TEST_ASSERT_TRUE(sensors.startConversion());
+	bus.failResets(1);
+	runConversion(sensors);
+	sensors.getConversionStats(stats);
+	TEST_ASSERT_EQUAL(1, stats.notConverted);
+	TEST_ASSERT_EQUAL(n - 1, stats.windows);
+	TEST_ASSERT_EQUAL(n - 1, sensors.readAll(readings, n));
+	for (uint8_t i = 0; i < n; i++) {
+		if (i == 1) {
+			TEST_ASSERT_EQUAL(DALLAS_READ_NOT_CONVERTED, readings[i].status);
+			TEST_ASSERT_EQUAL_INT32(DEVICE_DISCONNECTED_RAW, readings[i].raw);
+		} else {
+			TEST_ASSERT_EQUAL(DALLAS_READ_OK, readings[i].status);
+			TEST_ASSERT_EQUAL_INT32(DallasTemperature::celsiusToRaw(30.0f), readings[i].raw);
+		}
+	}
+
+	// the next cycle converts it again
+	TEST_ASSERT_TRUE(sensors.startConversion());
+	runConversion(sensors);
+	sensors.getConversionStats(stats);
+	TEST_ASSERT_EQUAL(0, stats.notConverted);
+	TEST_ASSERT_EQUAL(n, sensors.readAll(readings, n));
+
+	// with no device answering there is no cycle
+	bus.failResets(n + 1);
+	TEST_ASSERT_FALSE(sensors.startConversion());
+	sensors.getConversionStats(stats);
+	TEST_ASSERT_EQUAL(n, stats.notConverted);
+	TEST_ASSERT_TRUE(sensors.getAddress(addr, 0));
+	TEST_ASSERT_EQUAL_INT32(DEVICE_DISCONNECTED_RAW, sensors.getTemp(addr));
+
+	for (uint8_t i = 0; i < n; i++) delete probes[i];
+}
+
+// TH/TL as the device's EEPROM holds them, recalled into the scratchpad
+static void recallAlarms(DallasTemperature &sensors, const uint8_t *addr, int8_t &high, int8_t &low)
+{
+	uint8_t pad[9];
+	TEST_ASSERT_TRUE(sensors.recallScratchPad(addr));
+	TEST_ASSERT_TRUE(sensors.readScratchPad(addr, pad));
+	high = (int8_t)pad[2];
+	low = (int8_t)pad[3];
+}
+
+// readByAlarm() windows take over TH/TL in the scratchpad, the alarms and
+// user data of the caller are what the getters see and the EEPROM keeps
+void test_alarm_window_stays_out_of_eeprom(void)
+{
+	OneWireSimBus bus(OneWireSimBus::BYTE_ACCURATE);
+	OneWireSimDS18x20 x(DS18B20_FAMILY, 0x01);
+	OneWireSimDS18x20 y(DS18B20_FAMILY, 0x02);
+	bus.attach(&x);
+	bus.attach(&y);
+	OneWire oneWire(&bus);
+	DallasTemperature sensors(&oneWire);
+	DallasTemperature::reading_t readings[2];
+	uint8_t pad[9];
+	int8_t high, low;
+
+	sensors.begin();
+	sensors.setUserData(x.address(), 0x1234);
+	sensors.setHighAlarmTemp(y.address(), 40);
+	sensors.setLowAlarmTemp(y.address(), -5);
+	x.setTemperature(20.0f);
+	y.setTemperature(20.0f);
+	sensors.requestTemperatures();
+	TEST_ASSERT_EQUAL(2, sensors.readByAlarm(readings, 2));
+	TEST_ASSERT_TRUE(sensors.readScratchPad(x.address(), pad));
+	TEST_ASSERT_EQUAL_INT8(20 + DALLAS_ALARM_WINDOW, (int8_t)pad[2]);
+	TEST_ASSERT_EQUAL_INT8(20 - DALLAS_ALARM_WINDOW, (int8_t)pad[3]);
+	TEST_ASSERT_EQUAL_INT16(0x1234, sensors.getUserData(x.address()));
+	TEST_ASSERT_EQUAL_INT8(40, sensors.getHighAlarmTemp(y.address()));
+	TEST_ASSERT_EQUAL_INT8(-5, sensors.getLowAlarmTemp(y.address()));
+
+	// a resolution change saved to EEPROM saves the user data, not the window
+	sensors.setResolution(x.address(), 10);
+	recallAlarms(sensors, x.address(), high, low);
+	TEST_ASSERT_EQUAL_HEX8(0x12, (uint8_t)high);
+	TEST_ASSERT_EQUAL_HEX8(0x34, (uint8_t)low);
+	TEST_ASSERT_EQUAL(10, sensors.getResolution(x.address()));
+
+	// as does a save of the whole bus
+	TEST_ASSERT_TRUE(sensors.saveScratchPad());
+	recallAlarms(sensors, y.address(), high, low);
+	TEST_ASSERT_EQUAL_INT8(40, high);
+	TEST_ASSERT_EQUAL_INT8(-5, low);
+
+	// a setter keeps the caller's other threshold, not the window's
+	sensors.requestTemperatures();
+	TEST_ASSERT_EQUAL(2, sensors.readByAlarm(readings, 2));
+	TEST_ASSERT_TRUE(sensors.readScratchPad(y.address(), pad));
+	TEST_ASSERT_EQUAL_INT8(20 + DALLAS_ALARM_WINDOW, (int8_t)pad[2]);
+	sensors.setLowAlarmTemp(y.address(), -10);
+	recallAlarms(sensors, y.address(), high, low);
+	TEST_ASSERT_EQUAL_INT8(40, high);
+	TEST_ASSERT_EQUAL_INT8(-10, low);
+
+	// and the next call reads and windows it again, x kept its window
+	sensors.requestTemperatures();
+	TEST_ASSERT_EQUAL(1, sensors.readByAlarm(readings, 2));
+	TEST_ASSERT_EQUAL(DALLAS_READ_OK, readings[1].status);
+	TEST_ASSERT_EQUAL_INT32(DallasTemperature::celsiusToRaw(20.0f), readings[1].raw);
+	sensors.requestTemperatures();
+	TEST_ASSERT_EQUAL(0, sensors.readByAlarm(readings, 2));
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_search_slot_accurate);
+	RUN_TEST(test_search_byte_accurate);
+	RUN_TEST(test_search_empty_bus);
+	RUN_TEST(test_crc_error_injection);
+	RUN_TEST(test_missing_presence);
+	RUN_TEST(test_parasite_conversion_with_pullup);
+	RUN_TEST(test_parasite_conversion_without_pullup);
+	RUN_TEST(test_parasite_conversion_missing_presence);
+	RUN_TEST(test_alarm_window_stays_out_of_eeprom);
+	return UNITY_END();
+}
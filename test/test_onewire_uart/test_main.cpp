@@ -0,0 +1,217 @@
+// OneWireUART, the UART transport, driving the simulated bus through
+// OneWireSimUARTPort (pio test -e native)
+
+#include <unity.h>
+#include <OneWireSim.h>
+#include <OneWireUART.h>
+#include <DallasTemperature.h>
+
+#define READSCRATCH 0xBE
+#define STARTCONVO  0x44
+
+// A bus behind a simulated UART, with the port statistics in reach
+struct UARTBus
+{
+	OneWireSimBus bus;
+	OneWireSimUARTPort port;
+	OneWireUART<OneWireSimUARTPort> uart;
+	OneWire oneWire;
+
+	UARTBus() : port(&bus), uart(port), oneWire(&uart) { uart.begin(); }
+};
+
+void setUp(void)
+{
+	OneWireSimClock::set(0);
+}
+
+void tearDown(void)
+{
+}
+
+void test_search(void)
+{
+	UARTBus w;
+	OneWireSimDS18x20 x(DS18B20_FAMILY, 0x000001);
+	OneWireSimDS18x20 y(DS18B20_FAMILY, 0x800001);
+	OneWireSimDS18x20 z(DS18S20_FAMILY, 0x000001);
+	OneWireSimDS18x20 *devices[] = { &x, &y, &z };
+	const uint8_t n = sizeof(devices) / sizeof(devices[0]);
+	bool found[n] = { false };
+	uint8_t addr[8];
+	uint8_t count = 0;
+
+	for (uint8_t i = 0; i < n; i++) w.bus.attach(devices[i]);
+
+	w.oneWire.reset_search();
+	while (w.oneWire.search(addr)) {
+		TEST_ASSERT_EQUAL_HEX8(OneWire::crc8(addr, 7), addr[7]);
+		for (uint8_t i = 0; i < n; i++) {
+			if (memcmp(addr, devices[i]->address(), 8) == 0) {
+				TEST_ASSERT_FALSE(found[i]);
+				found[i] = true;
+			}
+		}
+		count++;
+		TEST_ASSERT_LESS_OR_EQUAL(n, count);
+	}
+	TEST_ASSERT_EQUAL(n, count);
+	for (uint8_t i = 0; i < n; i++) TEST_ASSERT_TRUE(found[i]);
+
+	TEST_ASSERT_TRUE(w.oneWire.verify(y.address()));
+	w.bus.detach(&y);
+	TEST_ASSERT_FALSE(w.oneWire.verify(y.address()));
+}
+
+void test_scratchpad_write_and_alarm_search(void)
+{
+	UARTBus w;
+	OneWireSimDS18x20 x(DS18B20_FAMILY, 0x01);
+	OneWireSimDS18x20 y(DS18B20_FAMILY, 0x02);
+	OneWireSimDS18x20 z(DS18B20_FAMILY, 0x03);
+	w.bus.attach(&x);
+	w.bus.attach(&y);
+	w.bus.attach(&z);
+	DallasTemperature sensors(&w.oneWire);
+	uint8_t pad[9];
+	uint8_t addr[8];
+
+	sensors.begin();
+	TEST_ASSERT_EQUAL(3, sensors.getDeviceCount());
+
+	// the alarm thresholds go out as a scratchpad write
+	sensors.setHighAlarmTemp(x.address(), 100);
+	sensors.setLowAlarmTemp(x.address(), -10);
+	TEST_ASSERT_TRUE(sensors.readScratchPad(x.address(), pad));
+	TEST_ASSERT_EQUAL_INT8(100, (int8_t)pad[2]);
+	TEST_ASSERT_EQUAL_INT8(-10, (int8_t)pad[3]);
+	sensors.setHighAlarmTemp(y.address(), 20);
+	sensors.setLowAlarmTemp(y.address(), -10);
+	sensors.setHighAlarmTemp(z.address(), 100);
+	sensors.setLowAlarmTemp(z.address(), 30);
+
+	x.setTemperature(25.0f);
+	y.setTemperature(25.0f);
+	z.setTemperature(25.0f);
+	sensors.requestTemperatures();
+
+	// y is over its high threshold and z under its low one
+	uint8_t alarms = 0;
+	sensors.resetAlarmSearch();
+	while (sensors.alarmSearch(addr)) {
+		TEST_ASSERT_TRUE(memcmp(addr, y.address(), 8) == 0 || memcmp(addr, z.address(), 8) == 0);
+		alarms++;
+		TEST_ASSERT_LESS_OR_EQUAL(2, alarms);
+	}
+	TEST_ASSERT_EQUAL(2, alarms);
+	TEST_ASSERT_FALSE(sensors.hasAlarm(x.address()));
+}
+
+void test_read_all(void)
+{
+	UARTBus w;
+	OneWireSimDS18x20 x(DS18B20_FAMILY, 0x01);
+	OneWireSimDS18x20 y(DS18B20_FAMILY, 0x02);
+	OneWireSimDS18x20 z(DS18S20_FAMILY, 0x03);
+	OneWireSimDS18x20 *devices[] = { &x, &y, &z };
+	const float temps[] = { 23.5f, -5.0625f, 60.5f };
+	DallasTemperature::reading_t readings[3];
+	uint8_t addr[8];
+
+	for (uint8_t i = 0; i < 3; i++) {
+		devices[i]->setTemperature(temps[i]);
+		w.bus.attach(devices[i]);
+	}
+	DallasTemperature sensors(&w.oneWire);
+	sensors.begin();
+	sensors.requestTemperatures();
+
+	w.port.clearStats();
+	TEST_ASSERT_EQUAL(3, sensors.readAll(readings, 3));
+	for (uint8_t i = 0; i < 3; i++) {
+		TEST_ASSERT_TRUE(sensors.getAddress(addr, i));
+		for (uint8_t d = 0; d < 3; d++) {
+			if (memcmp(addr, devices[d]->address(), 8) != 0) continue;
+			TEST_ASSERT_EQUAL(DALLAS_READ_OK, readings[i].status);
+			TEST_ASSERT_EQUAL_INT32(DallasTemperature::celsiusToRaw(temps[d]), readings[i].raw);
+		}
+	}
+
+	// select and command of each device go out in one exchange, so there
+	// are far fewer exchanges than frames
+	TEST_ASSERT_LESS_THAN(w.port.frames() / 8, w.port.exchanges());
+}
+
+void test_missing_presence(void)
+{
+	UARTBus w;
+	OneWireSimDS18x20 probe(DS18B20_FAMILY, 0x1234);
+	w.bus.attach(&probe);
+	uint8_t pad[9];
+	const uint8_t command[] = { READSCRATCH };
+	OneWireTransaction txn = { probe.address(), command, 1, pad, 9,
+	                           ONEWIRE_TXN_RESET | ONEWIRE_TXN_CHECK_CRC8 };
+
+	w.bus.failResets(1);
+	TEST_ASSERT_EQUAL(0, w.oneWire.reset());
+	TEST_ASSERT_EQUAL(1, w.oneWire.reset());
+
+	w.bus.failResets(1);
+	TEST_ASSERT_EQUAL(ONEWIRE_TXN_NO_PRESENCE, w.oneWire.transaction(txn));
+	TEST_ASSERT_EQUAL(ONEWIRE_TXN_OK, w.oneWire.transaction(txn));
+	TEST_ASSERT_EQUAL_HEX8(OneWire::crc8(pad, 8), pad[8]);
+
+	w.bus.detach(&probe);
+	TEST_ASSERT_EQUAL(0, w.oneWire.reset());
+}
+
+void test_parasite_conversion(void)
+{
+	UARTBus w;
+	OneWireSimDS18x20 probe(DS18B20_FAMILY, 0x1234);
+	probe.setParasite(true);
+	w.bus.attach(&probe);
+	DallasTemperature sensors(&w.oneWire);
+	DallasTemperature::reading_t r;
+
+	sensors.begin();
+	TEST_ASSERT_TRUE(sensors.isParasitePowerMode());
+
+	// without power the next slot ends the conversion early
+	probe.setTemperature(30.0f);
+	w.oneWire.reset();
+	w.oneWire.skip();
+	w.oneWire.write(STARTCONVO, 0);
+	delay(probe.conversionMillis());
+	TEST_ASSERT_TRUE(sensors.readByIndex(0, r));
+	TEST_ASSERT_EQUAL_UINT32(1, probe.failedConversions());
+	TEST_ASSERT_EQUAL_INT32(DallasTemperature::celsiusToRaw(85.0f), r.raw);
+
+	// with power the port holds the strong pull-up until the next slot
+	w.oneWire.reset();
+	w.oneWire.skip();
+	w.oneWire.write(STARTCONVO, 1);
+	delay(probe.conversionMillis());
+	w.oneWire.depower();
+	TEST_ASSERT_TRUE(sensors.readByIndex(0, r));
+	TEST_ASSERT_EQUAL_UINT32(1, probe.failedConversions());
+	TEST_ASSERT_EQUAL_INT32(DallasTemperature::celsiusToRaw(30.0f), r.raw);
+
+	// and the driver does the same
+	probe.setTemperature(-10.25f);
+	sensors.requestTemperatures();
+	TEST_ASSERT_TRUE(sensors.readByIndex(0, r));
+	TEST_ASSERT_EQUAL_UINT32(1, probe.failedConversions());
+	TEST_ASSERT_EQUAL_INT32(DallasTemperature::celsiusToRaw(-10.25f), r.raw);
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_search);
+	RUN_TEST(test_scratchpad_write_and_alarm_search);
+	RUN_TEST(test_read_all);
+	RUN_TEST(test_missing_presence);
+	RUN_TEST(test_parasite_conversion);
+	return UNITY_END();
+}